@@ -7,21 +7,68 @@
 #
 # This class implements a minimal wrapping IPC server for `tb_lib`.
 # `__main__` shows a demonstrator for it, running a simulation and accessing its memory.
+#
+# If a shared memory region is requested, the simulator maps it into its memory
+# at `shm_base`. Accesses within it then bypass the FIFOs entirely.
 
 import os
 import sys
+import time
 import tempfile
 import subprocess
 import struct
+from multiprocessing import shared_memory
+
+
+class PollFuture:
+    """Result of a non-blocking `SnitchSim.poll_async`."""
+
+    def __init__(self, sim, tag: int):
+        self.sim = sim
+        self.tag = tag
+        self.value = None
+
+    def done(self) -> bool:
+        if self.value is None:
+            self.sim._reap()
+            self.value = self.sim.completions.pop(self.tag, None)
+        return self.value is not None
+
+    def result(self, timeout: float = None) -> int:
+        deadline = None if timeout is None else time.monotonic() + timeout
+        period = SnitchSim.POLL_PERIOD_MIN
+        while not self.done():
+            if deadline is not None and time.monotonic() > deadline:
+                raise TimeoutError(f'Poll with tag {self.tag} did not complete')
+            time.sleep(period)
+            period = min(2 * period, SnitchSim.POLL_PERIOD_MAX)
+        return self.value
 
 
 class SnitchSim:
 
-    def __init__(self, sim_bin: str, snitch_bin: str):
+    # Shared memory header layout; see `ipc_shm_hdr_t` in `ipc.hh`
+    SHM_MAGIC = 0x534e495443485348
+    SHM_DATA_OFFSET = 4096
+    SHM_DB_HEAD = 24
+    SHM_DB_TAIL = 32
+    SHM_DB_RING = 64
+    SHM_DB_RING_SIZE = 64
+    POLL_PERIOD_MIN = 1e-6
+    POLL_PERIOD_MAX = 1e-4
+
+    def __init__(self, sim_bin: str, snitch_bin: str, shm_base: int = None, shm_size: int = 0,
+                 sim_args: list = ()):
         self.sim_bin = sim_bin
         self.snitch_bin = snitch_bin
+        self.sim_args = list(sim_args)
+        self.shm_base = shm_base
+        self.shm_size = shm_size
+        self.shm = None
         self.sim = None
         self.tmpdir = None
+        self.next_tag = 0
+        self.completions = {}
 
     def start(self):
         # Create FIFOs
@@ -30,9 +77,14 @@ class SnitchSim:
         os.mkfifo(tx_fd)
         rx_fd = os.path.join(self.tmpdir.name, 'rx')
         os.mkfifo(rx_fd)
+        args = [self.sim_bin, self.snitch_bin, f'--ipc,{tx_fd},{rx_fd}', *self.sim_args]
+        # Create and initialize shared memory
+        if self.shm_size:
+            self.shm = shared_memory.SharedMemory(create=True, size=self.SHM_DATA_OFFSET + self.shm_size)
+            struct.pack_into('QQQQQ', self.shm.buf, 0, self.SHM_MAGIC, self.shm_base, self.shm_size, 0, 0)
+            args.append(f'--ipc-shm,/{self.shm.name},{self.shm_base:#x},{self.shm_size:#x}')
         # Start simulator process
-        ipc_arg = f'--ipc,{tx_fd},{rx_fd}'
-        self.sim = subprocess.Popen([self.sim_bin, self.snitch_bin, ipc_arg])
+        self.sim = subprocess.Popen(args)
         # Open FIFOs
         self.tx = open(tx_fd, 'wb')
         self.rx = open(rx_fd, 'rb')
@@ -44,8 +96,21 @@ class SnitchSim:
             return func(self, *args, **kwargs)
         return inner
 
+    def __in_shm(self, addr: int, length: int) -> bool:
+        return self.shm is not None and self.shm_base <= addr and addr + length <= self.shm_base + self.shm_size
+
+    @__sim_active
+    def view(self, addr: int, length: int) -> memoryview:
+        """Zero-copy view into the shared memory region, e.g. for `numpy.frombuffer`."""
+        if not self.__in_shm(addr, length):
+            raise ValueError(f'Range 0x{addr:x} + 0x{length:x} is not in shared memory')
+        offs = self.SHM_DATA_OFFSET + addr - self.shm_base
+        return self.shm.buf[offs:offs+length]
+
     @__sim_active
     def read(self, addr: int, length: int) -> bytes:
+        if self.__in_shm(addr, length):
+            return bytes(self.view(addr, length))
         op = struct.pack('QQQ', 0, addr, length)
         self.tx.write(op)
         self.tx.flush()
@@ -53,18 +118,115 @@ class SnitchSim:
 
     @__sim_active
     def write(self, addr: int, data: bytes):
+        data = memoryview(data).cast('B')
+        if self.__in_shm(addr, len(data)):
+            self.view(addr, len(data))[:] = data
+            return
         op = struct.pack('QQQ', 1, addr, len(data))
         self.tx.write(op)
         self.tx.write(data)
         self.tx.flush()
 
+    @__sim_active
+    def batch(self, ops) -> list:
+        """Submit reads `(addr, length)` and writes `(addr, data)` in one message.
+
+        Returns the data of all reads in order.
+        """
+        msg = bytearray()
+        reads = []
+        count = 0
+        for addr, arg in ops:
+            if isinstance(arg, int):
+                if self.__in_shm(addr, arg):
+                    reads.append(self.read(addr, arg))
+                    continue
+                msg += struct.pack('QQQ', 0, addr, arg)
+                reads.append(arg)
+            else:
+                data = memoryview(arg).cast('B')
+                if self.__in_shm(addr, len(data)):
+                    self.write(addr, data)
+                    continue
+                msg += struct.pack('QQQ', 1, addr, len(data))
+                msg += data
+            count += 1
+        if count:
+            self.tx.write(struct.pack('QQQ', 4, count, 0))
+            self.tx.write(msg)
+            self.tx.flush()
+        return [self.rx.read(r) if isinstance(r, int) else r for r in reads]
+
+    def read_gather(self, ranges) -> list:
+        """Read a list of `(addr, length)` ranges in one round trip."""
+        return self.batch(ranges)
+
+    def write_scatter(self, writes):
+        """Write a list of `(addr, data)` chunks in one message."""
+        self.batch(writes)
+
     @__sim_active
     def poll(self, addr: int, mask32: int, exp32: int):
-        # TODO: check endiannesses
-        op = struct.pack('QQLL', 2, addr, mask32, exp32)
+        # Words in shared memory are polled directly
+        if self.__in_shm(addr, 4):
+            period = self.POLL_PERIOD_MIN
+            while True:
+                read = int.from_bytes(self.view(addr, 4), 'little')
+                if read & mask32 == exp32 & mask32:
+                    return read
+                time.sleep(period)
+                period = min(2 * period, self.POLL_PERIOD_MAX)
+        # Otherwise, the simulator polls and completes through the doorbell ring
+        if self.shm is not None:
+            return self.poll_async(addr, mask32, exp32).result()
+        op = struct.pack('QQII', 2, addr, mask32, exp32)
         self.tx.write(op)
         self.tx.flush()
-        return int.from_bytes(self.rx.read(4))
+        return int.from_bytes(self.rx.read(4), 'little')
+
+    @__sim_active
+    def poll_async(self, addr: int, mask32: int, exp32: int) -> PollFuture:
+        """Start polling in the simulator without waiting for the result."""
+        tag = self.next_tag
+        self.next_tag += 1
+        op = struct.pack('QQIIQ', 3, addr, mask32, exp32, tag)
+        self.tx.write(op)
+        self.tx.flush()
+        return PollFuture(self, tag)
+
+    # Collect completed async polls from the doorbell ring or with a `Reap` op
+    def _reap(self):
+        if self.shm is not None:
+            tail, = struct.unpack_from('Q', self.shm.buf, self.SHM_DB_TAIL)
+            head, = struct.unpack_from('Q', self.shm.buf, self.SHM_DB_HEAD)
+            for i in range(tail, head):
+                entry = self.SHM_DB_RING + 16 * (i % self.SHM_DB_RING_SIZE)
+                tag, value = struct.unpack_from('QQ', self.shm.buf, entry)
+                self.completions[tag] = value
+            struct.pack_into('Q', self.shm.buf, self.SHM_DB_TAIL, head)
+        else:
+            self.tx.write(struct.pack('QQQ', 5, 0, 0))
+            self.tx.flush()
+            count = int.from_bytes(self.rx.read(8), 'little')
+            data = self.rx.read(16 * count)
+            for tag, value in struct.iter_unpack('QQ', data):
+                self.completions[tag] = value
+
+    @__sim_active
+    def snapshot(self, path: str):
+        """Dump the simulated memory to `path`, e.g. once the input data is loaded.
+
+        A later simulation started with `--restore=<path>` in `sim_args` then
+        boots with this memory and need not load the data again. Take it while
+        the DUT does not write to memory. The shared memory region is not saved.
+        """
+        path = os.fsencode(path)
+        self.tx.write(struct.pack('QQQ', 6, 0, len(path)))
+        self.tx.write(path)
+        self.tx.flush()
+        status, = struct.unpack('Q', self.rx.read(8))
+        if status:
+            raise RuntimeError(f'Simulator failed to write snapshot {os.fsdecode(path)}')
 
     # Simulator can exit only once TX FIFO closes
     @__sim_active
@@ -76,11 +238,15 @@ class SnitchSim:
         else:
             self.sim.terminate()
         self.tmpdir.cleanup()
+        if self.shm is not None:
+            self.shm.close()
+            self.shm.unlink()
+            self.shm = None
         self.sim = None
 
 
 if __name__ == "__main__":
-    sim = SnitchSim(*sys.argv[1:])
+    sim = SnitchSim(*sys.argv[1:3], shm_base=0x90000000, shm_size=0x100000)
     sim.start()
 
     wstr = b'This is a test string to be written to testbench memory.'
@@ -88,4 +254,12 @@ if __name__ == "__main__":
     rstr = sim.read(0xdeadbeef, len(wstr)+5)
     print(f'Read back string: `{rstr}`')
 
+    sim.write(0x90000000, wstr)
+    rstr = sim.read(0x90000000, len(wstr)+5)
+    print(f'Read back string from shared memory: `{rstr}`')
+
+    sim.write_scatter([(0x80000000 + 0x100 * i, bytes([i]) * 8) for i in range(16)])
+    tiles = sim.read_gather([(0x80000000 + 0x100 * i, 8) for i in range(16)])
+    print(f'Read back {len(tiles)} tiles in one batch: `{tiles[-1]}`')
+
     sim.finish(wait_for_sim=False)
@@ -2,6 +2,12 @@
 // Solderpad Hardware License, Version 0.51, see LICENSE for details.
 // SPDX-License-Identifier: SHL-0.51
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <iostream>
 
 #include "sim.hh"
@@ -23,11 +29,110 @@ asm(".global tb_bootrom_start \n"
 // The global memory all memory ports write into.
 GlobalMemory MEM;
 
+// Memory snapshot file layout: a header, the indices of all stored pages, and
+// the page contents, starting page-aligned such that they can be mapped.
+struct SnapshotHeader {
+    char magic[8];
+    uint64_t page_size;
+    uint64_t page_count;
+    uint64_t data_offset;
+};
+static constexpr char SNAPSHOT_MAGIC[8] = {'S', 'N', 'S', 'N',
+                                           'A', 'P', '0', '1'};
+
+bool GlobalMemory::save(const char *path) {
+    std::vector<uint64_t> indices;
+    {
+        std::lock_guard<std::mutex> guard(touched_lock);
+        indices.assign(touched.begin(), touched.end());
+    }
+    // Pages that were written to but only hold zeros need not be stored.
+    static const uint8_t zero[PAGE_SIZE] = {0};
+    indices.erase(std::remove_if(indices.begin(), indices.end(),
+                                 [&](uint64_t idx) {
+                                     return memcmp(find_page(idx)->data, zero,
+                                                   PAGE_SIZE) == 0;
+                                 }),
+                  indices.end());
+
+    SnapshotHeader hdr;
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.page_size = PAGE_SIZE;
+    hdr.page_count = indices.size();
+    hdr.data_offset = sizeof(hdr) + indices.size() * sizeof(uint64_t);
+    hdr.data_offset = (hdr.data_offset + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+
+    FILE *fd = fopen(path, "wb");
+    if (!fd) return false;
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fd) == 1;
+    ok &= fwrite(indices.data(), sizeof(uint64_t), indices.size(), fd) ==
+          indices.size();
+    ok &= fseek(fd, hdr.data_offset, SEEK_SET) == 0;
+    for (auto idx : indices)
+        ok &= fwrite(find_page(idx)->data, PAGE_SIZE, 1, fd) == 1;
+    return (fclose(fd) == 0) && ok;
+}
+
+bool GlobalMemory::load(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    void *file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) return false;
+
+    auto hdr = reinterpret_cast<const SnapshotHeader *>(file);
+    bool ok = memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) == 0 &&
+              hdr->page_size == PAGE_SIZE &&
+              hdr->data_offset + hdr->page_count * PAGE_SIZE <=
+                  (uint64_t)st.st_size;
+    if (ok) {
+        auto indices = reinterpret_cast<const uint64_t *>(hdr + 1);
+        auto data = reinterpret_cast<const uint8_t *>(file) + hdr->data_offset;
+        for (uint64_t i = 0; i < hdr->page_count; i++)
+            write(indices[i] << ADDR_SHIFT, PAGE_SIZE, data + i * PAGE_SIZE,
+                  nullptr);
+    }
+    munmap(file, st.st_size);
+    return ok;
+}
+
+void Sim::parse_snapshot_args(int argc, char **argv) {
+    static constexpr char RESTORE_FLAG[] = "--restore=";
+    static constexpr char CHECKPOINT_FLAG[] = "--checkpoint=";
+    for (auto i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], RESTORE_FLAG, strlen(RESTORE_FLAG)) == 0) {
+            restore_path = argv[i] + strlen(RESTORE_FLAG);
+            // The snapshot replaces the preloaded binary.
+            disable_preloading = true;
+        } else if (strncmp(argv[i], CHECKPOINT_FLAG,
+                           strlen(CHECKPOINT_FLAG)) == 0) {
+            checkpoint_path = argv[i] + strlen(CHECKPOINT_FLAG);
+        }
+    }
+}
+
+size_t Sim::chunk_max_size() { return GlobalMemory::PAGE_SIZE; }
+
 // Override HTIF to populate bootloader with system specification and entry
 // symbol.
 void Sim::start() {
     htif_t::start();
 
+    // Restore a memory snapshot in place of the preloaded binary.
+    if (restore_path) {
+        if (!MEM.load(restore_path)) {
+            std::cerr << "Failed to restore memory snapshot " << restore_path
+                      << "\n";
+            exit(1);
+        }
+        std::cerr << "Restored memory snapshot " << restore_path << "\n";
+    }
+
     // Write the bootloader into memory.
     size_t bllen = (&tb_bootrom_end - &tb_bootrom_start);
     MEM.write(BOOTDATA.boot_addr, bllen, &tb_bootrom_start, nullptr);
@@ -49,7 +154,19 @@ void Sim::start() {
     MEM.write(bdp, bdlen, reinterpret_cast<const uint8_t *>(&BOOTDATA),
               nullptr);
     std::cerr << "Wrote " << bdlen << " bytes of bootdata to 0x" << std::hex
-              << bdp << "\n";
+              << bdp << std::dec << "\n";
+
+    // Dump the memory with the binary loaded for later restores. This only
+    // caches the memory image of the preload; snapshots that include data
+    // written by the host are taken later with the `Snapshot` IPC operation.
+    if (checkpoint_path) {
+        if (!MEM.save(checkpoint_path)) {
+            std::cerr << "Failed to write memory snapshot " << checkpoint_path
+                      << "\n";
+            exit(1);
+        }
+        std::cerr << "Wrote memory snapshot " << checkpoint_path << "\n";
+    }
 }
 
 void Sim::read_chunk(addr_t taddr, size_t len, void *dst) {
@@ -57,8 +174,7 @@ void Sim::read_chunk(addr_t taddr, size_t len, void *dst) {
 }
 
 void Sim::write_chunk(addr_t taddr, size_t len, const void *src) {
-    uint8_t strb[8] = {1, 1, 1, 1, 1, 1, 1, 1};
-    MEM.write(taddr, len, reinterpret_cast<const uint8_t *>(src), strb);
+    MEM.write(taddr, len, reinterpret_cast<const uint8_t *>(src), nullptr);
 }
 
 }  // namespace sim
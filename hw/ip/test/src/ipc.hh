@@ -6,28 +6,62 @@
 
 #pragma once
 
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <tb_lib.hh>
+#include <vector>
+
+// Define `IPC_DEBUG` to log every IPC operation.
+#ifdef IPC_DEBUG
+#define IPC_LOG(...) printf(__VA_ARGS__)
+#else
+#define IPC_LOG(...)
+#endif
 
 class IpcIface {
    private:
     static const int IPC_BUF_SIZE = 4096;
-    static const int IPC_BUF_SIZE_STRB = IPC_BUF_SIZE / 8 + 1;
     static const int IPC_ERR_DOUBLE_ARG = 30;
+    static const int IPC_ERR_SHM = 31;
+    static const int IPC_ERR_ARG = 32;
+    static const long IPC_POLL_PERIOD_MIN_NS = 1000L;
     static const long IPC_POLL_PERIOD_NS = 100000L;
 
+    // Shared-memory segment layout: a header page holding the doorbell ring,
+    // followed by the memory mapped into the simulation at `base`.
+    // The magic number spells "SNITCHSH".
+    static const uint64_t IPC_SHM_MAGIC = 0x534e495443485348ULL;
+    static const size_t IPC_SHM_DATA_OFFSET = 4096;
+    static const size_t IPC_DB_RING_SIZE = 64;
+
     // Possible IPC operations
     enum ipc_opcode_e {
         Read = 0,
         Write = 1,
         Poll = 2,
+        // Non-blocking poll, followed by a 64b tag. Completes through the
+        // doorbell ring if shared memory is mapped, otherwise through `Reap`.
+        // Completions that find the ring full are posted as it drains.
+        PollAsync = 3,
+        // `addr` reads and writes follow; read data is returned in one go
+        Batch = 4,
+        // Return the count of completed async polls, then their completions
+        Reap = 5,
+        // Dump the global memory to the file whose `len`-byte path follows,
+        // and return a 64b status (0 on success)
+        Snapshot = 6,
     };
 
     // Operations are 3 doubles, followed by data streams in either direction
@@ -37,10 +71,37 @@ class IpcIface {
         uint64_t len;
     } ipc_op_t;
 
+    // A completion of an async poll
+    typedef struct {
+        uint64_t tag;
+        uint64_t value;
+    } ipc_doorbell_t;
+
+    // An async poll still waiting for its word to match
+    typedef struct {
+        uint64_t tag;
+        uint64_t addr;
+        uint32_t mask;
+        uint32_t expected;
+    } ipc_pending_t;
+
+    // Header at the start of the shared-memory segment. The simulator only
+    // ever advances `db_head`, the host only ever advances `db_tail`.
+    typedef struct {
+        uint64_t magic;
+        uint64_t base;
+        uint64_t size;
+        std::atomic<uint64_t> db_head;
+        std::atomic<uint64_t> db_tail;
+        uint64_t reserved[3];
+        ipc_doorbell_t db_ring[IPC_DB_RING_SIZE];
+    } ipc_shm_hdr_t;
+
     // Args passed to IPC thread
     typedef struct {
         char* tx;
         char* rx;
+        ipc_shm_hdr_t* shm;
     } ipc_targs_t;
 
     // Thread to asynchronously handle FIFOs
@@ -48,76 +109,266 @@ class IpcIface {
     pthread_t thread;
     bool active;
 
+    // Shared-memory segment, if any
+    void* shm_ptr;
+    size_t shm_len;
+
+    // Poll a 32b word until its masked bits match, backing off exponentially.
+    static uint32_t poll_word(uint64_t addr, uint32_t mask, uint32_t expected) {
+        long period = IPC_POLL_PERIOD_MIN_NS;
+        uint32_t read;
+        while (true) {
+            sim::MEM.read(addr, sizeof(uint32_t), (uint8_t*)(void*)&read);
+            if ((read & mask) == (expected & mask)) return read;
+            const struct timespec ts = {0, period};
+            nanosleep(&ts, NULL);
+            period = 2 * period < IPC_POLL_PERIOD_NS ? 2 * period
+                                                     : IPC_POLL_PERIOD_NS;
+        }
+    }
+
+    // Post queued completions to the doorbell ring, as many as fit. The rest
+    // stay queued until the host advances `db_tail`, so a host that does not
+    // drain the ring never blocks the IPC thread.
+    static void ring_doorbells(ipc_shm_hdr_t* shm,
+                               std::vector<ipc_doorbell_t>& completed) {
+        uint64_t head = shm->db_head.load(std::memory_order_relaxed);
+        uint64_t tail = shm->db_tail.load(std::memory_order_acquire);
+        size_t num = std::min<uint64_t>(completed.size(),
+                                        IPC_DB_RING_SIZE - (head - tail));
+        for (size_t i = 0; i < num; i++)
+            shm->db_ring[(head + i) % IPC_DB_RING_SIZE] = completed[i];
+        shm->db_head.store(head + num, std::memory_order_release);
+        completed.erase(completed.begin(), completed.begin() + num);
+    }
+
+    // Read exactly `len` bytes from a FIFO; fails iff it was closed.
+    static bool read_full(int fd, void* buf, size_t len) {
+        uint8_t* ptr = (uint8_t*)buf;
+        while (len > 0) {
+            ssize_t n = read(fd, ptr, len);
+            if (n <= 0) return false;
+            ptr += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // Handle a read or write operation. Read data is not flushed.
+    static void handle_access(const ipc_op_t& op, int tx, FILE* rx) {
+        uint8_t buf_data[IPC_BUF_SIZE];
+        // Transfer full blocks until one full block or less left
+        for (uint64_t i = 0; i < op.len; i += IPC_BUF_SIZE) {
+            uint64_t len = std::min<uint64_t>(op.len - i, IPC_BUF_SIZE);
+            if (op.opcode == Read) {
+                sim::MEM.read(op.addr + i, len, buf_data);
+                fwrite(buf_data, len, 1, rx);
+            } else {
+                // Writes are full-strobe
+                read_full(tx, buf_data, len);
+                sim::MEM.write(op.addr + i, len, buf_data, nullptr);
+            }
+        }
+    }
+
+    // Check pending async polls, completing the ones whose word matches, and
+    // post completions to the doorbell ring if shared memory is mapped.
+    static void check_pending(ipc_targs_t* targs,
+                              std::vector<ipc_pending_t>& pending,
+                              std::vector<ipc_doorbell_t>& completed) {
+        auto it = pending.begin();
+        while (it != pending.end()) {
+            uint32_t read;
+            sim::MEM.read(it->addr, sizeof(uint32_t), (uint8_t*)(void*)&read);
+            if ((read & it->mask) != (it->expected & it->mask)) {
+                ++it;
+                continue;
+            }
+            completed.push_back({it->tag, read});
+            it = pending.erase(it);
+        }
+        if (targs->shm) ring_doorbells(targs->shm, completed);
+    }
+
     static void* ipc_thread_handle(void* in) {
         ipc_targs_t* targs = (ipc_targs_t*)in;
         // Open FIFOs
-        FILE* tx = fopen(targs->tx, "rb");
+        int tx = open(targs->tx, O_RDONLY);
         FILE* rx = fopen(targs->rx, "wb");
-        // Prepare data and full-strobe array
-        uint8_t buf_data[IPC_BUF_SIZE];
-        uint8_t buf_strb[IPC_BUF_SIZE_STRB];
-        std::fill_n(buf_strb, IPC_BUF_SIZE_STRB, 0xFF);
+        std::vector<ipc_pending_t> pending;
+        std::vector<ipc_doorbell_t> completed;
+        long period = IPC_POLL_PERIOD_MIN_NS;
         // Handle commands
         ipc_op_t op;
-        while (fread(&op, sizeof(ipc_op_t), 1, tx)) {
+        while (true) {
+            // While async polls are pending or their completions wait for
+            // room in the doorbell ring, only block on the TX FIFO for one
+            // polling period at a time.
+            auto waiting = [&] {
+                return !pending.empty() || (targs->shm && !completed.empty());
+            };
+            if (waiting()) {
+                check_pending(targs, pending, completed);
+                struct pollfd pfd = {tx, POLLIN, 0};
+                const struct timespec ts = {0, period};
+                if (waiting() && ppoll(&pfd, 1, &ts, NULL) <= 0) {
+                    period = 2 * period < IPC_POLL_PERIOD_NS
+                                 ? 2 * period
+                                 : IPC_POLL_PERIOD_NS;
+                    continue;
+                }
+                period = IPC_POLL_PERIOD_MIN_NS;
+            }
+            if (!read_full(tx, &op, sizeof(ipc_op_t))) break;
             switch (op.opcode) {
                 case Read:
-                    // Read full blocks until one full block or less left
-                    printf("[IPC] Read from 0x%x len %d ...\n", op.addr,
-                           op.len);
-                    for (uint64_t i = op.len; i > IPC_BUF_SIZE;
-                         i -= IPC_BUF_SIZE) {
-                        sim::MEM.read(op.addr, IPC_BUF_SIZE, buf_data);
-                        fwrite(buf_data, IPC_BUF_SIZE, 1, rx);
-                    }
-                    sim::MEM.read(op.addr, op.len, buf_data);
-                    fwrite(buf_data, op.len, 1, rx);
+                    IPC_LOG("[IPC] Read from 0x%lx len %lu ...\n", op.addr,
+                            op.len);
+                    handle_access(op, tx, rx);
                     fflush(rx);
                     break;
                 case Write:
-                    // Write full blocks until one full block or less left
-                    printf("[IPC] Write to 0x%x len %d ...\n", op.addr, op.len);
-                    for (uint64_t i = op.len; i > IPC_BUF_SIZE;
-                         i -= IPC_BUF_SIZE) {
-                        fread(buf_data, IPC_BUF_SIZE, 1, tx);
-                        sim::MEM.write(op.addr, IPC_BUF_SIZE, buf_data,
-                                       buf_strb);
-                    }
-                    fread(buf_data, op.len, 1, tx);
-                    sim::MEM.write(op.addr, op.len, buf_data, buf_strb);
+                    IPC_LOG("[IPC] Write to 0x%lx len %lu ...\n", op.addr,
+                            op.len);
+                    handle_access(op, tx, rx);
                     break;
                 case Poll:
+                case PollAsync: {
                     // Unpack 32b checking mask and expected value from length
                     uint32_t mask = op.len & 0xFFFFFFFF;
                     uint32_t expected = (op.len >> 32) & 0xFFFFFFFF;
-                    printf("[IPC] Poll on 0x%x mask 0x%x expected 0x%x ...\n",
-                           op.addr, mask, expected);
-                    uint32_t read;
-                    do {
-                        sim::MEM.read(op.addr, sizeof(uint32_t),
-                                      (uint8_t*)(void*)&read);
-                        nanosleep(
-                            (const struct timespec[]){{0, IPC_POLL_PERIOD_NS}},
-                            NULL);
-                    } while (read & mask == expected & mask);
+                    IPC_LOG(
+                        "[IPC] Poll on 0x%lx mask 0x%x expected 0x%x ...\n",
+                        op.addr, mask, expected);
+                    if (op.opcode == PollAsync) {
+                        uint64_t tag;
+                        if (!read_full(tx, &tag, sizeof(tag))) break;
+                        pending.push_back({tag, op.addr, mask, expected});
+                        break;
+                    }
+                    uint32_t read = poll_word(op.addr, mask, expected);
                     // Send back read 32b word
                     fwrite(&read, sizeof(uint32_t), 1, rx);
                     fflush(rx);
                     break;
+                }
+                case Batch:
+                    IPC_LOG("[IPC] Batch of %lu accesses ...\n", op.addr);
+                    for (uint64_t i = 0; i < op.addr; i++) {
+                        ipc_op_t access;
+                        if (!read_full(tx, &access, sizeof(ipc_op_t))) break;
+                        // Only reads and writes can be batched. Unknown
+                        // accesses are ignored like unknown operations, as
+                        // their data length cannot be known.
+                        if (access.opcode != Read && access.opcode != Write) {
+                            fprintf(stderr,
+                                    "[IPC] Ignoring batched opcode %lu\n",
+                                    access.opcode);
+                            continue;
+                        }
+                        handle_access(access, tx, rx);
+                    }
+                    fflush(rx);
+                    break;
+                case Reap: {
+                    check_pending(targs, pending, completed);
+                    uint64_t count = completed.size();
+                    fwrite(&count, sizeof(count), 1, rx);
+                    fwrite(completed.data(), sizeof(ipc_doorbell_t), count,
+                           rx);
+                    fflush(rx);
+                    completed.clear();
+                    break;
+                }
+                case Snapshot: {
+                    std::vector<char> path(op.len + 1, '\0');
+                    if (!read_full(tx, path.data(), op.len)) break;
+                    IPC_LOG("[IPC] Snapshot to `%s` ...\n", path.data());
+                    uint64_t status = !sim::MEM.save(path.data());
+                    fwrite(&status, sizeof(status), 1, rx);
+                    fflush(rx);
+                    break;
+                }
             }
-            printf("[IPC] ... done\n");
+            IPC_LOG("[IPC] ... done\n");
         }
         // TX FIFO closed at other end: close both FIFOs and join main thread
-        fclose(tx);
+        close(tx);
         fclose(rx);
         pthread_exit(NULL);
     }
 
+    // Map the shared-memory segment `name` and map its data area into the
+    // global memory at `base`. Must happen before the simulation starts.
+    void map_shm(const char* name, uint64_t base, uint64_t size) {
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0) {
+            fprintf(stderr, "[IPC] Cannot open shared memory `%s`\n", name);
+            exit(IPC_ERR_SHM);
+        }
+        // Accesses past the end of a shorter segment would raise SIGBUS.
+        struct stat st;
+        shm_len = IPC_SHM_DATA_OFFSET + size;
+        if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < shm_len) {
+            fprintf(stderr, "[IPC] Shared memory `%s` is smaller than 0x%lx\n",
+                    name, shm_len);
+            exit(IPC_ERR_SHM);
+        }
+        shm_ptr =
+            mmap(NULL, shm_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        auto hdr = (ipc_shm_hdr_t*)shm_ptr;
+        if (shm_ptr == MAP_FAILED || hdr->magic != IPC_SHM_MAGIC ||
+            hdr->base != base || hdr->size != size) {
+            fprintf(stderr, "[IPC] Invalid shared memory `%s`\n", name);
+            exit(IPC_ERR_SHM);
+        }
+        sim::MEM.add_mapping(base, size,
+                             (uint8_t*)shm_ptr + IPC_SHM_DATA_OFFSET);
+        targs.shm = hdr;
+        printf("[IPC] Mapped shared memory `%s` to 0x%lx len 0x%lx\n", name,
+               base, size);
+    }
+
+    // Exit on a malformed IPC argument, which should have the form `usage`.
+    static void usage_error(const char* usage) {
+        fprintf(stderr, "[IPC] Malformed argument, expected `%s`\n", usage);
+        exit(IPC_ERR_ARG);
+    }
+
+    // Parse a number in an IPC argument of the form `usage`.
+    static uint64_t parse_u64(const char* str, const char* usage) {
+        char* end;
+        uint64_t value = strtoull(str, &end, 0);
+        if (end == str || *end) usage_error(usage);
+        return value;
+    }
+
    public:
     // Conditionally construct IPC iff any arguments specify it
     IpcIface(int argc, char** argv) {
-        static constexpr char IPC_FLAG[6] = "--ipc";
+        static constexpr char IPC_FLAG[] = "--ipc,";
+        static constexpr char IPC_SHM_FLAG[] = "--ipc-shm,";
         active = false;
+        targs.shm = nullptr;
+        shm_ptr = nullptr;
+        // Shared memory has to be mapped before the IPC thread launches
+        for (auto i = 1; i < argc; ++i) {
+            if (strncmp(argv[i], IPC_SHM_FLAG, strlen(IPC_SHM_FLAG)) == 0) {
+                if (shm_ptr) {
+                    fprintf(stderr, "[IPC] Duplicate IPC shm args: %s",
+                            argv[i]);
+                    exit(IPC_ERR_DOUBLE_ARG);
+                }
+                char* shm_args = argv[i] + strlen(IPC_SHM_FLAG);
+                char* name = strtok(shm_args, ",");
+                char* base = strtok(NULL, ",");
+                char* size = strtok(NULL, ",");
+                const char* usage = "--ipc-shm,<name>,<base>,<size>";
+                if (!name || !base || !size) usage_error(usage);
+                map_shm(name, parse_u64(base, usage), parse_u64(size, usage));
+            }
+        }
         for (auto i = 1; i < argc; ++i) {
             if (strncmp(argv[i], IPC_FLAG, strlen(IPC_FLAG)) == 0) {
                 // Check for duplicate args
@@ -127,9 +378,10 @@ class IpcIface {
                     exit(IPC_ERR_DOUBLE_ARG);
                 }
                 // Parse IPC thread arguments
-                char* ipc_args = argv[i] + strlen(IPC_FLAG) + 1;
+                char* ipc_args = argv[i] + strlen(IPC_FLAG);
                 targs.tx = strtok(ipc_args, ",");
                 targs.rx = strtok(NULL, ",");
+                if (!targs.tx || !targs.rx) usage_error("--ipc,<tx>,<rx>");
                 // Initialize IO thread which will handle TX, RX pipes
                 pthread_create(&thread, NULL, *ipc_thread_handle,
                                (void*)&targs);
@@ -148,5 +400,6 @@ class IpcIface {
             printf("[IPC] Thread joined\n");
             active = false;
         }
+        if (shm_ptr) munmap(shm_ptr, shm_len);
     }
 };
@@ -31,6 +31,7 @@ Sim::Sim(int argc, char **argv) : htif_t(argc, argv) {
             disable_preloading = true;
         }
     }
+    parse_snapshot_args(argc, argv);
     host = context_t::current();
     target.init(sim_thread_main, this);
     target.switch_to();
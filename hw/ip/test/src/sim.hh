@@ -6,10 +6,14 @@
 #include <fesvr/context.h>
 #include <fesvr/htif.h>
 
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <unordered_map>
 #include <vector>
@@ -37,16 +41,29 @@ struct Sim : htif_t {
 
     // Force alignment to 8 byte.
     size_t chunk_align() { return 8; }
-    // Force chunk size to 8 byte.
-    size_t chunk_max_size() { return 8; }
+    // Transfer up to one page per chunk to preload binaries in bulk.
+    size_t chunk_max_size();
 
     void reset() {}
 
    private:
+    // Parse the memory snapshot arguments common to all simulators.
+    void parse_snapshot_args(int argc, char **argv);
+
     context_t *host;
     context_t target;
     bool vlt_vcd = false;
     bool disable_preloading = false;
+    // Memory snapshot to restore instead of preloading the binary.
+    const char *restore_path = nullptr;
+    // Memory snapshot to dump once the binary is loaded.
+    const char *checkpoint_path = nullptr;
+    // Number of time steps between switches to the HTIF host context.
+    int htif_interval = 0;
+    // Number of threads requested for the verilated model (0 is default).
+    int vlt_threads = 0;
+    // Wall clock time at which the simulation started.
+    std::chrono::steady_clock::time_point start_time;
 };
 
 void sim_thread_main(void *arg);
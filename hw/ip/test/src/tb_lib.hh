@@ -14,8 +14,15 @@ struct GlobalMemory {
     static constexpr size_t ADDR_SHIFT = 12;
     static constexpr size_t PAGE_SIZE = (size_t)1 << ADDR_SHIFT;
 
-    std::unordered_map<uint64_t, std::unique_ptr<uint8_t[]>> pages;
-    std::set<uint64_t> touched;
+    // Pages are kept in a two-level radix tree spanning `ADDR_WIDTH` bits of
+    // address space. Higher address bits are ignored. Table entries are only
+    // ever set once, so lookups need no locking even though the IPC thread
+    // accesses memory concurrently with the simulation.
+    static constexpr size_t ADDR_WIDTH = 48;
+    static constexpr size_t LEAF_BITS = 12;
+    static constexpr size_t ROOT_BITS = ADDR_WIDTH - ADDR_SHIFT - LEAF_BITS;
+    static constexpr size_t LEAF_SIZE = (size_t)1 << LEAF_BITS;
+    static constexpr size_t ROOT_SIZE = (size_t)1 << ROOT_BITS;
 
     // A mapping of host memory into Manticore memory.
     struct Mapping {
@@ -25,6 +32,52 @@ struct GlobalMemory {
     };
     std::vector<Mapping> mappings;
 
+    // Per-page mapping cache entries. The upper 32 bits hold the mapping
+    // epoch the entry was computed in, the lower 32 bits one of the values
+    // below or the index of the mapping covering the whole page.
+    static constexpr uint32_t MAPPING_INVALID = ~(uint32_t)0;
+    static constexpr uint32_t MAPPING_NONE = ~(uint32_t)1;
+    static constexpr uint32_t MAPPING_PARTIAL = ~(uint32_t)2;
+
+    struct Page {
+        uint8_t data[PAGE_SIZE];
+        std::atomic<uint64_t> mapping;
+        std::atomic<bool> touched;
+    };
+    typedef std::atomic<Page *> Leaf[LEAF_SIZE];
+
+    // The tables are allocated zeroed with `calloc` such that the untouched
+    // parts of the (large) root table are never backed by physical memory.
+    std::atomic<Leaf *> *root;
+    std::atomic<uint32_t> mapping_epoch;
+
+    // Indices of all pages that have been written to.
+    std::set<uint64_t> touched;
+    std::mutex touched_lock;
+
+    GlobalMemory()
+        : root((std::atomic<Leaf *> *)calloc(ROOT_SIZE, sizeof(*root))),
+          mapping_epoch(0) {}
+    GlobalMemory(const GlobalMemory &) = delete;
+    GlobalMemory &operator=(const GlobalMemory &) = delete;
+
+    ~GlobalMemory() {
+        for (size_t i = 0; i < ROOT_SIZE; i++) {
+            Leaf *leaf = root[i].load(std::memory_order_relaxed);
+            if (!leaf) continue;
+            for (size_t j = 0; j < LEAF_SIZE; j++)
+                delete (*leaf)[j].load(std::memory_order_relaxed);
+            free(leaf);
+        }
+        free(root);
+    }
+
+    // Map host memory into the address space. Must not race with accesses.
+    void add_mapping(uint64_t base, size_t size, uint8_t *into) {
+        mappings.push_back({base, size, into});
+        mapping_epoch++;
+    }
+
     uint8_t *find_mapping(uint64_t addr) const {
         for (const auto &m : mappings) {
             if (m.base <= addr && m.base + m.size > addr) {
@@ -34,81 +87,192 @@ struct GlobalMemory {
         return nullptr;
     }
 
+    // Look up a page, returning `nullptr` if it has not been allocated yet.
+    Page *find_page(uint64_t page_idx) const {
+        Leaf *leaf = root[(page_idx >> LEAF_BITS) % ROOT_SIZE].load(
+            std::memory_order_acquire);
+        if (!leaf) return nullptr;
+        return (*leaf)[page_idx % LEAF_SIZE].load(std::memory_order_acquire);
+    }
+
+    // Look up a page, allocating it and its leaf table if necessary.
+    Page *get_page(uint64_t page_idx) {
+        auto &root_entry = root[(page_idx >> LEAF_BITS) % ROOT_SIZE];
+        Leaf *leaf = root_entry.load(std::memory_order_acquire);
+        if (!leaf) {
+            Leaf *fresh = (Leaf *)calloc(1, sizeof(Leaf));
+            if (root_entry.compare_exchange_strong(leaf, fresh,
+                                                   std::memory_order_acq_rel))
+                leaf = fresh;
+            else
+                free(fresh);
+        }
+        auto &leaf_entry = (*leaf)[page_idx % LEAF_SIZE];
+        Page *page = leaf_entry.load(std::memory_order_acquire);
+        if (!page) {
+            // std::cout << "[TB] Allocate page " << std::hex
+            //           << (page_idx << ADDR_SHIFT) << "\n";
+            Page *fresh = new Page();
+            fresh->mapping = MAPPING_INVALID;
+            if (leaf_entry.compare_exchange_strong(page, fresh,
+                                                   std::memory_order_acq_rel))
+                page = fresh;
+            else
+                delete fresh;
+        }
+        return page;
+    }
+
+    // Determine which mapping covers a page: the index of a mapping that
+    // covers it entirely, `MAPPING_NONE` or `MAPPING_PARTIAL`.
+    uint32_t classify_page(uint64_t page_idx) const {
+        uint64_t page_base = page_idx << ADDR_SHIFT;
+        uint64_t page_end = page_base + PAGE_SIZE;
+        uint32_t result = MAPPING_NONE;
+        for (size_t i = 0; i < mappings.size(); i++) {
+            const auto &m = mappings[i];
+            if (m.base >= page_end || m.base + m.size <= page_base) continue;
+            if (result != MAPPING_NONE) return MAPPING_PARTIAL;
+            if (m.base > page_base || m.base + m.size < page_end)
+                return MAPPING_PARTIAL;
+            result = i;
+        }
+        return result;
+    }
+
+    // Same as `classify_page`, but cached in the page if it exists.
+    uint32_t page_mapping(Page *page, uint64_t page_idx) const {
+        if (mappings.empty()) return MAPPING_NONE;
+        if (!page) return classify_page(page_idx);
+        uint64_t epoch = mapping_epoch.load(std::memory_order_relaxed);
+        uint64_t cached = page->mapping.load(std::memory_order_relaxed);
+        if ((cached >> 32) == epoch && (uint32_t)cached != MAPPING_INVALID)
+            return (uint32_t)cached;
+        uint32_t result = classify_page(page_idx);
+        page->mapping.store(epoch << 32 | result, std::memory_order_relaxed);
+        return result;
+    }
+
+    // Copy bytes. Single bus beats are copied inline rather than through a
+    // `memcpy` call.
+    static void copy_bytes(uint8_t *dst, const uint8_t *src, size_t len) {
+        if (len <= 8) {
+            for (size_t i = 0; i < len; i++) dst[i] = src[i];
+        } else {
+            memcpy(dst, src, len);
+        }
+    }
+
+    // Copy bytes with set strobes, using `memcpy` for contiguous runs.
+    static void copy_strobed(uint8_t *dst, const uint8_t *src,
+                             const uint8_t *strb, size_t len) {
+        if (!strb) {
+            copy_bytes(dst, src, len);
+            return;
+        }
+        size_t i = 0;
+        while (i < len) {
+            while (i < len && !strb[i]) i++;
+            if (i == len) break;
+            // Use `memchr` to quickly find the end of the strobed run.
+            auto run_end = (const uint8_t *)memchr(strb + i, 0, len - i);
+            size_t run = run_end ? run_end - strb : len;
+            copy_bytes(dst + i, src + i, run - i);
+            i = run;
+        }
+    }
+
     // Copy a chunk of data into memory.
     void write(size_t addr, size_t len, const uint8_t *data,
                const uint8_t *strb) {
         // std::cout << "[GlobalMemory] Write " << std::hex << addr << std::dec
         //           << " (" << len << " bytes)\n";
-        size_t end = addr + len;
-        size_t data_idx = 0;
-        while (addr < end) {
-            size_t byte_start = addr;
-            addr >>= ADDR_SHIFT;
-            auto &page = pages[addr];
-            uint64_t page_idx = addr;
-            if (!page) {
-                // std::cout << "[TB] Allocate page " << std::hex << (addr <<
-                // ADDR_SHIFT) << "\n";
-                page = std::make_unique<uint8_t[]>(PAGE_SIZE);
-                std::fill(&page[0], &page[PAGE_SIZE], 0);
-            }
-            // std::cout << "[TB] Write to page " << std::hex << (addr <<
-            // ADDR_SHIFT)
-            // << "\n";
-            addr += 1;
-            addr <<= ADDR_SHIFT;
-            size_t byte_end = std::min(addr, end);
-            bool any_changed = false;
-            for (size_t i = byte_start; i < byte_end; i++, data_idx++) {
-                if (!strb || strb[data_idx]) {
-                    // std::cout << "[TB] Write byte " << std::hex << i << " = "
-                    // << (uint32_t)data[data_idx] << "\n";
-                    auto host = find_mapping(i);
+        while (len > 0) {
+            uint64_t page_idx = addr >> ADDR_SHIFT;
+            size_t offset = addr % PAGE_SIZE;
+            size_t chunk = std::min(len, PAGE_SIZE - offset);
+            // Look up the mapping first, such that pages fully covered by a
+            // mapping are never allocated.
+            Page *page = find_page(page_idx);
+            uint32_t mapping = page_mapping(page, page_idx);
+            if (!page &&
+                (mapping == MAPPING_NONE || mapping == MAPPING_PARTIAL))
+                page = get_page(page_idx);
+            if (mapping == MAPPING_NONE) {
+                copy_strobed(&page->data[offset], data, strb, chunk);
+                mark_touched(page, page_idx);
+            } else if (mapping == MAPPING_PARTIAL) {
+                bool any_changed = false;
+                for (size_t i = 0; i < chunk; i++) {
+                    if (strb && !strb[i]) continue;
+                    auto host = find_mapping(addr + i);
                     if (host) {
-                        *host = data[data_idx];
+                        *host = data[i];
                     } else {
-                        page[i % PAGE_SIZE] = data[data_idx];
+                        page->data[offset + i] = data[i];
                         any_changed = true;
                     }
                 }
+                if (any_changed) mark_touched(page, page_idx);
+            } else {
+                const auto &m = mappings[mapping];
+                copy_strobed(m.into + (addr - m.base), data, strb, chunk);
             }
-            if (any_changed) touched.insert(page_idx);
+            addr += chunk;
+            len -= chunk;
+            data += chunk;
+            if (strb) strb += chunk;
         }
-        std::cout << std::dec;
     }
 
     // Copy a chunk of data out of the memory.
     void read(size_t addr, size_t len, uint8_t *data) {
         // std::cout << "[GlobalMemory] Read " << std::hex << addr << std::dec
         //           << " (" << len << " bytes)\n";
-        size_t end = addr + len;
-        size_t data_idx = 0;
-        while (addr < end) {
-            size_t byte_start = addr;
-            addr >>= ADDR_SHIFT;
-            auto &page = pages[addr];
-            // std::cout << "[TB] Read from page " << std::hex << (addr <<
-            // ADDR_SHIFT)
-            // << "\n";
-            addr += 1;
-            addr <<= ADDR_SHIFT;
-            size_t byte_end = std::min(addr, end);
-            for (size_t i = byte_start; i < byte_end; i++, data_idx++) {
-                auto host = find_mapping(i);
-                if (host) {
-                    data[data_idx] = *host;
-                } else {
-                    if (page) {
-                        // std::cout << "[TB] Read byte " << std::hex << i <<
-                        // "\n";
-                        data[data_idx] = page[i % PAGE_SIZE];
-                    } else {
-                        data[data_idx] = 0;
-                    }
+        while (len > 0) {
+            uint64_t page_idx = addr >> ADDR_SHIFT;
+            size_t offset = addr % PAGE_SIZE;
+            size_t chunk = std::min(len, PAGE_SIZE - offset);
+            Page *page = find_page(page_idx);
+            uint32_t mapping = page_mapping(page, page_idx);
+            if (mapping == MAPPING_NONE) {
+                if (page)
+                    copy_bytes(data, &page->data[offset], chunk);
+                else
+                    memset(data, 0, chunk);
+            } else if (mapping == MAPPING_PARTIAL) {
+                for (size_t i = 0; i < chunk; i++) {
+                    auto host = find_mapping(addr + i);
+                    if (host)
+                        data[i] = *host;
+                    else
+                        data[i] = page ? page->data[offset + i] : 0;
                 }
+            } else {
+                const auto &m = mappings[mapping];
+                copy_bytes(data, m.into + (addr - m.base), chunk);
             }
+            addr += chunk;
+            len -= chunk;
+            data += chunk;
         }
-        std::cout << std::dec;
+    }
+
+    // Dump all touched pages to a snapshot file. Returns false on failure.
+    bool save(const char *path);
+
+    // Load the pages of a snapshot file written by `save`, mapping the file
+    // into the host address space. Returns false on failure.
+    bool load(const char *path);
+
+   private:
+    // Record the first write to a page in the `touched` set.
+    void mark_touched(Page *page, uint64_t page_idx) {
+        if (page->touched.load(std::memory_order_relaxed) ||
+            page->touched.exchange(true))
+            return;
+        std::lock_guard<std::mutex> guard(touched_lock);
+        touched.insert(page_idx);
     }
 };
 
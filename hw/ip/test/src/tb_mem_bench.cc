@@ -0,0 +1,75 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Solderpad Hardware License, Version 0.51, see LICENSE for details.
+// SPDX-License-Identifier: SHL-0.51
+
+// Microbenchmark of the per-access cost of `GlobalMemory`. Only needs the
+// `fesvr` headers, not the library or a DUT:
+//
+//   g++ -std=c++14 -O2 -I${FESVR}/include -o tb_mem_bench tb_mem_bench.cc
+//       -lpthread
+//
+// Every case issues the same number of accesses of one size (the argument,
+// 20M by default; a hundredth of that for 4 KiB), striding through a 1 MiB
+// region that is written once up front, like a preloaded binary. To compare
+// against another `GlobalMemory`, build a copy of this file next to that
+// version of `tb_lib.hh`.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "tb_lib.hh"
+
+namespace sim {
+// `tb_lib.hh` declares the global memory, `common_lib.cc` is not linked.
+GlobalMemory MEM;
+}  // namespace sim
+
+using sim::MEM;
+
+static constexpr size_t BASE = 0x80000000;
+static constexpr size_t REGION = 1 << 20;
+
+enum Kind { WRITE_STROBED, WRITE_PLAIN, READ };
+
+static void bench(const char *name, Kind kind, size_t len, size_t iters) {
+    std::vector<uint8_t> data(len, 0x5a), strb(len, 1);
+    volatile uint8_t sink = 0;
+    size_t addr = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iters; i++) {
+        switch (kind) {
+            case WRITE_STROBED:
+                MEM.write(BASE + addr, len, data.data(), strb.data());
+                break;
+            case WRITE_PLAIN:
+                MEM.write(BASE + addr, len, data.data(), nullptr);
+                break;
+            case READ:
+                MEM.read(BASE + addr, len, data.data());
+                sink = sink + data[0];
+                break;
+        }
+        addr = (addr + len) % REGION;
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    printf("%-14s %5zu B: %8.1f ns\n", name, len, ns / iters);
+}
+
+int main(int argc, char **argv) {
+    size_t iters = argc > 1 ? strtoull(argv[1], nullptr, 0) : 20000000;
+
+    std::vector<uint8_t> preload(REGION, 0xa5);
+    MEM.write(BASE, REGION, preload.data(), nullptr);
+
+    bench("strobed write", WRITE_STROBED, 8, iters);
+    bench("strobed write", WRITE_STROBED, 64, iters);
+    bench("plain write", WRITE_PLAIN, 8, iters);
+    bench("plain write", WRITE_PLAIN, 64, iters);
+    bench("read", READ, 8, iters);
+    bench("read", READ, 64, iters);
+    bench("strobed write", WRITE_STROBED, 4096, iters / 100);
+    return 0;
+}
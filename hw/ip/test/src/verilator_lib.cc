@@ -12,22 +12,49 @@
 #include "verilated_vcd_c.h"
 namespace sim {
 
-// Number of cycles between HTIF checks.
+// Default number of time steps (half cycles) between HTIF checks.
 const int HTIFTimeInterval = 200;
 void sim_thread_main(void *arg) { ((Sim *)arg)->main(); }
 
 // Sim time.
-int TIME = 0;
+uint64_t TIME = 0;
 
 Sim::Sim(int argc, char **argv) : htif_t(argc, argv) {
+    static constexpr char HTIF_INTERVAL_FLAG[] = "--htif-interval=";
+    static constexpr char VLT_THREADS_FLAG[] = "--vlt-threads=";
+    htif_interval = HTIFTimeInterval;
     // Search arguments for `--vcd` flag and enable waves if requested
     for (auto i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "--vcd") == 0) {
             printf("VCD wave generation enabled\n");
             vlt_vcd = true;
+        } else if (strncmp(argv[i], HTIF_INTERVAL_FLAG,
+                           strlen(HTIF_INTERVAL_FLAG)) == 0) {
+            htif_interval = atoi(argv[i] + strlen(HTIF_INTERVAL_FLAG));
+            if (htif_interval <= 0) htif_interval = HTIFTimeInterval;
+            printf("HTIF check interval set to %d time steps\n",
+                   htif_interval);
+        } else if (strncmp(argv[i], VLT_THREADS_FLAG,
+                           strlen(VLT_THREADS_FLAG)) == 0) {
+            vlt_threads = atoi(argv[i] + strlen(VLT_THREADS_FLAG));
         }
     }
+    parse_snapshot_args(argc, argv);
     Verilated::commandArgs(argc, argv);
+    // The thread count can only be chosen at runtime on Verilator 5 and
+    // newer. Older versions fix it when the model is verilated.
+    if (vlt_threads > 0) {
+#if defined(VL_THREADED) && defined(VERILATOR_VERSION_INTEGER) && \
+    VERILATOR_VERSION_INTEGER >= 5000000
+        Verilated::threadContextp()->threads(vlt_threads);
+        printf("Verilator model running on %d threads\n", vlt_threads);
+#else
+        fprintf(stderr,
+                "Warning: `--vlt-threads` ignored; rebuild the model with "
+                "`VLT_NUM_THREADS=%d` instead\n",
+                vlt_threads);
+#endif
+    }
 }
 
 void Sim::idle() { target.switch_to(); }
@@ -36,10 +63,21 @@ void Sim::idle() { target.switch_to(); }
 int Sim::run() {
     host = context_t::current();
     target.init(sim_thread_main, this);
-    return htif_t::run();
+    int exit_code = htif_t::run();
+
+    // Report the simulation speed. Two time steps make one clock cycle.
+    double wall_s = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start_time)
+                        .count();
+    uint64_t cycles = TIME / 2;
+    printf("[Sim] Simulated %llu cycles in %.3f s (%.1f cycles/s)\n",
+           (unsigned long long)cycles, wall_s,
+           wall_s > 0 ? cycles / wall_s : 0.0);
+    return exit_code;
 }
 
 void Sim::main() {
+    start_time = std::chrono::steady_clock::now();
     // Initialize verilator environment.
     Verilated::traceEverOn(true);
     // Allocate the simulation state and VCD trace.
@@ -67,7 +105,7 @@ void Sim::main() {
         // Increase global time.
         TIME++;
         // Switch to the HTIF interface in regular intervals.
-        if (TIME % HTIFTimeInterval == 0) {
+        if (TIME % htif_interval == 0) {
             host->switch_to();
         }
     }
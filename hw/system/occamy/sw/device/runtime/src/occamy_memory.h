@@ -29,6 +29,11 @@ inline volatile uint32_t* __attribute__((const)) snrt_cluster_clint_clr_ptr() {
     return cluster_clint_clr_ptr(snrt_cluster_idx());
 }
 
+inline volatile uint32_t* __attribute__((const))
+snrt_remote_cluster_clint_set_ptr(uint32_t cluster_idx) {
+    return cluster_clint_set_ptr(cluster_idx);
+}
+
 inline uint32_t __attribute__((const)) snrt_cluster_hw_barrier_addr() {
     return _snrt_cluster_hw_barrier;
 }
@@ -6,13 +6,32 @@ static inline void snrt_crt0_callback3() {
     _snrt_cluster_hw_barrier = cluster_hw_barrier_addr(snrt_cluster_idx());
 }
 
+// Clear the interrupt that woke up the cores, which would otherwise turn the
+// first WFI in `main` into a NOP
+static inline void snrt_crt0_callback5() { post_wakeup_cl(); }
+
+// Binaries that serve jobs never return from `main`. Other binaries report
+// the sum of the exit codes of all cores to CVA6 (see `run_device_test`).
+static inline void snrt_crt0_callback8(int exit_code) {
+    comm_buffer_t* comm_buffer = get_communication_buffer();
+    if (exit_code)
+        __atomic_add_fetch(&comm_buffer->usr_data_ptr, exit_code,
+                           __ATOMIC_RELAXED);
+    // The update must have completed before CVA6 is interrupted
+    asm volatile("fence" ::: "memory");
+    return_to_cva6(SYNC_ALL);
+}
+
+#define SNRT_INIT_DMA
 #define SNRT_INIT_TLS
 #define SNRT_INIT_BSS
 #define SNRT_INIT_CLS
 #define SNRT_CRT0_CALLBACK3
 #define SNRT_INIT_LIBS
 #define SNRT_CRT0_PRE_BARRIER
+#define SNRT_CRT0_CALLBACK5
 #define SNRT_INVOKE_MAIN
 #define SNRT_CRT0_POST_BARRIER
+#define SNRT_CRT0_CALLBACK8
 
 #include "start.c"
@@ -4,9 +4,13 @@
 
 #include "snrt.h"
 
+// Empty printf implementation
+extern int printf(const char* format, ...);
+
 #include "alloc.c"
 #include "cls.c"
 #include "cluster_interrupts.c"
+#include "collectives.c"
 #include "dma.c"
 #include "global_interrupts.c"
 #include "occamy_device.c"
@@ -0,0 +1,8 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "host.c"
+
+// Runs the collectives test of `sw/tests` on all clusters of all quadrants
+int main() { return run_device_test(); }
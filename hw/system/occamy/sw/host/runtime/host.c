@@ -709,3 +709,28 @@ void deactivate_interleaved_mode_hbm() {
         OCCAMY_HBM_XBAR_INTERLEAVED_ENA_REG_OFFSET + HBM_XBAR_CFG_BASE_ADDR;
     *((volatile uint32_t*)addr) = 1;
 }
+
+//===============================================================
+// Device tests
+//===============================================================
+
+/**
+ * @brief Runs the device binary once on all clusters
+ *
+ * @detail Ungates and deisolates all quadrants and wakes up all
+ *         Snitches, which run the `main` of the device binary and
+ *         return. Each Snitch adds its exit code to the user data
+ *         field of the communication buffer.
+ *
+ * @return Sum of the exit codes of all Snitches
+ */
+uint32_t run_device_test() {
+    for (uint32_t i = 0; i < N_QUADS; i++) reset_and_ungate_quad(i);
+    deisolate_all();
+    enable_sw_interrupts();
+    comm_buffer.usr_data_ptr = 0;
+    program_snitches();
+    wakeup_snitches_cl();
+    wait_snitches_done();
+    return comm_buffer.usr_data_ptr;
+}
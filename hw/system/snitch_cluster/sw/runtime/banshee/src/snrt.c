@@ -7,6 +7,7 @@
 #include "alloc.c"
 #include "cls.c"
 #include "cluster_interrupts.c"
+#include "collectives.c"
 #include "dm.c"
 #include "dma.c"
 #include "eu.c"
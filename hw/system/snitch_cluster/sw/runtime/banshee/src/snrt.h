@@ -31,3 +31,6 @@
 #include "ssr.h"
 #include "sync.h"
 #include "team.h"
+
+// Collectives build on the DMA, synchronization and team modules
+#include "collectives.h"
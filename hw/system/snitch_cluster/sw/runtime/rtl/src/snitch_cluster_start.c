@@ -2,6 +2,7 @@
 // Licensed under the Apache License, Version 2.0, see LICENSE for details.
 // SPDX-License-Identifier: Apache-2.0
 
+#define SNRT_INIT_DMA
 #define SNRT_INIT_TLS
 #define SNRT_INIT_BSS
 #define SNRT_INIT_CLS
@@ -10,6 +10,7 @@ extern int printf(const char* format, ...);
 #include "alloc.c"
 #include "cls.c"
 #include "cluster_interrupts.c"
+#include "collectives.c"
 #include "dm.c"
 #include "dma.c"
 #include "eu.c"
@@ -37,3 +37,6 @@ inline int printf(const char* format, ...) { return 0; };
 #include "ssr.h"
 #include "sync.h"
 #include "team.h"
+
+// Collectives build on the DMA, synchronization and team modules
+#include "collectives.h"
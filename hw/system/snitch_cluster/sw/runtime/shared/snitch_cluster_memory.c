@@ -10,4 +10,7 @@ extern volatile uint32_t* snrt_cluster_clint_set_ptr();
 
 extern volatile uint32_t* snrt_cluster_clint_clr_ptr();
 
+extern volatile uint32_t* snrt_remote_cluster_clint_set_ptr(
+    uint32_t cluster_idx);
+
 extern uint32_t snrt_cluster_hw_barrier_addr();
@@ -48,6 +48,12 @@ inline volatile uint32_t* __attribute__((const)) snrt_cluster_clint_clr_ptr() {
     return (uint32_t*)CLUSTER_CLINT_CLR_ADDR;
 }
 
+inline volatile uint32_t* __attribute__((const))
+snrt_remote_cluster_clint_set_ptr(uint32_t cluster_idx) {
+    return (uint32_t*)(CLUSTER_CLINT_SET_ADDR +
+                       cluster_idx * SNRT_CLUSTER_OFFSET);
+}
+
 inline uint32_t __attribute__((const)) snrt_cluster_hw_barrier_addr() {
     return CLUSTER_HW_BARRIER_ADDR;
 }
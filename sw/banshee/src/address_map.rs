@@ -0,0 +1,175 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+//! Address decoding for accesses that miss the inlined fast paths
+//!
+//! Each cluster sees the same registers and memories, but with its own TCDM,
+//! peripherals and DRAM window. An `AddressMap` flattens the configuration
+//! into a sorted table of non-overlapping regions once, such that decoding an
+//! address is a binary search instead of a walk over the configuration.
+
+use crate::configuration::Configuration;
+
+/// The target of an access, as decoded from its address.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Region {
+    TcdmStart,
+    TcdmEnd,
+    NrCores,
+    ScratchReg,
+    WakeupReg,
+    BarrierReg,
+    ClusterBaseHartid,
+    ClusterNum,
+    ClusterId,
+    /// The register to take a checkpoint.
+    CheckpointReg,
+    Uart,
+    /// The TCDM of a cluster, mapped at the given base address.
+    Tcdm(usize, u32),
+    Periphs,
+    Bootrom,
+    Clint,
+    /// The cluster-local CLINT set register and the word after it.
+    ClClint,
+    /// The cluster-local CLINT clear register.
+    ClClintClear,
+    /// The cluster's DRAM window.
+    Dram,
+    /// Anything else; still backed by the global memory.
+    Unmapped,
+}
+
+#[derive(Debug, Clone, Copy)]
+struct Entry {
+    start: u64,
+    end: u64,
+    region: Region,
+}
+
+/// The address map as seen by one cluster.
+#[derive(Debug, Default)]
+pub struct AddressMap {
+    /// Sorted by start address and non-overlapping.
+    entries: Vec<Entry>,
+}
+
+impl AddressMap {
+    /// Build the address map of cluster `cluster_id`.
+    ///
+    /// Where regions overlap, the earlier one in the order below wins,
+    /// matching the priorities of `binary_load` and `binary_store`.
+    pub fn new(config: &Configuration, cluster_id: usize) -> Self {
+        let mut map = Self::default();
+        let a = &config.address;
+        let regs = [
+            (a.tcdm_start, Region::TcdmStart),
+            (a.tcdm_end, Region::TcdmEnd),
+            (a.nr_cores, Region::NrCores),
+            (a.scratch_reg, Region::ScratchReg),
+            (a.wakeup_reg, Region::WakeupReg),
+            (a.barrier_reg, Region::BarrierReg),
+            (a.cluster_base_hartid, Region::ClusterBaseHartid),
+            (a.cluster_num, Region::ClusterNum),
+            (a.cluster_id, Region::ClusterId),
+            (a.checkpoint_reg, Region::CheckpointReg),
+            (a.uart, Region::Uart),
+        ];
+        for &(addr, region) in &regs {
+            map.insert(addr, 4, region);
+        }
+
+        // The local TCDM, then external TCDM windows, then the TCDMs of the
+        // other clusters at their own addresses.
+        let mem = &config.memory;
+        let tcdm = &mem[cluster_id].tcdm;
+        map.insert(
+            tcdm.start,
+            tcdm.end - tcdm.start,
+            Region::Tcdm(cluster_id, tcdm.start),
+        );
+        for ext in &mem[cluster_id].ext_tcdm {
+            let id = ext.cluster as usize;
+            let size = mem[id].tcdm.end - mem[id].tcdm.start;
+            map.insert(ext.start, size, Region::Tcdm(id, ext.start));
+        }
+        for (id, m) in mem.iter().enumerate() {
+            map.insert(
+                m.tcdm.start,
+                m.tcdm.end - m.tcdm.start,
+                Region::Tcdm(id, m.tcdm.start),
+            );
+        }
+
+        let periphs = &mem[cluster_id].periphs;
+        map.insert(
+            periphs.start,
+            periphs.end.saturating_sub(periphs.start),
+            Region::Periphs,
+        );
+        map.insert(
+            config.bootrom.start,
+            config.bootrom.end.saturating_sub(config.bootrom.start),
+            Region::Bootrom,
+        );
+        map.insert(a.clint, 0x1000, Region::Clint);
+        map.insert(a.cl_clint, 0x8, Region::ClClint);
+        map.insert(a.cl_clint.wrapping_add(0x8), 4, Region::ClClintClear);
+        let dram = &mem[cluster_id].dram;
+        map.insert(
+            dram.start,
+            dram.end.saturating_sub(dram.start),
+            Region::Dram,
+        );
+        map
+    }
+
+    /// Add `region` to the parts of `[start, start + size)` that no earlier
+    /// region claims.
+    fn insert(&mut self, start: u32, size: u32, region: Region) {
+        let start = start as u64;
+        let end = start + size as u64;
+        let mut cursor = start;
+        let mut gaps = vec![];
+        for e in &self.entries {
+            if e.end <= cursor {
+                continue;
+            }
+            if e.start >= end {
+                break;
+            }
+            if e.start > cursor {
+                gaps.push(Entry {
+                    start: cursor,
+                    end: e.start,
+                    region,
+                });
+            }
+            cursor = e.end;
+        }
+        if cursor < end {
+            gaps.push(Entry {
+                start: cursor,
+                end,
+                region,
+            });
+        }
+        self.entries.extend(gaps);
+        self.entries.sort_by_key(|e| e.start);
+    }
+
+    /// Decode `addr` into its region and the first address past the region.
+    #[inline]
+    pub fn lookup(&self, addr: u32) -> (Region, u64) {
+        let addr = addr as u64;
+        let i = self.entries.partition_point(|e| e.start <= addr);
+        match i.checked_sub(1).map(|i| &self.entries[i]) {
+            Some(e) if addr < e.end => (e.region, e.end),
+            _ => (
+                Region::Unmapped,
+                self.entries.get(i).map_or(1 << 32, |e| e.start),
+            ),
+        }
+    }
+}
@@ -0,0 +1,83 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+//! Decoder for the binary traces written by `banshee --trace-binary`.
+//!
+//! Merges the per-hart trace files and prints them in the text format of
+//! `banshee --trace`, ordered by cycle, instret, and hart ID. This matches the
+//! output of `banshee --trace | sort`.
+
+#[path = "../trace.rs"]
+mod trace;
+
+use anyhow::{bail, Context, Result};
+use std::{
+    cmp::Reverse,
+    collections::BinaryHeap,
+    fs::File,
+    io::{BufReader, BufWriter, Read, Write},
+    path::{Path, PathBuf},
+};
+
+type Reader = BufReader<File>;
+
+fn open(path: &Path) -> Result<Reader> {
+    let file = File::open(path).with_context(|| format!("Cannot open {}", path.display()))?;
+    let mut reader = BufReader::with_capacity(1 << 20, file);
+    let mut magic = [0u8; 8];
+    reader.read_exact(&mut magic)?;
+    if magic != trace::MAGIC {
+        bail!("{} is not a banshee binary trace", path.display());
+    }
+    Ok(reader)
+}
+
+fn main() -> Result<()> {
+    let args: Vec<_> = std::env::args_os().skip(1).collect();
+    if args.is_empty() {
+        bail!("Usage: banshee-trace <trace directory or files>...");
+    }
+
+    // Collect the trace files, expanding directories.
+    let mut paths = vec![];
+    for arg in args.iter().map(PathBuf::from) {
+        if arg.is_dir() {
+            let mut entries: Vec<_> = std::fs::read_dir(&arg)?
+                .map(|e| e.map(|e| e.path()))
+                .collect::<Result<_, _>>()?;
+            entries.retain(|p| p.extension().map_or(false, |e| e == "trace"));
+            entries.sort();
+            paths.extend(entries);
+        } else {
+            paths.push(arg);
+        }
+    }
+    let mut readers = paths.iter().map(|p| open(p)).collect::<Result<Vec<_>>>()?;
+
+    // Merge the harts' records, which are each ordered already.
+    let mut heap = BinaryHeap::new();
+    let mut pending = vec![vec![]; readers.len()];
+    for (i, reader) in readers.iter_mut().enumerate() {
+        if let Some((header, accesses)) = trace::read_record(reader)? {
+            heap.push(Reverse((header, i)));
+            pending[i] = accesses;
+        }
+    }
+    let stdout = std::io::stdout();
+    let mut out = BufWriter::new(stdout.lock());
+    while let Some(Reverse((header, i))) = heap.pop() {
+        let args: Vec<_> = pending[i]
+            .iter()
+            .map(|&(access, data)| trace::format_access(access, data))
+            .collect();
+        writeln!(out, "{}", trace::format_line(&header, &args.join(" ")))?;
+        let next = trace::read_record(&mut readers[i])
+            .with_context(|| format!("Corrupt trace {}", paths[i].display()))?;
+        if let Some((header, accesses)) = next {
+            heap.push(Reverse((header, i)));
+            pending[i] = accesses;
+        }
+    }
+    Ok(())
+}
@@ -0,0 +1,213 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+//! Checkpoints of a running simulation
+//!
+//! With `--checkpoint`, a store to the checkpoint register acts as a barrier
+//! across all harts, where harts sleeping in `wfi` count as arrived. Once
+//! every hart has arrived, the architectural state of the system is written to
+//! a file: the state of each hart including its SSRs and DMA, the TCDMs, the
+//! allocated parts of the global memory, and the CLINT registers. A later run
+//! of the same binary with `--restore` loads the file and resumes each hart at
+//! the instruction after its store, or at its `wfi`.
+//!
+//! A checkpoint file starts with the 8-byte `MAGIC`, followed by the fields of
+//! `Checkpoint` in order. All values are little-endian, and variable-length
+//! sequences are prefixed with their length as a 64-bit value.
+
+use std::{
+    convert::TryInto,
+    io::{self, Read, Write},
+    path::Path,
+    sync::atomic::{AtomicU32, AtomicU64, AtomicUsize, Ordering},
+};
+
+/// Identifies a checkpoint file and its format version.
+pub const MAGIC: [u8; 8] = *b"BNSHCKP1";
+
+/// A value that can be saved to and restored from a checkpoint.
+pub trait Snapshot {
+    /// Append the value to `out`.
+    fn save(&self, out: &mut Vec<u8>);
+    /// Overwrite the value with the one at the front of `input`, and advance
+    /// `input` past it.
+    fn restore(&mut self, input: &mut &[u8]) -> io::Result<()>;
+}
+
+/// Split `n` bytes off the front of `input`.
+fn take<'a>(input: &mut &'a [u8], n: usize) -> io::Result<&'a [u8]> {
+    if input.len() < n {
+        return Err(io::Error::new(
+            io::ErrorKind::UnexpectedEof,
+            "truncated checkpoint",
+        ));
+    }
+    let (head, tail) = input.split_at(n);
+    *input = tail;
+    Ok(head)
+}
+
+macro_rules! snapshot_int {
+    ($($ty:ty),*) => {$(
+        impl Snapshot for $ty {
+            fn save(&self, out: &mut Vec<u8>) {
+                out.extend_from_slice(&self.to_le_bytes());
+            }
+            fn restore(&mut self, input: &mut &[u8]) -> io::Result<()> {
+                let bytes = take(input, std::mem::size_of::<$ty>())?;
+                *self = <$ty>::from_le_bytes(bytes.try_into().unwrap());
+                Ok(())
+            }
+        }
+    )*};
+}
+snapshot_int!(u8, u16, u32, u64);
+
+impl Snapshot for usize {
+    fn save(&self, out: &mut Vec<u8>) {
+        (*self as u64).save(out)
+    }
+    fn restore(&mut self, input: &mut &[u8]) -> io::Result<()> {
+        let mut value = 0u64;
+        value.restore(input)?;
+        *self = value as usize;
+        Ok(())
+    }
+}
+
+impl Snapshot for bool {
+    fn save(&self, out: &mut Vec<u8>) {
+        out.push(*self as u8)
+    }
+    fn restore(&mut self, input: &mut &[u8]) -> io::Result<()> {
+        *self = take(input, 1)?[0] != 0;
+        Ok(())
+    }
+}
+
+macro_rules! snapshot_atomic {
+    ($($ty:ty),*) => {$(
+        impl Snapshot for $ty {
+            fn save(&self, out: &mut Vec<u8>) {
+                self.load(Ordering::SeqCst).save(out)
+            }
+            fn restore(&mut self, input: &mut &[u8]) -> io::Result<()> {
+                self.get_mut().restore(input)
+            }
+        }
+    )*};
+}
+snapshot_atomic!(AtomicU32, AtomicU64, AtomicUsize);
+
+impl<T: Snapshot, const N: usize> Snapshot for [T; N] {
+    fn save(&self, out: &mut Vec<u8>) {
+        self.iter().for_each(|x| x.save(out))
+    }
+    fn restore(&mut self, input: &mut &[u8]) -> io::Result<()> {
+        self.iter_mut().try_for_each(|x| x.restore(input))
+    }
+}
+
+impl<T: Snapshot + Default> Snapshot for Vec<T> {
+    fn save(&self, out: &mut Vec<u8>) {
+        self.len().save(out);
+        self.iter().for_each(|x| x.save(out))
+    }
+    fn restore(&mut self, input: &mut &[u8]) -> io::Result<()> {
+        let mut len = 0usize;
+        len.restore(input)?;
+        // Every element takes at least a byte, so this bounds the allocation.
+        if len > input.len() {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                "corrupt checkpoint",
+            ));
+        }
+        self.clear();
+        self.resize_with(len, Default::default);
+        self.iter_mut().try_for_each(|x| x.restore(input))
+    }
+}
+
+impl<A: Snapshot, B: Snapshot> Snapshot for (A, B) {
+    fn save(&self, out: &mut Vec<u8>) {
+        self.0.save(out);
+        self.1.save(out);
+    }
+    fn restore(&mut self, input: &mut &[u8]) -> io::Result<()> {
+        self.0.restore(input)?;
+        self.1.restore(input)
+    }
+}
+
+/// Implement `Snapshot` for a struct by saving the listed fields in order.
+macro_rules! snapshot_fields {
+    ($ty:ty { $($field:ident),* $(,)? }) => {
+        impl $crate::checkpoint::Snapshot for $ty {
+            fn save(&self, out: &mut Vec<u8>) {
+                $($crate::checkpoint::Snapshot::save(&self.$field, out);)*
+            }
+            fn restore(&mut self, input: &mut &[u8]) -> std::io::Result<()> {
+                $($crate::checkpoint::Snapshot::restore(&mut self.$field, input)?;)*
+                Ok(())
+            }
+        }
+    };
+}
+pub(crate) use snapshot_fields;
+
+/// The state of the system at a checkpoint.
+#[derive(Default)]
+pub struct Checkpoint {
+    pub num_clusters: u32,
+    pub num_cores: u32,
+    /// The contents of the scratch register holding the exit code.
+    pub exit_code: u32,
+    /// For each hart, the PC to resume at and its saved `CpuState`.
+    pub harts: Vec<(u32, Vec<u8>)>,
+    /// The CLINT registers.
+    pub clint: Vec<u32>,
+    /// The cluster-local CLINT register of each cluster.
+    pub cl_clints: Vec<u64>,
+    /// The TCDM words of each cluster.
+    pub tcdms: Vec<Vec<u32>>,
+    /// The base address and words of each allocated chunk of global memory.
+    pub dram: Vec<(u32, Vec<u32>)>,
+}
+
+snapshot_fields!(Checkpoint {
+    num_clusters,
+    num_cores,
+    exit_code,
+    harts,
+    clint,
+    cl_clints,
+    tcdms,
+    dram,
+});
+
+impl Checkpoint {
+    /// Write the checkpoint to `path`.
+    pub fn write(&self, path: &Path) -> io::Result<()> {
+        let mut data = MAGIC.to_vec();
+        self.save(&mut data);
+        std::fs::File::create(path)?.write_all(&data)
+    }
+
+    /// Read a checkpoint from `path`.
+    pub fn read(path: &Path) -> io::Result<Self> {
+        let mut data = vec![];
+        std::fs::File::open(path)?.read_to_end(&mut data)?;
+        let mut input = &data[..];
+        if take(&mut input, MAGIC.len())? != MAGIC {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                "not a banshee checkpoint",
+            ));
+        }
+        let mut ckpt = Self::default();
+        ckpt.restore(&mut input)?;
+        Ok(ckpt)
+    }
+}
@@ -26,6 +26,10 @@ pub struct Configuration {
     pub ssr: Ssr,
     #[serde(default)]
     pub interrupt_latency: u32,
+    #[serde(default)]
+    pub dma: Dma,
+    #[serde(default)]
+    pub icache: Icache,
 }
 
 impl Default for Configuration {
@@ -38,6 +42,8 @@ impl Default for Configuration {
             inst_latency: Default::default(),
             ssr: Default::default(),
             interrupt_latency: 10,
+            dma: Default::default(),
+            icache: Default::default(),
         }
     }
 }
@@ -58,6 +64,8 @@ impl Configuration {
             inst_latency: Default::default(),
             ssr: Default::default(),
             interrupt_latency: 10,
+            dma: Default::default(),
+            icache: Default::default(),
         }
     }
     /// Parse a json/yaml file into a `Configuration` struct
@@ -127,11 +135,13 @@ impl Default for Memories {
                 start: 0x100000,
                 end: 0x120000,
                 latency: 2,
+                ..Default::default()
             },
             dram: Memory {
                 start: 0x80000000,
                 end: 0x90000000,
                 latency: 10,
+                ..Default::default()
             },
             periphs: MemoryCallback {
                 start: 0x20000,
@@ -150,6 +160,16 @@ pub struct Memory {
     pub start: u32,
     pub end: u32,
     pub latency: u64,
+    /// Number of banks for the TCDM bank conflict model (0 to disable)
+    #[serde(default)]
+    pub banks: u32,
+    /// Width of a bank in bytes, a power of two
+    #[serde(default = "default_bank_width")]
+    pub bank_width: u32,
+}
+
+fn default_bank_width() -> u32 {
+    8
 }
 
 impl Default for Memory {
@@ -158,6 +178,8 @@ impl Default for Memory {
             start: 0,
             end: u32::MAX,
             latency: 1,
+            banks: 0,
+            bank_width: default_bank_width(),
         }
     }
 }
@@ -209,6 +231,13 @@ pub struct Address {
     pub uart: u32,
     pub clint: u32,
     pub cl_clint: u32,
+    /// A store takes a checkpoint with `--checkpoint`
+    #[serde(default = "default_checkpoint_reg")]
+    pub checkpoint_reg: u32,
+}
+
+fn default_checkpoint_reg() -> u32 {
+    0x40000058
 }
 
 impl Default for Address {
@@ -224,6 +253,7 @@ impl Default for Address {
             cluster_num: 0x40000048,
             cluster_id: 0x40000050,
             cl_clint: 0x40000060,
+            checkpoint_reg: default_checkpoint_reg(),
             uart: 0xF00B8000,
             clint: 0xFFFF0000,
         }
@@ -242,6 +272,73 @@ impl Default for Ssr {
     }
 }
 
+/// Struct to configure the DMA timing model
+///
+/// Only used with instruction latency modeling enabled, as otherwise the
+/// cycle counters do not advance.
+#[derive(Debug, serde::Serialize, serde::Deserialize)]
+#[serde(default)]
+pub struct Dma {
+    /// Sustained transfer bandwidth in bytes per cycle (0 for instant transfers)
+    pub bandwidth: u32,
+    /// Cycles from issuing a transfer until its first data arrives
+    pub latency: u64,
+    /// Number of transfers in flight before issuing stalls
+    pub outstanding: u32,
+}
+
+impl Default for Dma {
+    fn default() -> Dma {
+        Dma {
+            bandwidth: 64,
+            latency: 10,
+            outstanding: 8,
+        }
+    }
+}
+
+/// Struct to configure the instruction cache model
+///
+/// Only used with instruction latency modeling enabled. Each hart fetches
+/// through a fully associative L0, which refills from an L1 shared by the
+/// cluster.
+#[derive(Debug, serde::Serialize, serde::Deserialize)]
+#[serde(default)]
+pub struct Icache {
+    /// Line size in bytes, a power of two
+    pub line_size: u32,
+    /// Number of lines in the L0 of each hart
+    pub l0_lines: u32,
+    /// Number of sets of the L1, a power of two (0 to disable the model)
+    pub sets: u32,
+    /// Number of ways of the L1
+    pub ways: u32,
+    /// Cycles to fetch a line from the L1 on an L0 miss
+    pub l1_latency: u64,
+    /// Cycles to refill a line of the L1 from memory on an L1 miss
+    pub refill_latency: u64,
+}
+
+impl Default for Icache {
+    fn default() -> Icache {
+        Icache {
+            line_size: 32,
+            l0_lines: 8,
+            sets: 0,
+            ways: 2,
+            l1_latency: 2,
+            refill_latency: 10,
+        }
+    }
+}
+
+impl Icache {
+    /// Whether the instruction cache is modelled.
+    pub fn enabled(&self) -> bool {
+        self.sets > 0 && self.ways > 0 && self.line_size >= 4
+    }
+}
+
 /// Description of the hierarchy
 #[derive(Debug, serde::Serialize, serde::Deserialize, Clone)]
 pub struct Architecture {
@@ -0,0 +1,191 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+//! Sparse, lock-free backing store for the global memory
+//!
+//! The 32-bit address space is split into fixed-size chunks of words. A flat
+//! table holds one pointer per chunk, and chunks are only allocated when they
+//! are first written. Harts therefore never contend on a lock to access DRAM,
+//! and every word is an `AtomicU32` such that AMOs and masked stores issued by
+//! different harts (or clusters) to the same word are race-free.
+
+use std::alloc::{alloc_zeroed, dealloc, handle_alloc_error, Layout};
+use std::sync::atomic::{AtomicPtr, AtomicU32, Ordering};
+
+/// Number of address bits covered by a single chunk (64 KiB).
+const CHUNK_BITS: u32 = 16;
+/// Number of words in a chunk.
+const CHUNK_WORDS: usize = 1 << (CHUNK_BITS - 2);
+/// Number of chunks needed to cover the full 32-bit address space.
+const NUM_CHUNKS: usize = 1 << (32 - CHUNK_BITS);
+
+/// A contiguous, zero-initialized block of memory words.
+struct Chunk([AtomicU32; CHUNK_WORDS]);
+
+/// The global memory, addressed in words.
+pub struct Dram {
+    chunks: Box<[AtomicPtr<Chunk>]>,
+}
+
+impl Default for Dram {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Dram {
+    /// Create an empty memory. All words read as zero until written.
+    pub fn new() -> Self {
+        Self {
+            chunks: (0..NUM_CHUNKS)
+                .map(|_| AtomicPtr::new(std::ptr::null_mut()))
+                .collect(),
+        }
+    }
+
+    /// Look up the chunk containing `addr`, if it has been allocated.
+    #[inline]
+    fn chunk(&self, addr: u32) -> Option<&Chunk> {
+        let slot = unsafe { self.chunks.get_unchecked((addr >> CHUNK_BITS) as usize) };
+        unsafe { slot.load(Ordering::Acquire).as_ref() }
+    }
+
+    /// Look up the chunk containing `addr`, allocating it on first use.
+    ///
+    /// Harts racing to allocate the same chunk agree on a single winner
+    /// through a compare-exchange on the chunk table.
+    fn chunk_or_alloc(&self, addr: u32) -> &Chunk {
+        if let Some(chunk) = self.chunk(addr) {
+            return chunk;
+        }
+        let slot = unsafe { self.chunks.get_unchecked((addr >> CHUNK_BITS) as usize) };
+        let layout = Layout::new::<Chunk>();
+        let fresh = unsafe { alloc_zeroed(layout) } as *mut Chunk;
+        if fresh.is_null() {
+            handle_alloc_error(layout);
+        }
+        match slot.compare_exchange(
+            std::ptr::null_mut(),
+            fresh,
+            Ordering::AcqRel,
+            Ordering::Acquire,
+        ) {
+            Ok(_) => unsafe { &*fresh },
+            Err(existing) => unsafe {
+                dealloc(fresh as *mut u8, layout);
+                &*existing
+            },
+        }
+    }
+
+    #[inline]
+    fn word(chunk: &Chunk, addr: u32) -> &AtomicU32 {
+        unsafe {
+            chunk
+                .0
+                .get_unchecked((addr as usize >> 2) & (CHUNK_WORDS - 1))
+        }
+    }
+
+    /// Load the word containing `addr`.
+    #[inline]
+    pub fn load(&self, addr: u32) -> u32 {
+        self.chunk(addr)
+            .map_or(0, |chunk| Self::word(chunk, addr).load(Ordering::Acquire))
+    }
+
+    /// Store the bits of `value` selected by `mask` to the word containing
+    /// `addr`.
+    #[inline]
+    pub fn store(&self, addr: u32, value: u32, mask: u32) {
+        let word = self.atomic(addr);
+        if mask == u32::MAX {
+            word.store(value, Ordering::Release);
+        } else {
+            let _ = word.fetch_update(Ordering::AcqRel, Ordering::Acquire, |prev| {
+                Some((prev & !mask) | (value & mask))
+            });
+        }
+    }
+
+    /// Get the word containing `addr` for atomic read-modify-write accesses.
+    #[inline]
+    pub fn atomic(&self, addr: u32) -> &AtomicU32 {
+        Self::word(self.chunk_or_alloc(addr), addr)
+    }
+
+    /// Get a host pointer to the byte at `addr` and the number of bytes that
+    /// follow it contiguously, for bulk copies into memory.
+    pub fn span(&self, addr: u32) -> (*mut u8, usize) {
+        Self::span_in(self.chunk_or_alloc(addr), addr)
+    }
+
+    /// Like `span`, but for bulk copies out of memory. Does not allocate: the
+    /// pointer is null if the chunk has never been written, in which case the
+    /// whole span reads as zero.
+    pub fn span_read(&self, addr: u32) -> (*const u8, usize) {
+        match self.chunk(addr) {
+            Some(chunk) => {
+                let (ptr, len) = Self::span_in(chunk, addr);
+                (ptr as *const u8, len)
+            }
+            None => (
+                std::ptr::null(),
+                (1 << CHUNK_BITS) - (addr as usize & ((1 << CHUNK_BITS) - 1)),
+            ),
+        }
+    }
+
+    #[inline]
+    fn span_in(chunk: &Chunk, addr: u32) -> (*mut u8, usize) {
+        let offset = addr as usize & ((1 << CHUNK_BITS) - 1);
+        let ptr = chunk.0.as_ptr() as *mut u8;
+        (unsafe { ptr.add(offset) }, (1 << CHUNK_BITS) - offset)
+    }
+
+    /// Iterate over the base address and words of each allocated chunk, e.g.
+    /// to save a checkpoint.
+    pub fn chunks(&self) -> impl Iterator<Item = (u32, &[AtomicU32])> + '_ {
+        self.chunks.iter().enumerate().filter_map(|(i, slot)| {
+            let chunk = unsafe { slot.load(Ordering::Acquire).as_ref() }?;
+            Some(((i as u32) << CHUNK_BITS, &chunk.0[..]))
+        })
+    }
+
+    /// Copy a block of bytes into memory, e.g. to preload ELF sections.
+    pub fn write_bytes(&self, addr: u32, data: &[u8]) {
+        for (i, bytes) in data.chunks(4).enumerate() {
+            let addr = addr.wrapping_add(4 * i as u32);
+            let mut value = 0u64;
+            let mut mask = 0u64;
+            for (j, &byte) in bytes.iter().enumerate() {
+                value |= (byte as u64) << (8 * j);
+                mask |= 0xff << (8 * j);
+            }
+            // Split words that straddle an unaligned address.
+            let shift = 8 * (addr & 3);
+            let (value, mask) = (value << shift, mask << shift);
+            self.store(addr, value as u32, mask as u32);
+            if (mask >> 32) != 0 {
+                self.store(
+                    addr.wrapping_add(4),
+                    (value >> 32) as u32,
+                    (mask >> 32) as u32,
+                );
+            }
+        }
+    }
+}
+
+impl Drop for Dram {
+    fn drop(&mut self) {
+        let layout = Layout::new::<Chunk>();
+        for slot in self.chunks.iter_mut() {
+            let ptr = *slot.get_mut();
+            if !ptr.is_null() {
+                unsafe { dealloc(ptr as *mut u8, layout) };
+            }
+        }
+    }
+}
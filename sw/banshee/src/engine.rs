@@ -5,7 +5,19 @@
 //! Engine for dynamic binary translation and execution
 
 use crate::{
-    bootroms::Bootroms, peripherals::Peripherals, riscv, tran::ElfTranslator, util::SiUnit,
+    address_map::{AddressMap, Region},
+    bootroms::Bootroms,
+    checkpoint::{Checkpoint, Snapshot},
+    dram::Dram,
+    jit_cache::JitCache,
+    optimize,
+    peripherals::Peripherals,
+    profile::{self, Symbols},
+    riscv,
+    runtime::{PerfEvents, PERF_CYCLES, PERF_NUM_EVENTS, PERF_RETIRED_INSTR},
+    trace::{self, TraceHeader},
+    tran::ElfTranslator,
+    util::SiUnit,
     Configuration,
 };
 extern crate flexfloat;
@@ -14,24 +26,29 @@ use anyhow::{anyhow, bail, Result};
 use itertools::Itertools;
 use llvm_sys::{
     analysis::*, core::*, execution_engine::*, ir_reader::*, linker::*, prelude::*, support::*,
-    target_machine::*, transforms::pass_manager_builder::*,
 };
 use std::{
     collections::HashMap,
+    io::Write,
     sync::{
         atomic::{AtomicBool, AtomicU32, AtomicUsize, Ordering},
-        Mutex,
+        Barrier, Condvar, Mutex,
     },
 };
 use termion::{color, style};
 
-pub use crate::runtime::{Cpu, CpuState, DmaState, SsrState, WakeupState};
+pub use crate::runtime::{
+    CheckpointState, CheckpointSync, ClusterWakeup, Cpu, CpuState, DmaState, Icache, SsrState, TcdmBanks,
+    WakeupState,
+};
+pub use crate::trace::TraceAccess;
 
 /// An execution engine.
 pub struct Engine {
     /// The global LLVM context.
     pub context: LLVMContextRef,
-    /// The LLVM modules which contains the translated code for each cluster.
+    /// The LLVM modules which contains the translated code for each cluster,
+    /// or a single module shared by all clusters.
     pub modules: Vec<LLVMModuleRef>,
     /// The exit code set by the binary.
     pub exit_code: AtomicU32,
@@ -45,8 +62,28 @@ pub struct Engine {
     pub interrupt: bool,
     /// Enable instruction tracing.
     pub trace: bool,
+    /// Write binary traces to this directory instead of printing them.
+    pub trace_dir: Option<std::path::PathBuf>,
+    /// Write profiles to this directory.
+    pub profile_dir: Option<std::path::PathBuf>,
+    /// Retired instructions, or cycles with `latency`, between profile
+    /// samples.
+    pub profile_period: u64,
     /// Enable instruction latency.
     pub latency: bool,
+    /// Translate the binary once and share the code across all clusters.
+    pub shared_jit: bool,
+    /// Cache for translated binaries.
+    pub jit_cache: Option<JitCache>,
+    /// The number of threads to optimize the translated code on.
+    pub jit_threads: usize,
+    /// Write a checkpoint to this file when the harts store to the
+    /// checkpoint register.
+    pub checkpoint_path: Option<std::path::PathBuf>,
+    /// Resume execution from this checkpoint.
+    pub restore_path: Option<std::path::PathBuf>,
+    /// The entry point of the binary.
+    pub entry: u32,
     /// The base hartid.
     pub base_hartid: usize,
     /// The number of cores.
@@ -57,13 +94,17 @@ pub struct Engine {
     pub config: Configuration,
     // pub config: Configuration,
     /// The global memory.
-    pub memory: Mutex<HashMap<u64, u32>>,
+    pub memory: Dram,
     /// The per-core putchar buffers (per hartid).
     pub putchar_buffer: Mutex<HashMap<usize, Vec<u8>>>,
     /// The peripherals for each cluster
     peripherals: Peripherals,
     /// The bootrom
     bootrom: Bootroms,
+    /// The address map for each cluster
+    address_map: Vec<AddressMap>,
+    /// The function symbols of the binary, for the profiler
+    symbols: Symbols,
 }
 
 // SAFETY: This is safe because only `context` and `module`
@@ -83,7 +124,16 @@ impl Engine {
             opt_jit: true,
             interrupt: true,
             trace: false,
+            trace_dir: None,
+            profile_dir: None,
+            profile_period: 1000,
             latency: false,
+            shared_jit: false,
+            jit_cache: None,
+            jit_threads: std::thread::available_parallelism().map_or(1, |n| n.get()),
+            checkpoint_path: None,
+            restore_path: None,
+            entry: 0,
             base_hartid: 0,
             num_cores: 1,
             num_clusters: 1,
@@ -92,12 +142,29 @@ impl Engine {
             putchar_buffer: Default::default(),
             peripherals: Peripherals::new(),
             bootrom: Bootroms::new(),
+            address_map: Default::default(),
+            symbols: Default::default(),
         }
     }
 
-    /// Create a Module for each cluster
+    /// Create a Module for each cluster, or a single one for all of them
     pub fn create_modules(&mut self) {
-        for i in 0..self.num_clusters {
+        if self.shared_jit {
+            // Latencies are baked into the code, so they need to match.
+            let mem = &self.config.memory;
+            if mem.iter().any(|m| {
+                m.tcdm.latency != mem[0].tcdm.latency || m.dram.latency != mem[0].dram.latency
+            }) {
+                warn!("Memory latencies differ across clusters; not sharing the translation");
+                self.shared_jit = false;
+            } else {
+                debug!(
+                    "Sharing the translation across {} clusters",
+                    self.num_clusters
+                );
+            }
+        }
+        for i in 0..self.num_modules() {
             let module = unsafe {
                 // Wrap the runtime IR up in an LLVM memory buffer.
                 let mut initial_ir = crate::runtime::JIT_INITIAL
@@ -134,9 +201,67 @@ impl Engine {
         }
     }
 
-    /// Translate an ELF binary.
-    pub fn translate_elf(&self, elf: &elf::File) -> Result<()> {
-        for i in 0..self.num_clusters {
+    /// The number of translated modules.
+    pub fn num_modules(&self) -> usize {
+        if self.shared_jit {
+            1
+        } else {
+            self.num_clusters
+        }
+    }
+
+    /// The module which holds the code executed by cluster `cluster_id`.
+    pub fn module_id(&self, cluster_id: usize) -> usize {
+        if self.shared_jit {
+            0
+        } else {
+            cluster_id
+        }
+    }
+
+    /// Translate an ELF binary, or load its translation from the JIT cache.
+    pub fn translate_elf(&mut self, elf: &elf::File) -> Result<()> {
+        let cache_key = self.jit_cache.as_ref().map(|_| JitCache::key(self, elf));
+        let cached = match (&self.jit_cache, cache_key) {
+            (Some(cache), Some(key)) => unsafe {
+                cache.load(self.context, key, self.num_modules())
+            },
+            _ => None,
+        };
+        if let Some(modules) = cached {
+            info!("Using cached translation {:016x}", cache_key.unwrap());
+            for (module, cached) in self.modules.iter_mut().zip(modules) {
+                unsafe { LLVMDisposeModule(*module) };
+                *module = cached;
+            }
+        } else {
+            self.translate_modules(elf)?;
+            if let (Some(cache), Some(key)) = (&self.jit_cache, cache_key) {
+                unsafe { cache.store(key, &self.modules) };
+            }
+        }
+
+        if self.profile_dir.is_some() {
+            self.symbols = Symbols::new(elf);
+        }
+        self.entry = elf.ehdr.entry as u32;
+
+        // Copy the executable sections into memory.
+        for section in &elf.sections {
+            if (section.shdr.flags.0 & elf::types::SHF_ALLOC.0) == 0 {
+                continue;
+            }
+            trace!("Preloading ELF section `{}`", section.shdr.name);
+            self.memory
+                .write_bytes(section.shdr.addr as u32, &section.data);
+        }
+
+        Ok(())
+    }
+
+    /// Translate and optimize the binary into the modules.
+    fn translate_modules(&self, elf: &elf::File) -> Result<()> {
+        for i in 0..self.num_modules() {
             let mut tran = ElfTranslator::new(elf, self, i);
 
             // Dump the contents of the binary.
@@ -215,98 +340,13 @@ impl Engine {
             unsafe { self.optimize() };
         }
 
-        // Copy the executable sections into memory.
-        {
-            let mut mem = self.memory.lock().unwrap();
-            for section in &elf.sections {
-                if (section.shdr.flags.0 & elf::types::SHF_ALLOC.0) == 0 {
-                    continue;
-                }
-                use byteorder::{LittleEndian, ReadBytesExt};
-                trace!("Preloading ELF section `{}`", section.shdr.name);
-                mem.extend(
-                    section
-                        .data
-                        .chunks(4)
-                        .enumerate()
-                        .map(|(offset, mut value)| {
-                            let addr = section.shdr.addr + offset as u64 * 4;
-                            let value = value.read_u32::<LittleEndian>().unwrap_or(0);
-                            trace!("  - 0x{:x} = 0x{:x}", addr, value);
-                            (addr, value)
-                        }),
-                );
-            }
-        }
-
         Ok(())
     }
 
     unsafe fn optimize(&self) {
         debug!("Optimizing IR");
-
-        // Create the pass managers.
-        for i in 0..self.num_clusters {
-            let func_passes = LLVMCreateFunctionPassManagerForModule(self.modules[i]);
-            let module_passes = LLVMCreatePassManager();
-
-            // Determine the target machine we are running on.
-            let tm_triple = LLVMGetDefaultTargetTriple();
-            let mut tm_target = std::ptr::null_mut();
-            let mut tm_target_msg = std::ptr::null_mut();
-            assert_eq!(
-                LLVMGetTargetFromTriple(tm_triple, &mut tm_target, &mut tm_target_msg),
-                0
-            );
-            let tm_cpu = LLVMGetHostCPUName();
-            let tm_features = LLVMGetHostCPUFeatures();
-            let tm = LLVMCreateTargetMachine(
-                tm_target,
-                tm_triple,
-                tm_cpu,
-                tm_features,
-                LLVMCodeGenOptLevel::LLVMCodeGenLevelAggressive,
-                LLVMRelocMode::LLVMRelocDefault,
-                LLVMCodeModel::LLVMCodeModelJITDefault,
-            );
-            LLVMDisposeMessage(tm_triple);
-            LLVMDisposeMessage(tm_cpu);
-            LLVMDisposeMessage(tm_features);
-
-            // Create a pass manager builder.
-            let builder = LLVMPassManagerBuilderCreate();
-            LLVMPassManagerBuilderSetOptLevel(builder, 3);
-            LLVMPassManagerBuilderSetSizeLevel(builder, 0);
-            LLVMPassManagerBuilderUseInlinerWithThreshold(builder, 275);
-
-            LLVMPassManagerBuilderPopulateFunctionPassManager(builder, func_passes);
-            LLVMAddAnalysisPasses(tm, module_passes);
-            LLVMPassManagerBuilderPopulateLTOPassManager(builder, module_passes, 0, 1);
-            LLVMPassManagerBuilderPopulateModulePassManager(builder, module_passes);
-
-            // Create and run the function pass manager.
-            LLVMInitializeFunctionPassManager(func_passes);
-            let mut func = LLVMGetFirstFunction(self.modules[i]);
-            while !func.is_null() {
-                let mut name_len = 0;
-                let name = LLVMGetValueName2(func, &mut name_len);
-                let name = std::slice::from_raw_parts(name as *const u8, name_len as usize);
-                let name = std::str::from_utf8_unchecked(name);
-                trace!("  - Optimizing function {}", name);
-                LLVMRunFunctionPassManager(func_passes, func);
-                func = LLVMGetNextFunction(func);
-            }
-            LLVMFinalizeFunctionPassManager(func_passes);
-
-            // Create and run the module pass manager.
-            trace!("  - Optimizing module");
-            LLVMRunPassManager(module_passes, self.modules[i]);
-
-            // Clean up.
-            LLVMPassManagerBuilderDispose(builder);
-            LLVMDisposePassManager(func_passes);
-            LLVMDisposePassManager(module_passes);
-            LLVMDisposeTargetMachine(tm);
+        for &module in &self.modules {
+            optimize::optimize_module(module, self.jit_threads);
         }
     }
 
@@ -327,6 +367,14 @@ impl Engine {
         }
     }
 
+    pub fn init_address_map(&mut self) {
+        debug!("Building address map");
+        self.address_map = (0..self.num_clusters)
+            .map(|i| AddressMap::new(&self.config, i))
+            .collect();
+        trace!("Address map of cluster 0: {:#x?}", self.address_map[0]);
+    }
+
     // Execute the loaded memory.
     pub fn execute(&self) -> Result<u32> {
         unsafe { self.execute_inner() }
@@ -335,7 +383,7 @@ impl Engine {
     unsafe fn execute_inner<'b>(&'b self) -> Result<u32> {
         // Create a JIT compiler for the module (and consumes it).
         debug!("Creating JIT compiler for translated code");
-        let execs: Vec<_> = (0..self.num_clusters)
+        let execs: Vec<_> = (0..self.num_modules())
             .map(|i| {
                 let mut ee = std::mem::MaybeUninit::uninit().assume_init();
                 let mut errmsg = std::mem::MaybeUninit::zeroed().assume_init();
@@ -357,25 +405,58 @@ impl Engine {
             })
             .collect();
 
-        // Allocate some TCDM memories.
-        let tcdms: Vec<_> = (0..self.num_clusters)
-            .map(|i| {
-                let mut tcdm = vec![
-                    0u32;
-                    ((self.config.memory[i].tcdm.end - self.config.memory[i].tcdm.start) / 4)
-                        as usize
-                ];
-
-                for (&addr, &value) in self.memory.lock().unwrap().iter() {
-                    if (addr as u32) >= self.config.memory[i].tcdm.start
-                        && (addr as u32) < self.config.memory[i].tcdm.end
-                    {
-                        tcdm[((addr - (self.config.memory[i].tcdm.start as u64)) / 4) as usize] =
-                            value;
+        // Load the checkpoint to resume from, and restore the global memory.
+        let restore = match &self.restore_path {
+            Some(path) => {
+                let ckpt = Checkpoint::read(path)
+                    .map_err(|e| anyhow!("Cannot read checkpoint {}: {}", path.display(), e))?;
+                if ckpt.num_clusters as usize != self.num_clusters
+                    || ckpt.num_cores as usize != self.num_cores
+                {
+                    bail!(
+                        "Checkpoint {} was taken with {} clusters of {} cores",
+                        path.display(),
+                        ckpt.num_clusters,
+                        ckpt.num_cores
+                    );
+                }
+                for (base, words) in &ckpt.dram {
+                    for (i, &word) in words.iter().enumerate() {
+                        self.memory.store(base + 4 * i as u32, word, u32::MAX);
                     }
                 }
+                // All clusters map their TCDM to the same addresses, so the
+                // TCDMs are restored directly below, not through the memory.
+                if ckpt.tcdms.len() != self.num_clusters
+                    || ckpt.tcdms.iter().enumerate().any(|(i, words)| {
+                        let tcdm = &self.config.memory[i].tcdm;
+                        words.len() != (tcdm.end - tcdm.start) as usize / 4
+                    })
+                {
+                    bail!(
+                        "Checkpoint {} does not match the TCDM configuration",
+                        path.display()
+                    );
+                }
+                info!("Restoring checkpoint {}", path.display());
+                Some(ckpt)
+            }
+            None => None,
+        };
 
-                tcdm
+        // Allocate some TCDM memories, initialized from the checkpoint if
+        // there is one.
+        let tcdms: Vec<_> = (0..self.num_clusters)
+            .map(|i| {
+                if let Some(ckpt) = &restore {
+                    return ckpt.tcdms[i].clone();
+                }
+                let tcdm_start = self.config.memory[i].tcdm.start;
+                let tcdm_end = self.config.memory[i].tcdm.end;
+                (tcdm_start..tcdm_end)
+                    .step_by(4)
+                    .map(|addr| self.memory.load(addr))
+                    .collect::<Vec<u32>>()
             })
             .collect();
 
@@ -384,15 +465,20 @@ impl Engine {
 
         // Allocate some barriers.
         let barriers: Vec<_> = (0..self.num_clusters)
-            .map(|_| AtomicUsize::new(0))
+            .map(|_| Barrier::new(self.num_cores))
             .collect();
 
-        // Allocate state struct to keep track of sleeping cores.
-        let wakeup_state = Mutex::new(WakeupState {
-            num: 0,
-            req: vec![0; self.num_clusters * self.num_cores],
-            wfi: vec![false; self.num_clusters * self.num_cores],
-        });
+        // Allocate state structs to keep track of sleeping cores.
+        let wakeup: Vec<_> = (0..self.num_clusters)
+            .map(|_| ClusterWakeup {
+                state: Mutex::new(WakeupState {
+                    req: vec![0; self.num_cores],
+                    wfi: vec![false; self.num_cores],
+                }),
+                cond: (0..self.num_cores).map(|_| Condvar::new()).collect(),
+            })
+            .collect();
+        let num_awake = AtomicUsize::new(self.num_clusters * self.num_cores);
 
         // Allocate CLINT registers
         let n_virt_cores = self.num_clusters * self.num_cores + self.base_hartid;
@@ -405,8 +491,33 @@ impl Engine {
             .map(|_| AtomicUsize::new(0))
             .collect();
 
+        // Allocate the TCDM banks for the conflict model
+        let tcdm_banks: Vec<_> = (0..self.num_clusters)
+            .map(|j| TcdmBanks::new(&self.config.memory[j].tcdm, self.latency))
+            .collect();
+
+        // Allocate the L1 instruction caches
+        let icaches: Vec<_> = (0..self.num_clusters)
+            .map(|_| Icache::new(&self.config.icache, self.latency))
+            .collect();
+
+        // Allocate the event counts published to the performance counters.
+        let perf_events: Vec<PerfEvents> = (0..self.num_clusters * self.num_cores)
+            .map(|_| Default::default())
+            .collect();
+
+        // Allocate the rendezvous for checkpoints.
+        let num_harts = self.num_clusters * self.num_cores;
+        let checkpoint = CheckpointSync {
+            num_harts,
+            state: Mutex::new(Default::default()),
+            done: Condvar::new(),
+            harts: Mutex::new(vec![Default::default(); num_harts]),
+            cl_clints: &cl_clints,
+        };
+
         // Create the CPUs.
-        let cpus: Vec<_> = (0..self.num_clusters)
+        let mut cpus: Vec<_> = (0..self.num_clusters)
             .flat_map(|j| (0..self.num_cores).map(move |i| (j, i)))
             .map(|(j, i)| {
                 let base_hartid = self.base_hartid + j * self.num_cores;
@@ -419,12 +530,32 @@ impl Engine {
                     base_hartid,
                     j,
                     &barriers[j],
-                    &wakeup_state,
+                    &wakeup,
+                    &num_awake,
                     &clint,
                     &cl_clints[j],
+                    &tcdm_banks[j],
+                    &icaches[j],
+                    &perf_events,
+                    &checkpoint,
                 )
             })
             .collect();
+
+        // Resume the harts from the checkpoint.
+        if let Some(ckpt) = &restore {
+            for (cpu, (pc, state)) in cpus.iter_mut().zip(&ckpt.harts) {
+                cpu.state.restore(&mut &state[..])?;
+                cpu.state.pc = *pc;
+            }
+            for (reg, &value) in clint.iter().zip(&ckpt.clint) {
+                reg.store(value, Ordering::SeqCst);
+            }
+            for (reg, &value) in cl_clints.iter().zip(&ckpt.cl_clints) {
+                reg.store(value as usize, Ordering::SeqCst);
+            }
+            self.exit_code.store(ckpt.exit_code, Ordering::SeqCst);
+        }
         trace!(
             "Initial state hart {}: {:#?}",
             cpus[0].hartid,
@@ -436,7 +567,7 @@ impl Engine {
         let t0 = std::time::Instant::now();
         crossbeam_utils::thread::scope(|s| {
             for cpu in &cpus {
-                let exec = execs[cpu.cluster_id];
+                let exec = execs[self.module_id(cpu.cluster_id)];
                 s.spawn(move |_| {
                     exec(cpu);
                     debug!("Hart {} finished", cpu.hartid);
@@ -448,6 +579,42 @@ impl Engine {
         let duration = (t1.duration_since(t0)).as_secs_f64();
         debug!("All {} harts finished", cpus.len());
 
+        // Flush the binary traces.
+        for cpu in &cpus {
+            if let Some(writer) = &cpu.trace_writer {
+                writer.lock().unwrap().flush()?;
+            }
+        }
+
+        // Write the profiles.
+        if let Some(dir) = &self.profile_dir {
+            let harts: Vec<_> = cpus
+                .iter()
+                .filter_map(|cpu| cpu.profile.as_ref().map(|p| (cpu.hartid, p)))
+                .collect();
+            profile::write(dir, &self.symbols, self.profile_period, &harts)?;
+            info!("Wrote profiles to {}", dir.display());
+        }
+
+        // Report the hit rates of the instruction caches.
+        if icaches[0].shift != 0 {
+            for cpu in &cpus {
+                let s = &cpu.state.icache;
+                let rate =
+                    |hits: u64, misses: u64| 100.0 * hits as f64 / (hits + misses).max(1) as f64;
+                info!(
+                    "Hart {} icache: L0 {} hits, {} misses ({:.2}%); L1 {} hits, {} misses ({:.2}%)",
+                    cpu.hartid,
+                    s.l0_hits,
+                    s.l0_misses,
+                    rate(s.l0_hits, s.l0_misses),
+                    s.l1_hits,
+                    s.l1_misses,
+                    rate(s.l1_hits, s.l1_misses),
+                );
+            }
+        }
+
         // Count the number of instructions that we have retired.
         let instret: u64 = cpus.iter().map(|cpu| cpu.state.instret).sum();
 
@@ -532,6 +699,10 @@ pub unsafe fn add_llvm_symbols() {
         b"banshee_rmw\0".as_ptr() as *const _,
         Cpu::binary_rmw as *mut _,
     );
+    LLVMAddSymbol(
+        b"banshee_dma_copy\0".as_ptr() as *const _,
+        Cpu::binary_dma_copy as *mut _,
+    );
     LLVMAddSymbol(
         b"banshee_csr_read\0".as_ptr() as *const _,
         Cpu::binary_csr_read as *mut _,
@@ -560,6 +731,18 @@ pub unsafe fn add_llvm_symbols() {
         b"banshee_wfi\0".as_ptr() as *const _,
         Cpu::binary_wfi as *mut _,
     );
+    LLVMAddSymbol(
+        b"banshee_profile_sample\0".as_ptr() as *const _,
+        Cpu::binary_profile_sample as *mut _,
+    );
+    LLVMAddSymbol(
+        b"banshee_profile_call\0".as_ptr() as *const _,
+        Cpu::binary_profile_call as *mut _,
+    );
+    LLVMAddSymbol(
+        b"banshee_profile_ret\0".as_ptr() as *const _,
+        Cpu::binary_profile_ret as *mut _,
+    );
     LLVMAddSymbol(
         b"banshee_check_clint\0".as_ptr() as *const _,
         Cpu::binary_check_clint as *mut _,
@@ -647,6 +830,9 @@ impl CpuState {
             wfi: false,
             dma: Default::default(),
             irq: Default::default(),
+            perf: [0; PERF_NUM_EVENTS],
+            profile_next: 0,
+            icache: Default::default(),
         }
     }
 }
@@ -661,105 +847,90 @@ impl<'a, 'b> Cpu<'a, 'b> {
         num_cores: usize,
         cluster_base_hartid: usize,
         cluster_id: usize,
-        barrier: &'b AtomicUsize,
-        wakeup_state: &'b Mutex<WakeupState>,
+        barrier: &'b Barrier,
+        wakeup: &'b Vec<ClusterWakeup>,
+        num_awake: &'b AtomicUsize,
         clint: &'b Vec<AtomicU32>,
         cl_clint: &'b AtomicUsize,
+        tcdm_banks: &'b TcdmBanks,
+        icache: &'b Icache,
+        perf_events: &'b Vec<PerfEvents>,
+        checkpoint: &'b CheckpointSync<'b>,
     ) -> Self {
+        let mut state = CpuState::new(
+            engine.config.ssr.num_dm,
+            hartid,
+            engine.config.bootrom.start,
+        );
+        state.dma = DmaState::new(&engine.config.dma, engine.latency);
+        state.profile_next = engine.profile_period;
+        state.pc = engine.entry;
+        let trace_writer = engine.trace_dir.as_ref().map(|dir| {
+            let path = dir.join(format!("hart_{:04}.trace", hartid));
+            let mut file = std::fs::File::create(&path)
+                .unwrap_or_else(|e| panic!("Cannot create trace {}: {}", path.display(), e));
+            file.write_all(&trace::MAGIC).unwrap();
+            Mutex::new(std::io::BufWriter::with_capacity(1 << 20, file))
+        });
         Self {
             engine,
-            state: CpuState::new(
-                engine.config.ssr.num_dm,
-                hartid,
-                engine.config.bootrom.start,
-            ),
+            state,
             tcdm_ptr,
             tcdm_ext_ptr,
             hartid,
             num_cores,
             cluster_base_hartid,
             cluster_id,
+            tcdm_start: engine.config.memory[cluster_id].tcdm.start,
+            tcdm_end: engine.config.memory[cluster_id].tcdm.end,
             barrier,
-            wakeup_state,
+            wakeup,
+            num_awake,
             clint,
             cl_clint,
+            tcdm_banks,
+            icache,
+            perf_events,
+            checkpoint,
+            trace_writer,
+            profile: engine.profile_dir.as_ref().map(|_| Default::default()),
         }
     }
 
     fn binary_load(&self, addr: u32, size: u8) -> u32 {
-        match addr {
-            x if x == self.engine.config.address.tcdm_start => {
-                self.engine.config.memory[self.cluster_id].tcdm.start
-            } // tcdm_start
-            x if x == self.engine.config.address.tcdm_end => {
-                self.engine.config.memory[self.cluster_id].tcdm.end
-            } // tcdm_end
-            x if x == self.engine.config.address.nr_cores => self.num_cores as u32, // nr_cores
-            x if x == self.engine.config.address.scratch_reg => {
-                self.engine.exit_code.load(Ordering::SeqCst)
-            } // scratch_reg
-            x if x == self.engine.config.address.barrier_reg => {
+        let (region, _) = self.engine.address_map[self.cluster_id].lookup(addr);
+        match region {
+            Region::TcdmStart => self.engine.config.memory[self.cluster_id].tcdm.start,
+            Region::TcdmEnd => self.engine.config.memory[self.cluster_id].tcdm.end,
+            Region::NrCores => self.num_cores as u32,
+            Region::ScratchReg => self.engine.exit_code.load(Ordering::SeqCst),
+            Region::BarrierReg => {
                 self.cluster_barrier();
                 0
-            } // barrier_reg
-            x if x == self.engine.config.address.cluster_base_hartid => {
-                self.cluster_base_hartid as u32
-            } // cluster_base_hartid
-            x if x == self.engine.config.address.cluster_num => self.engine.num_clusters as u32, // cluster_num
-            x if x == self.engine.config.address.cluster_id => self.cluster_id as u32, // cluster_id
-            // TCDM
-            x if x >= self.engine.config.memory[self.cluster_id].tcdm.start
-                && x < self.engine.config.memory[self.cluster_id].tcdm.end =>
-            {
-                let tcdm_addr = addr - self.engine.config.memory[self.cluster_id].tcdm.start;
-                let word_addr = tcdm_addr / 4;
-                let word_offs = tcdm_addr - 4 * word_addr;
-                let ptr: *const u32 = self.tcdm_ptr;
-                let word = unsafe { *ptr.offset(word_addr as isize) };
-                (word >> (8 * word_offs)) & ((((1 as u64) << (8 << size)) - 1) as u32)
             }
-            // TCDM External
-            x if self
-                .engine
-                .config
-                .memory
-                .iter()
-                .any(|m| x >= m.tcdm.start && x < m.tcdm.end) =>
-            {
-                let id = self
-                    .engine
-                    .config
-                    .memory
-                    .iter()
-                    .position(|m| addr >= m.tcdm.start && addr < m.tcdm.end)
-                    .unwrap();
-                let tcdm_addr = addr - self.engine.config.memory[id].tcdm.start;
-                let word_addr = tcdm_addr / 4;
-                let word_offs = tcdm_addr - 4 * word_addr;
-                let ptr: *const u32 = self.tcdm_ext_ptr[id];
-                let word = unsafe { *ptr.offset(word_addr as isize) };
+            Region::ClusterBaseHartid => self.cluster_base_hartid as u32,
+            Region::ClusterNum => self.engine.num_clusters as u32,
+            Region::ClusterId => self.cluster_id as u32,
+            Region::CheckpointReg => 0,
+            // TCDM, local or external
+            Region::Tcdm(id, base) => {
+                let word_offs = (addr - base) & 3;
+                let word = unsafe { *self.tcdm_word(id, base, addr) };
                 (word >> (8 * word_offs)) & ((((1 as u64) << (8 << size)) - 1) as u32)
             }
             // Peripherals
-            x if x >= self.engine.config.memory[self.cluster_id].periphs.start
-                && x < self.engine.config.memory[self.cluster_id].periphs.end =>
-            {
-                self.engine.peripherals.load(
-                    self.cluster_id,
-                    addr - self.engine.config.memory[self.cluster_id].periphs.start,
-                    size,
-                )
-            }
+            Region::Periphs => self.engine.peripherals.load(
+                self,
+                addr - self.engine.config.memory[self.cluster_id].periphs.start,
+                size,
+            ),
             // Bootrom
-            x if x >= self.engine.config.bootrom.start && x < self.engine.config.bootrom.end => {
-                self.engine
-                    .bootrom
-                    .load(addr - self.engine.config.bootrom.start)
-            }
+            Region::Bootrom => self
+                .engine
+                .bootrom
+                .load(addr - self.engine.config.bootrom.start),
             // access to the CLINT
-            x if x >= self.engine.config.address.clint
-                && x < self.engine.config.address.clint + 0x1000 =>
-            {
+            Region::Clint => {
                 trace!(
                     "CLINT Load off 0x{:x}",
                     addr as u64 - self.engine.config.address.clint as u64
@@ -768,51 +939,32 @@ impl<'a, 'b> Cpu<'a, 'b> {
                 self.clint[word_addr as usize].load(Ordering::SeqCst)
             }
             // The cl_clint is WO
-            x if x >= self.engine.config.address.cl_clint
-                && x < self.engine.config.address.cl_clint + 0x8 =>
-            {
-                0
-            }
+            Region::ClClint => 0,
             // DRAM
             _ => {
-                // Map all remaining addresses to the hash map but throw a warning if we read outside the memory map
-                if addr < self.engine.config.memory[self.cluster_id].dram.start
-                    || addr >= self.engine.config.memory[self.cluster_id].dram.end
-                {
+                // Map all remaining addresses to DRAM but throw a warning if we read outside the memory map
+                if !self.in_dram(region, addr) {
                     warn!(
                         "Hart {} (pc=0x{:08x}) is reading outside the memory map at 0x{:08x}",
                         self.hartid, self.state.pc, addr
                     );
                 }
                 // trace!("Load 0x{:x} ({}B)", addr, 8 << size);
-                self.engine
-                    .memory
-                    .lock()
-                    .unwrap()
-                    .get(&(addr as u64))
-                    .copied()
-                    .unwrap_or(0)
+                self.engine.memory.load(addr)
             }
         }
     }
 
     fn binary_store(&self, addr: u32, value: u32, mask: u32, size: u8) {
-        match addr {
-            x if x == self.engine.config.address.tcdm_start => (), // tcdm_start
-            x if x == self.engine.config.address.tcdm_end => (),   // tcdm_end
-            x if x == self.engine.config.address.nr_cores => (),   // nr_cores
-            x if x == self.engine.config.address.scratch_reg => {
-                self.engine.exit_code.store(value, Ordering::SeqCst)
-            } // scratch_reg
-            x if x == self.engine.config.address.wakeup_reg => {
-                // wakeup_req
-                self.wake(value);
-            } // wakeup_reg
-            x if x == self.engine.config.address.barrier_reg => (), // barrier_reg
-            x if x == self.engine.config.address.cluster_base_hartid => (), // cluster_base_hartid
-            x if x == self.engine.config.address.cluster_num => (), // cluster_num
-            x if x == self.engine.config.address.cluster_id => (), // cluster_id
-            x if x == self.engine.config.address.uart => {
+        let (region, _) = self.engine.address_map[self.cluster_id].lookup(addr);
+        match region {
+            Region::TcdmStart | Region::TcdmEnd | Region::NrCores => (),
+            Region::ScratchReg => self.engine.exit_code.store(value, Ordering::SeqCst),
+            Region::WakeupReg => self.wake(value),
+            Region::BarrierReg => (),
+            Region::ClusterBaseHartid | Region::ClusterNum | Region::ClusterId => (),
+            Region::CheckpointReg => self.take_checkpoint(),
+            Region::Uart => {
                 let mut buffer = self.engine.putchar_buffer.lock().unwrap();
                 let buffer = buffer.entry(self.hartid).or_default();
                 if value == '\n' as u32 {
@@ -829,69 +981,30 @@ impl<'a, 'b> Cpu<'a, 'b> {
                     buffer.push(value as u8);
                 }
             }
-            // TCDM
+            // TCDM, local or external
             // TODO: this is *not* thread-safe and *will* lead to undefined behavior on simultaneous access
             // by 2 harts. However, changing `tcdm_ptr` to a locked structure would require pervasive redesign.
-            x if x >= self.engine.config.memory[self.cluster_id].tcdm.start
-                && x < self.engine.config.memory[self.cluster_id].tcdm.end =>
-            {
-                let tcdm_addr = addr - self.engine.config.memory[self.cluster_id].tcdm.start;
-                let word_addr = tcdm_addr / 4;
-                let word_offs = tcdm_addr - 4 * word_addr;
-                let ptr = self.tcdm_ptr as *const u32;
-                let ptr_mut = ptr as *mut u32;
-                let wmask = ((((1 as u64) << (8 << size)) - 1) as u32) << (8 * word_offs);
-                unsafe {
-                    let word_ptr = ptr_mut.offset(word_addr as isize);
-                    let word = *word_ptr;
-                    *word_ptr = (word & !wmask) | ((value << (8 * word_offs)) & wmask);
-                }
-            }
-            // TCDM External
-            x if self
-                .engine
-                .config
-                .memory
-                .iter()
-                .any(|m| x >= m.tcdm.start && x < m.tcdm.end) =>
-            {
-                let id = self
-                    .engine
-                    .config
-                    .memory
-                    .iter()
-                    .position(|m| addr >= m.tcdm.start && addr < m.tcdm.end)
-                    .unwrap();
-                let tcdm_addr = addr - self.engine.config.memory[id].tcdm.start;
-                let word_addr = tcdm_addr / 4;
-                let word_offs = tcdm_addr - 4 * word_addr;
-                let ptr = self.tcdm_ext_ptr[id] as *const u32;
-                let ptr_mut = ptr as *mut u32;
+            Region::Tcdm(id, base) => {
+                let word_offs = (addr - base) & 3;
                 let wmask = ((((1 as u64) << (8 << size)) - 1) as u32) << (8 * word_offs);
                 unsafe {
-                    let word_ptr = ptr_mut.offset(word_addr as isize);
+                    let word_ptr = self.tcdm_word(id, base, addr);
                     let word = *word_ptr;
                     *word_ptr = (word & !wmask) | ((value << (8 * word_offs)) & wmask);
                 }
             }
             // Peripherals
-            x if x >= self.engine.config.memory[self.cluster_id].periphs.start
-                && x < self.engine.config.memory[self.cluster_id].periphs.end =>
-            {
-                self.engine.peripherals.store(
-                    self.cluster_id,
-                    addr - self.engine.config.memory[self.cluster_id].periphs.start,
-                    value,
-                    mask,
-                    size,
-                )
-            }
+            Region::Periphs => self.engine.peripherals.store(
+                self,
+                addr - self.engine.config.memory[self.cluster_id].periphs.start,
+                value,
+                mask,
+                size,
+            ),
             // Bootrom
-            x if x >= self.engine.config.bootrom.start && x < self.engine.config.bootrom.end => {}
+            Region::Bootrom => {}
             // access to the CLINT
-            x if x >= self.engine.config.address.clint
-                && x < self.engine.config.address.clint + 0x1000 =>
-            {
+            Region::Clint => {
                 let word_addr = (addr - self.engine.config.address.clint) / 4;
                 trace!("CLINT store word off {:x} = 0x{:x}", word_addr, value,);
                 let old_entry = self.clint[word_addr as usize].load(Ordering::SeqCst);
@@ -910,7 +1023,7 @@ impl<'a, 'b> Cpu<'a, 'b> {
                     }
                 }
             }
-            x if x == self.engine.config.address.cl_clint => {
+            Region::ClClint if addr == self.engine.config.address.cl_clint => {
                 // clint set register
                 let old_entry = self
                     .cl_clint
@@ -927,17 +1040,15 @@ impl<'a, 'b> Cpu<'a, 'b> {
                     }
                 }
             }
-            x if x == self.engine.config.address.cl_clint + 0x8 => {
+            Region::ClClintClear => {
                 // clint clear register
                 self.cl_clint
                     .fetch_and(!(value & mask) as usize, Ordering::SeqCst);
             }
             // DRAM
             _ => {
-                // Map all remaining addresses to the hash map but throw a warning if we write outside the memory map
-                if addr < self.engine.config.memory[self.cluster_id].dram.start
-                    || addr >= self.engine.config.memory[self.cluster_id].dram.end
-                {
+                // Map all remaining addresses to DRAM but throw a warning if we write outside the memory map
+                if !self.in_dram(region, addr) {
                     warn!(
                         "Hart {} (pc=0x{:08x}) is writing outside the memory map at 0x{:08x}",
                         self.hartid, self.state.pc, addr
@@ -950,40 +1061,160 @@ impl<'a, 'b> Cpu<'a, 'b> {
                     mask,
                     8 << size
                 );
-                let mut data = self.engine.memory.lock().unwrap();
-                let data = data.entry(addr as u64).or_default();
-                *data &= !mask;
-                *data |= value & mask;
+                self.engine.memory.store(addr, value, mask);
             }
         }
     }
 
+    /// Check whether an access that falls through to the global memory is
+    /// within this cluster's DRAM. Registers without a load or store side
+    /// effect may be shadowed by the DRAM window.
+    fn in_dram(&self, region: Region, addr: u32) -> bool {
+        let dram = &self.engine.config.memory[self.cluster_id].dram;
+        region == Region::Dram || (addr >= dram.start && addr < dram.end)
+    }
+
+    /// Get a pointer to the word containing `addr` in the TCDM of cluster
+    /// `id`, which is mapped at `base`.
+    fn tcdm_word(&self, id: usize, base: u32, addr: u32) -> *mut u32 {
+        let tcdm = if id == self.cluster_id {
+            self.tcdm_ptr
+        } else {
+            self.tcdm_ext_ptr[id]
+        } as *const u32 as *mut u32;
+        unsafe { tcdm.add(((addr - base) / 4) as usize) }
+    }
+
     fn binary_rmw(&self, addr: u32, value: u32, op: AtomicOp) -> u32 {
         trace!("RMW 0x{:x} (op={})= 0x{:x} (32B)", addr, op as u8, value);
-        let mut data = self.engine.memory.lock().unwrap();
-        let mut prev = data.get(&(addr as u64)).copied().unwrap_or(0);
+        let data = match self.engine.address_map[self.cluster_id].lookup(addr) {
+            // SAFETY: TCDM words are aligned and live as long as the harts.
+            (Region::Tcdm(id, base), _) => unsafe {
+                &*(self.tcdm_word(id, base, addr) as *const AtomicU32)
+            },
+            _ => self.engine.memory.atomic(addr),
+        };
+        let ord = Ordering::SeqCst;
         // Atomics
-        let result = match op {
-            AtomicOp::Amoadd => prev.wrapping_add(value),
-            AtomicOp::Amoxor => prev ^ value,
-            AtomicOp::Amoor => prev | value,
-            AtomicOp::Amoand => prev & value,
-            AtomicOp::Amomin => std::cmp::min(prev as i32, value as i32) as u32,
-            AtomicOp::Amomax => std::cmp::max(prev as i32, value as i32) as u32,
-            AtomicOp::Amominu => std::cmp::min(prev as u32, value as u32),
-            AtomicOp::Amomaxu => std::cmp::max(prev as u32, value as u32),
-            AtomicOp::Amoswap => value,
+        match op {
+            AtomicOp::Amoadd => data.fetch_add(value, ord),
+            AtomicOp::Amoxor => data.fetch_xor(value, ord),
+            AtomicOp::Amoor => data.fetch_or(value, ord),
+            AtomicOp::Amoand => data.fetch_and(value, ord),
+            AtomicOp::Amomin => data
+                .fetch_update(ord, ord, |prev| {
+                    Some(std::cmp::min(prev as i32, value as i32) as u32)
+                })
+                .unwrap(),
+            AtomicOp::Amomax => data
+                .fetch_update(ord, ord, |prev| {
+                    Some(std::cmp::max(prev as i32, value as i32) as u32)
+                })
+                .unwrap(),
+            AtomicOp::Amominu => data.fetch_min(value, ord),
+            AtomicOp::Amomaxu => data.fetch_max(value, ord),
+            AtomicOp::Amoswap => data.swap(value, ord),
             AtomicOp::ScW => {
-                if prev == self.state.cas_value {
-                    prev = 0; // Store-conditional success
-                    value
-                } else {
-                    return 1 as u32; // Store-conditional failed
+                match data.compare_exchange(self.state.cas_value, value, ord, ord) {
+                    Ok(_) => 0,  // Store-conditional success
+                    Err(_) => 1, // Store-conditional failed
                 }
             }
-        };
-        data.insert(addr as u64, result);
-        prev as u32
+        }
+    }
+
+    /// Copy `reps` rows of `size` bytes on behalf of the DMA.
+    ///
+    /// Rows are copied in bulk wherever source and destination resolve to
+    /// host memory; see `dma_resolve`.
+    fn binary_dma_copy(
+        &self,
+        dst: u32,
+        src: u32,
+        size: u32,
+        dst_stride: u32,
+        src_stride: u32,
+        reps: u32,
+    ) {
+        trace!(
+            "DMA 0x{:x} -> 0x{:x} ({}B x {}, strides {}/{})",
+            src,
+            dst,
+            size,
+            reps,
+            src_stride,
+            dst_stride
+        );
+        for i in 0..reps {
+            self.dma_copy_row(
+                dst.wrapping_add(i.wrapping_mul(dst_stride)),
+                src.wrapping_add(i.wrapping_mul(src_stride)),
+                size as usize,
+            );
+        }
+    }
+
+    fn dma_copy_row(&self, mut dst: u32, mut src: u32, mut size: usize) {
+        while size > 0 {
+            let n = match (self.dma_resolve(src, false), self.dma_resolve(dst, true)) {
+                (Some((src_ptr, src_len)), Some((dst_ptr, dst_len))) => {
+                    let n = size.min(src_len).min(dst_len);
+                    // SAFETY: Both spans are valid for `n` bytes. Like TCDM
+                    // accesses from the translated code, this is not atomic
+                    // with respect to concurrent accesses by other harts.
+                    if src_ptr.is_null() {
+                        // Never-written DRAM reads as zero.
+                        unsafe { std::ptr::write_bytes(dst_ptr, 0, n) };
+                    } else {
+                        unsafe { std::ptr::copy(src_ptr, dst_ptr, n) };
+                    }
+                    n
+                }
+                // Go through the regular path for registers and peripherals.
+                _ if (src | dst) & 3 == 0 && size >= 4 => {
+                    let value = self.binary_load(src, 2);
+                    self.binary_store(dst, value, u32::MAX, 2);
+                    4
+                }
+                _ => {
+                    let value = self.binary_load(src & !3, 2) >> (8 * (src & 3));
+                    let shift = 8 * (dst & 3);
+                    self.binary_store(dst & !3, (value & 0xff) << shift, 0xff << shift, 0);
+                    1
+                }
+            };
+            src = src.wrapping_add(n as u32);
+            dst = dst.wrapping_add(n as u32);
+            size -= n;
+        }
+    }
+
+    /// Resolve `addr` to host memory for bulk accesses.
+    ///
+    /// Returns a pointer to the byte at `addr` and the number of bytes that
+    /// are contiguous in host memory from there, or `None` if the address is
+    /// handled by a register or peripheral in `binary_load`/`binary_store`.
+    /// Unless `write` is set, DRAM is not allocated and the pointer is null
+    /// for memory that has never been written.
+    fn dma_resolve(&self, addr: u32, write: bool) -> Option<(*mut u8, usize)> {
+        let (region, end) = self.engine.address_map[self.cluster_id].lookup(addr);
+        let len = (end - addr as u64) as usize;
+        match region {
+            Region::Tcdm(id, base) => {
+                let ptr = self.tcdm_word(id, base, addr) as *mut u8;
+                Some((unsafe { ptr.add((addr & 3) as usize) }, len))
+            }
+            Region::Dram => {
+                let (ptr, span) = if write {
+                    self.engine.memory.span(addr)
+                } else {
+                    let (ptr, span) = self.engine.memory.span_read(addr);
+                    (ptr as *mut u8, span)
+                };
+                Some((ptr, span.min(len)))
+            }
+            _ => None,
+        }
     }
 
     fn binary_csr_read(&self, csr: riscv::Csr, notrace: u32) -> u32 {
@@ -1052,293 +1283,122 @@ impl<'a, 'b> Cpu<'a, 'b> {
     }
 
     unsafe fn binary_trace(&self, addr: u32, inst: u32, accesses: &[TraceAccess], data: &[u64]) {
+        let header = TraceHeader {
+            cycle: self.state.cycle,
+            instret: self.state.instret,
+            hartid: self.hartid as u16,
+            pc: addr,
+            inst,
+        };
+
+        // Binary traces only copy the record into the hart's buffer.
+        if let Some(writer) = &self.trace_writer {
+            let mut writer = writer.lock().unwrap();
+            if let Err(e) = trace::write_record(&mut *writer, &header, accesses, data) {
+                error!("Hart {} cannot write trace: {}", self.hartid, e);
+                self.engine.had_error.store(true, Ordering::SeqCst);
+            }
+            return;
+        }
+
         // Assemble the arguments.
         let args = accesses.iter().copied().zip(data.iter().copied());
-        let mut args = args.map(|(access, data)| match access {
-            TraceAccess::ReadMem => format!("RA:{:08x}", data as u32),
-            TraceAccess::WriteMem => format!("WA:{:08x}", data as u32),
-            TraceAccess::RMWMem => format!("AMO:{:08x}", data as u32),
-            TraceAccess::ReadReg(x) => format!("x{}:{:08x}", x, data as u32),
-            TraceAccess::WriteReg(x) => format!("x{}={:08x}", x, data as u32),
-            TraceAccess::ReadFReg(x) => format!("f{:02}:{:>16.6}", x, f64::from_bits(data)),
-            TraceAccess::WriteFReg(x) => format!("f{:02}={:>16.6}", x, f64::from_bits(data)),
-            TraceAccess::ReadF32Reg(x) => {
-                format!("f{:02}:{:>12.4}", x, f32::from_bits(data as u32))
-            }
-            TraceAccess::WriteF32Reg(x) => {
-                format!("f{:02}={:>12.4}", x, f32::from_bits(data as u32))
-            }
-            TraceAccess::Readf8Reg(x) => format!(
-                "f{:02}:[{:>5.3}]",
-                x,
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_0000_00ff) >> 0,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32)
-            ),
-            TraceAccess::Writef8Reg(x) => format!(
-                "f{:02}=[{:>5.3}]",
-                x,
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_0000_00ff) >> 0,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-            ),
-            TraceAccess::Readf16Reg(x) => format!(
-                "f{:02}=[{:>8.4}]",
-                x,
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_0000_ffff) >> 0,
-                    flexfloat::FfOpCvt::Fcvt16f2f,
-                    false,
-                    false
-                ) as u32),
-            ),
-            TraceAccess::Writef16Reg(x) => format!(
-                "f{:02}=[{:>5.3}]",
-                x,
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_0000_00ff) >> 0,
-                    flexfloat::FfOpCvt::Fcvt16f2f,
-                    false,
-                    false
-                ) as u32),
-            ),
-            TraceAccess::Readvf64sReg(x) => format!(
-                "f{:02}:[{:>12.4}, {:>12.4}]",
-                x,
-                f32::from_bits((data >> 32) as u32),
-                f32::from_bits((data) as u32)
-            ),
-            TraceAccess::Writevf64sReg(x) => format!(
-                "f{:02}=[{:>12.4}, {:>12.4}]",
-                x,
-                f32::from_bits((data >> 32) as u32),
-                f32::from_bits((data) as u32)
-            ),
-            TraceAccess::Readvf64hReg(x) => format!(
-                "f{:02}:[{:>8.4}, {:>8.4}, {:>8.4}, {:>8.4}]",
-                x,
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0xffff_0000_0000_0000) >> 48,
-                    flexfloat::FfOpCvt::Fcvt16f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_ffff_0000_0000) >> 32,
-                    flexfloat::FfOpCvt::Fcvt16f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_ffff_0000) >> 16,
-                    flexfloat::FfOpCvt::Fcvt16f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_0000_ffff) >> 0,
-                    flexfloat::FfOpCvt::Fcvt16f2f,
-                    false,
-                    false
-                ) as u32),
-            ),
-            TraceAccess::Writevf64hReg(x) => format!(
-                "f{:02}=[{:>8.4}, {:>8.4}, {:>8.4}, {:>8.4}]",
-                x,
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0xffff_0000_0000_0000) >> 48,
-                    flexfloat::FfOpCvt::Fcvt16f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_ffff_0000_0000) >> 32,
-                    flexfloat::FfOpCvt::Fcvt16f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_ffff_0000) >> 16,
-                    flexfloat::FfOpCvt::Fcvt16f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_0000_ffff) >> 0,
-                    flexfloat::FfOpCvt::Fcvt16f2f,
-                    false,
-                    false
-                ) as u32),
-            ),
-            TraceAccess::Readvf64bReg(x) => format!(
-                "f{:02}:[{:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}]",
-                x,
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0xff00_0000_0000_0000) >> 56,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x00ff_0000_0000_0000) >> 48,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_ff00_0000_0000) >> 40,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_00ff_0000_0000) >> 32,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_ff00_0000) >> 24,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_00ff_0000) >> 16,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_0000_ff00) >> 8,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_0000_00ff) >> 0,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-            ),
-            TraceAccess::Writevf64bReg(x) => format!(
-                "f{:02}=[{:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}]",
-                x,
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0xff00_0000_0000_0000) >> 56,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x00ff_0000_0000_0000) >> 48,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_ff00_0000_0000) >> 40,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_00ff_0000_0000) >> 32,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_ff00_0000) >> 24,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_00ff_0000) >> 16,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_0000_ff00) >> 8,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-                f32::from_bits(flexfloat::ff_instruction_cvt_to_s(
-                    (data & 0x0000_0000_0000_00ff) >> 0,
-                    flexfloat::FfOpCvt::Fcvt8f2f,
-                    false,
-                    false
-                ) as u32),
-            ),
-        });
+        let mut args = args.map(|(access, data)| trace::format_access(access, data));
         let args = args.join(" ");
 
         // Assemble the trace line.
-        let line = format!(
-            "{:08} {:08} {:04} {:08x}  {:38}  # DASM({:08x})",
-            self.state.cycle, self.state.instret, self.hartid, addr, args, inst
-        );
-        println!("{}", line);
+        println!("{}", trace::format_line(&header, &args));
     }
 
+    /// Put the hart to sleep until it is woken up or all harts are asleep.
+    ///
+    /// Sleeping harts park on their condition variable instead of spinning,
+    /// such that they do not compete with running harts for host cores.
+    /// `num_awake` counts the harts that are running or have a wake request
+    /// pending. Once it drops to zero, no hart can issue another request, and
+    /// all harts exit. Returns 1 in that case.
     fn binary_wfi(&mut self) -> u32 {
-        let mut wus = self.wakeup_state.lock().unwrap();
+        let core_id = self.hartid - self.cluster_base_hartid;
+        let cluster = &self.wakeup[self.cluster_id];
+        let mut wus = cluster.state.lock().unwrap();
         // Don't wfi if any interrupt is pending. Mip is updated before each instruction in tran.rs
         let mie = self.binary_csr_read(riscv::Csr::Mie, 1);
         let mip = self.binary_csr_read(riscv::Csr::Mip, 1);
-        let hartid = self.hartid - self.engine.base_hartid;
         if mip & mie != 0 {
             trace!(" hart: {} wfi is nop. mip: {:x}", self.hartid, mip);
             // clear a possible outstanding wakeup request
-            wus.req[hartid] = 0;
+            wus.req[core_id] = 0;
             // Trigger IRQ check on next instruction
             self.state.irq.sample_ctr = u32::MAX - 1;
             return 0;
         }
-        // Set own wfi.
-        self.state.wfi = true;
-        wus.wfi[hartid] = true;
-        wus.num += 1;
-        // Wait for the wake up call: poll while this hart is not requested to wake and
-        // exit iff all harts are in the WFI loop and no requests are outstanding
-        let mut do_poll = wus.req[hartid] == 0;
-        let mut do_exit =
-            wus.num == wus.req.len() && wus.req.iter().filter(|&n| *n != 0).count() == 0;
-        std::mem::drop(wus);
-        while do_poll {
-            // Check if everyone is sleeping
-            if do_exit {
+        // A request that arrived while running is consumed right away.
+        if wus.req[core_id] == 0 {
+            self.publish_perf_events();
+            self.park_for_checkpoint();
+            // Set own wfi.
+            self.state.wfi = true;
+            wus.wfi[core_id] = true;
+            if self.num_awake.fetch_sub(1, Ordering::SeqCst) == 1 {
+                // Everyone is sleeping; wake all harts so they can exit.
+                std::mem::drop(wus);
+                self.wake_all_for_exit();
                 return 1;
             }
-            std::thread::yield_now();
-            let wus = self.wakeup_state.lock().unwrap();
-            do_poll = wus.req[hartid] == 0;
-            do_exit = wus.num == wus.req.len() && wus.req.iter().filter(|&n| *n != 0).count() == 0;
-            std::mem::drop(wus);
+            while wus.req[core_id] == 0 {
+                if self.num_awake.load(Ordering::SeqCst) == 0 {
+                    return 1;
+                }
+                wus = cluster.cond[core_id].wait(wus).unwrap();
+            }
+            self.state.wfi = false;
+            wus.wfi[core_id] = false;
         }
-        let mut wus = self.wakeup_state.lock().unwrap();
         // Someone woke us up --> Clear the flag
-        let cycle = wus.req[hartid];
+        let cycle = wus.req[core_id];
         self.state.cycle = std::cmp::max(self.state.cycle, cycle as u64);
-        self.state.wfi = false;
-        wus.req[hartid] = 0;
-        wus.wfi[hartid] = false;
-        wus.num -= 1;
+        wus.req[core_id] = 0;
         // Trigger IRQ check on next instruction
         self.state.irq.sample_ctr = u32::MAX - 1;
         return 0;
     }
 
+    /// Record profile samples for the `count` instructions or cycles that
+    /// passed since the last sample.
+    fn binary_profile_sample(&mut self, count: u64) {
+        let period = self.engine.profile_period.max(1);
+        let weight = (count - self.state.profile_next) / period + 1;
+        self.state.profile_next += weight * period;
+        let pc = self.state.pc;
+        if let Some(profile) = &mut self.profile {
+            profile.sample(pc, weight);
+        }
+    }
+
+    fn binary_profile_call(&mut self, ret_addr: u32) {
+        if let Some(profile) = &mut self.profile {
+            profile.call(ret_addr);
+        }
+    }
+
+    fn binary_profile_ret(&mut self, target: u32) {
+        if let Some(profile) = &mut self.profile {
+            profile.ret(target);
+        }
+    }
+
+    /// Notify every sleeping hart once `num_awake` has dropped to zero.
+    fn wake_all_for_exit(&self) {
+        debug!("All harts are sleeping in wfi");
+        for cluster in self.wakeup.iter() {
+            // Taking the lock orders this after any hart's check of `num_awake`.
+            let _wus = cluster.state.lock().unwrap();
+            for cond in &cluster.cond {
+                cond.notify_one();
+            }
+        }
+    }
+
     fn binary_check_clint(&mut self) -> u32 {
         // read the clint software interrupt and return 1 if interrupt pending
         let hartid = self.hartid;
@@ -1355,51 +1415,169 @@ impl<'a, 'b> Cpu<'a, 'b> {
 
     /// A simple barrier across all cores in the cluster.
     ///
-    /// Uses an atomic barrier flag shared across all CPU threads in a cluster.
-    /// Core 0 coordinates. In a first phase, it waits until all cores but
-    /// itself have bumped the flag, then bumps itself and waits for all cores
-    /// to make it through.
+    /// Waiting harts are parked by the host OS until the last core arrives.
     fn cluster_barrier(&self) {
-        let core_id = self.hartid - self.cluster_base_hartid;
-        let core_num = self.num_cores;
-        if core_id == 0 {
-            while self.barrier.load(Ordering::Relaxed) < core_num - 1 {
-                std::thread::yield_now();
-            }
-            self.barrier.fetch_add(1, Ordering::Relaxed);
-            while self.barrier.load(Ordering::Relaxed) < 2 * core_num - 1 {
-                std::thread::yield_now();
-            }
-            self.barrier.store(0, Ordering::Relaxed);
-        } else {
-            while self.barrier.load(Ordering::Relaxed) >= core_num {
-                std::thread::yield_now();
-            }
-            self.barrier.fetch_add(1, Ordering::Relaxed);
-            while self.barrier.load(Ordering::Relaxed) < core_num {
-                std::thread::yield_now();
+        self.publish_perf_events();
+        self.barrier.wait();
+    }
+
+    /// Write a checkpoint once all harts have arrived here.
+    ///
+    /// Every hart saves its own state, and the last one to arrive writes the
+    /// checkpoint while the others wait, such that the memories are not
+    /// modified in the meantime. Harts parked in `wfi` count as arrived; see
+    /// `park_for_checkpoint`.
+    fn take_checkpoint(&self) {
+        if self.engine.checkpoint_path.is_none() {
+            return;
+        }
+        // Resume after the store that took the checkpoint.
+        self.save_for_checkpoint(self.state.pc.wrapping_add(4));
+        let mut sync = self.checkpoint.state.lock().unwrap();
+        let generation = sync.generation;
+        sync.arrived += 1;
+        self.write_checkpoint_if_complete(&mut sync);
+        while sync.generation == generation {
+            sync = self.checkpoint.done.wait(sync).unwrap();
+        }
+    }
+
+    /// Count the hart as arrived at the checkpoint rendezvous while it sleeps
+    /// in `wfi`, since it cannot reach the checkpoint register until another
+    /// hart wakes it up. Called with the cluster's wakeup lock held, such
+    /// that `wake` cannot race with it.
+    fn park_for_checkpoint(&self) {
+        if self.engine.checkpoint_path.is_none() {
+            return;
+        }
+        // Resume at the `wfi`, such that the hart goes back to sleep.
+        self.save_for_checkpoint(self.state.pc);
+        let mut sync = self.checkpoint.state.lock().unwrap();
+        sync.parked += 1;
+        self.write_checkpoint_if_complete(&mut sync);
+    }
+
+    /// Undo `park_for_checkpoint` for a hart that is being woken up.
+    fn unpark_for_checkpoint(&self) {
+        if self.engine.checkpoint_path.is_none() {
+            return;
+        }
+        self.checkpoint.state.lock().unwrap().parked -= 1;
+    }
+
+    /// Save the state of the hart for the next checkpoint.
+    fn save_for_checkpoint(&self, pc: u32) {
+        let mut state = vec![];
+        self.state.save(&mut state);
+        self.checkpoint.harts.lock().unwrap()[self.hartid - self.engine.base_hartid] =
+            (pc, state);
+    }
+
+    /// Write the checkpoint if the harts that arrived at the rendezvous and
+    /// the parked ones add up to all harts, and release the waiting harts.
+    fn write_checkpoint_if_complete(&self, sync: &mut CheckpointState) {
+        if sync.arrived == 0 || sync.arrived + sync.parked < self.checkpoint.num_harts {
+            return;
+        }
+        let path = self.engine.checkpoint_path.as_ref().unwrap();
+        let engine = self.engine;
+        let tcdms = (0..engine.num_clusters)
+            .map(|i| {
+                let tcdm = &engine.config.memory[i].tcdm;
+                let ptr = self.tcdm_ext_ptr[i] as *const u32;
+                let len = (tcdm.end - tcdm.start) as usize / 4;
+                unsafe { std::slice::from_raw_parts(ptr, len) }.to_vec()
+            })
+            .collect();
+        let ckpt = Checkpoint {
+            num_clusters: engine.num_clusters as u32,
+            num_cores: engine.num_cores as u32,
+            exit_code: engine.exit_code.load(Ordering::SeqCst),
+            // Parked harts keep their saved state for later checkpoints.
+            harts: self.checkpoint.harts.lock().unwrap().clone(),
+            clint: self
+                .clint
+                .iter()
+                .map(|r| r.load(Ordering::SeqCst))
+                .collect(),
+            cl_clints: self
+                .checkpoint
+                .cl_clints
+                .iter()
+                .map(|r| r.load(Ordering::SeqCst) as u64)
+                .collect(),
+            tcdms,
+            dram: engine
+                .memory
+                .chunks()
+                .map(|(base, words)| {
+                    let words = words.iter().map(|w| w.load(Ordering::SeqCst));
+                    (base, words.collect())
+                })
+                .collect(),
+        };
+        match ckpt.write(path) {
+            Ok(()) => info!("Wrote checkpoint {}", path.display()),
+            Err(e) => {
+                error!("Cannot write checkpoint {}: {}", path.display(), e);
+                engine.had_error.store(true, Ordering::SeqCst);
             }
-            self.barrier.fetch_add(1, Ordering::Relaxed);
         }
+        sync.arrived = 0;
+        sync.generation += 1;
+        self.checkpoint.done.notify_all();
     }
 
+    /// Publish the hart's event counts to the performance counters.
+    ///
+    /// Harts only publish when they access the peripherals, synchronize in
+    /// a barrier, or go to sleep, such that the translated code counts
+    /// events without atomics. Counters of other harts are exact as of their
+    /// last synchronization.
+    pub fn publish_perf_events(&self) {
+        let events = &self.perf_events[self.hartid - self.engine.base_hartid];
+        for (count, &value) in events.iter().zip(self.state.perf.iter()) {
+            count.store(value, Ordering::Relaxed);
+        }
+        // Without the latency model, every instruction takes one cycle.
+        let cycles = if self.engine.latency {
+            self.state.cycle
+        } else {
+            self.state.instret
+        };
+        events[PERF_CYCLES].store(cycles, Ordering::Relaxed);
+        events[PERF_RETIRED_INSTR].store(self.state.instret, Ordering::Relaxed);
+    }
+
+    /// Request hart `hart` (relative to the base hart ID), or all harts if
+    /// -1, to wake up from `wfi`.
     fn wake(&self, hart: u32) {
-        // Lock is released once out of scope
-        let mut wus = self.wakeup_state.lock().unwrap();
-        if hart as i32 == -1 {
-            for i in 0..wus.req.len() {
-                wus.req[i] = self.state.cycle + 1;
+        let num_harts = self.wakeup.len() * self.num_cores;
+        let harts = if hart as i32 == -1 {
+            0..num_harts
+        } else if (hart as usize) < num_harts {
+            hart as usize..hart as usize + 1
+        } else {
+            return;
+        };
+        for hart in harts {
+            let cluster = &self.wakeup[hart / self.num_cores];
+            let core_id = hart % self.num_cores;
+            // Lock is released once out of scope
+            let mut wus = cluster.state.lock().unwrap();
+            if wus.wfi[core_id] && wus.req[core_id] == 0 {
+                self.num_awake.fetch_add(1, Ordering::SeqCst);
+                self.unpark_for_checkpoint();
             }
-        } else if (hart as usize) < wus.req.len() {
-            wus.req[hart as usize] = self.state.cycle + 1;
+            wus.req[core_id] = self.state.cycle + 1;
+            cluster.cond[core_id].notify_one();
+            trace!(
+                "[{}] wake hart {}, awake: {}",
+                self.hartid,
+                hart,
+                self.num_awake.load(Ordering::Relaxed),
+            );
         }
-        trace!(
-            "[{}] wake num: {:?} req: {:?} wfi: {:?}",
-            self.hartid,
-            wus.num,
-            wus.req,
-            wus.wfi,
-        );
     }
 
     /*
@@ -1531,31 +1709,6 @@ impl<'a, 'b> Cpu<'a, 'b> {
     }
 }
 
-/// A single register or memory access as recorded in a trace.
-#[derive(Debug, Clone, Copy)]
-#[repr(C, u8)]
-pub enum TraceAccess {
-    ReadMem,
-    ReadReg(u8),
-    ReadFReg(u8),
-    Readf8Reg(u8),
-    Readf16Reg(u8),
-    ReadF32Reg(u8),
-    Readvf64sReg(u8),
-    Readvf64hReg(u8),
-    Readvf64bReg(u8),
-    WriteMem,
-    WriteReg(u8),
-    WriteFReg(u8),
-    Writef8Reg(u8),
-    Writef16Reg(u8),
-    WriteF32Reg(u8),
-    Writevf64sReg(u8),
-    Writevf64hReg(u8),
-    Writevf64bReg(u8),
-    RMWMem,
-}
-
 /// Which type of AMO to execute.
 #[derive(Debug, Clone, Copy)]
 #[repr(C)]
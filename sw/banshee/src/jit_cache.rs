@@ -0,0 +1,163 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+//! On-disk cache of translated binaries
+//!
+//! Translating and optimizing a binary dominates the startup of banshee, and
+//! sweeps often run the same binary many times with different data. The cache
+//! stores the optimized LLVM modules as bitcode, keyed by a hash over
+//! everything that affects the translation: the ELF sections, the
+//! configuration, the translation options, and the banshee version including
+//! its `jit.rs` runtime. Later runs with the same key skip the translation and
+//! optimization and hand the cached modules straight to the JIT compiler.
+
+use crate::engine::Engine;
+use llvm_sys::{bit_reader::*, bit_writer::*, core::*, prelude::*};
+use std::{
+    ffi::{CStr, CString},
+    hash::{Hash, Hasher},
+    path::{Path, PathBuf},
+};
+
+/// A cache directory holding translated modules.
+pub struct JitCache {
+    dir: PathBuf,
+}
+
+/// The 64-bit FNV-1a hash, which unlike `DefaultHasher` is stable across
+/// Rust releases.
+struct Fnv1a(u64);
+
+impl Hasher for Fnv1a {
+    fn finish(&self) -> u64 {
+        self.0
+    }
+
+    fn write(&mut self, bytes: &[u8]) {
+        for &b in bytes {
+            self.0 = (self.0 ^ b as u64).wrapping_mul(0x100000001b3);
+        }
+    }
+}
+
+impl JitCache {
+    /// Use `dir` as the cache directory; it is created on the first store.
+    pub fn new(dir: impl AsRef<Path>) -> Self {
+        Self {
+            dir: dir.as_ref().to_path_buf(),
+        }
+    }
+
+    /// Compute the cache key for translating `elf` with `engine`.
+    pub fn key(engine: &Engine, elf: &elf::File) -> u64 {
+        let mut h = Fnv1a(0xcbf29ce484222325);
+        env!("CARGO_PKG_VERSION").hash(&mut h);
+        crate::runtime::JIT_INITIAL.hash(&mut h);
+        crate::runtime::JIT_GENERATED.hash(&mut h);
+        // Go through a `Value` such that map keys are serialized in order.
+        serde_json::to_value(&engine.config)
+            .map(|c| c.to_string())
+            .unwrap_or_default()
+            .hash(&mut h);
+        (
+            engine.num_cores,
+            engine.num_clusters,
+            engine.base_hartid,
+            engine.opt_llvm,
+            engine.interrupt,
+            engine.trace,
+            engine.latency,
+            engine.shared_jit,
+            engine.profile_dir.is_some(),
+        )
+            .hash(&mut h);
+        elf.ehdr.entry.hash(&mut h);
+        for section in &elf.sections {
+            section.shdr.name.hash(&mut h);
+            section.shdr.addr.hash(&mut h);
+            section.shdr.flags.0.hash(&mut h);
+            section.data.hash(&mut h);
+        }
+        h.finish()
+    }
+
+    fn path(&self, key: u64, module: usize) -> PathBuf {
+        self.dir.join(format!("{:016x}-{}.bc", key, module))
+    }
+
+    /// Load the `num` modules cached under `key`, if all of them are present.
+    pub unsafe fn load(
+        &self,
+        context: LLVMContextRef,
+        key: u64,
+        num: usize,
+    ) -> Option<Vec<LLVMModuleRef>> {
+        let mut modules = Vec::with_capacity(num);
+        for i in 0..num {
+            let path = self.path(key, i);
+            match Self::load_module(context, &path) {
+                Some(module) => modules.push(module),
+                None => {
+                    modules.into_iter().for_each(|m| LLVMDisposeModule(m));
+                    return None;
+                }
+            }
+        }
+        Some(modules)
+    }
+
+    unsafe fn load_module(context: LLVMContextRef, path: &Path) -> Option<LLVMModuleRef> {
+        if !path.exists() {
+            return None;
+        }
+        let cpath = CString::new(path.to_string_lossy().as_bytes()).ok()?;
+        let mut buf = std::ptr::null_mut();
+        let mut errmsg = std::ptr::null_mut();
+        if LLVMCreateMemoryBufferWithContentsOfFile(cpath.as_ptr(), &mut buf, &mut errmsg) != 0 {
+            warn!(
+                "Cannot read JIT cache entry {}: {:?}",
+                path.display(),
+                CStr::from_ptr(errmsg)
+            );
+            LLVMDisposeMessage(errmsg);
+            return None;
+        }
+        let mut module = std::ptr::null_mut();
+        let failed = LLVMParseBitcodeInContext2(context, buf, &mut module) != 0;
+        LLVMDisposeMemoryBuffer(buf);
+        if failed {
+            warn!("Cannot parse JIT cache entry {}", path.display());
+            return None;
+        }
+        debug!("Loaded translation from {}", path.display());
+        Some(module)
+    }
+
+    /// Store `modules` under `key`.
+    ///
+    /// Entries are written to a temporary file and renamed into place, such
+    /// that concurrent runs never see a partially written entry.
+    pub unsafe fn store(&self, key: u64, modules: &[LLVMModuleRef]) {
+        if let Err(e) = std::fs::create_dir_all(&self.dir) {
+            warn!("Cannot create JIT cache {}: {}", self.dir.display(), e);
+            return;
+        }
+        for (i, &module) in modules.iter().enumerate() {
+            let path = self.path(key, i);
+            let tmp = path.with_extension(format!("{}.tmp", std::process::id()));
+            let ctmp = match CString::new(tmp.to_string_lossy().as_bytes()) {
+                Ok(p) => p,
+                Err(_) => return,
+            };
+            if LLVMWriteBitcodeToFile(module, ctmp.as_ptr()) != 0
+                || std::fs::rename(&tmp, &path).is_err()
+            {
+                warn!("Cannot write JIT cache entry {}", path.display());
+                let _ = std::fs::remove_file(&tmp);
+                return;
+            }
+            debug!("Stored translation in {}", path.display());
+        }
+    }
+}
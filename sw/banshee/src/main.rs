@@ -20,19 +20,27 @@ use std::{
     os::raw::c_int, path::Path, ptr::null_mut, str::FromStr,
 };
 
+pub mod address_map;
 pub mod bootroms;
+pub mod checkpoint;
 pub mod configuration;
+pub mod dram;
 pub mod dram_preload;
 pub mod engine;
+pub mod jit_cache;
+pub mod optimize;
 pub mod peripherals;
+pub mod profile;
 pub mod riscv;
 mod runtime;
 mod softfloat;
+pub mod trace;
 pub mod tran;
 pub mod util;
 
 use crate::configuration::*;
 use crate::engine::*;
+use crate::jit_cache::JitCache;
 
 use byteorder::{BigEndian, LittleEndian, ReadBytesExt};
 
@@ -90,6 +98,55 @@ fn main() -> Result<()> {
                 .long("opt-jit")
                 .help("Optimize during JIT compilation"),
         )
+        .arg(
+            Arg::with_name("shared-jit")
+                .long("shared-jit")
+                .help("Translate the binary once and share it across all clusters"),
+        )
+        .arg(
+            Arg::with_name("jit-cache")
+                .long("jit-cache")
+                .takes_value(true)
+                .help("Directory to cache translated binaries in"),
+        )
+        .arg(
+            Arg::with_name("jit-threads")
+                .long("jit-threads")
+                .takes_value(true)
+                .help(
+                    "Number of threads to optimize the translated binary on [default: host cores]",
+                ),
+        )
+        .arg(
+            Arg::with_name("trace-binary")
+                .long("trace-binary")
+                .takes_value(true)
+                .help("Write a binary instruction trace per hart to a directory"),
+        )
+        .arg(
+            Arg::with_name("profile")
+                .long("profile")
+                .takes_value(true)
+                .help("Sample the PC of each hart and write profiles to a directory"),
+        )
+        .arg(
+            Arg::with_name("profile-period")
+                .long("profile-period")
+                .takes_value(true)
+                .help("Retired instructions, or cycles with --latency, between profile samples"),
+        )
+        .arg(
+            Arg::with_name("checkpoint")
+                .long("checkpoint")
+                .takes_value(true)
+                .help("Write a checkpoint to a file on a store to the checkpoint register"),
+        )
+        .arg(
+            Arg::with_name("restore")
+                .long("restore")
+                .takes_value(true)
+                .help("Resume execution from a checkpoint file"),
+        )
         .arg(
             Arg::with_name("trace")
                 .long("trace")
@@ -224,7 +281,24 @@ fn main() -> Result<()> {
         debug!("Interrupts enabled");
     }
     engine.trace = matches.is_present("trace");
+    if let Some(dir) = matches.value_of("trace-binary") {
+        std::fs::create_dir_all(dir)
+            .with_context(|| format!("Failed to create trace directory {}", dir))?;
+        engine.trace = true;
+        engine.trace_dir = Some(dir.into());
+    }
+    engine.profile_dir = matches.value_of("profile").map(Into::into);
+    matches
+        .value_of("profile-period")
+        .map(|x| engine.profile_period = x.parse().unwrap());
     engine.latency = matches.is_present("latency");
+    engine.shared_jit = matches.is_present("shared-jit");
+    engine.jit_cache = matches.value_of("jit-cache").map(JitCache::new);
+    matches
+        .value_of("jit-threads")
+        .map(|x| engine.jit_threads = x.parse().unwrap());
+    engine.checkpoint_path = matches.value_of("checkpoint").map(Into::into);
+    engine.restore_path = matches.value_of("restore").map(Into::into);
 
     let has_num_cores = matches.is_present("num-cores");
     let has_num_clusters = matches.is_present("num-clusters");
@@ -324,11 +398,11 @@ fn main() -> Result<()> {
 
             let data_length = data.len() as u64;
 
-            let mut mem = engine.memory.lock().unwrap();
-
-            mem.extend(data);
+            for (addr, value) in data {
+                engine.memory.store(addr as u32, value, u32::MAX);
+            }
             for addr in mem_offset..mem_offset + data_length {
-                let val: u32 = mem.get(&(addr)).copied().unwrap_or(0);
+                let val: u32 = engine.memory.load(addr as u32);
                 trace!("address = 0x{:x}, binary value = {:#034b}", addr, val);
             }
         }
@@ -365,6 +439,9 @@ fn main() -> Result<()> {
     // Init the Bootrom
     engine.init_bootrom();
 
+    // Init the address map
+    engine.init_address_map();
+
     // Execute the binary.
     if !matches.is_present("dry-run") {
         let return_code = engine.execute().context("Failed to execute ELF binary")?;
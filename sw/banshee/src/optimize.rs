@@ -0,0 +1,257 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+//! Parallel optimization of translated modules
+//!
+//! The translator emits each region of the binary into its own function, and
+//! `execute_binary` dispatches between them. To optimize the regions on
+//! multiple threads, they are distributed over partitions. Each partition is
+//! a copy of the module in a private LLVM context, in which the regions of
+//! the other partitions are only declared. The partitions are optimized
+//! concurrently, stripped down to their regions, and linked back into the
+//! original module, which in the meantime optimizes the dispatcher and the
+//! runtime functions.
+
+use crate::tran::REGION_PREFIX;
+use llvm_sys::{
+    bit_reader::*, bit_writer::*, core::*, linker::*, prelude::*, target_machine::*,
+    transforms::pass_manager_builder::*, LLVMLinkage,
+};
+use std::ffi::CString;
+
+/// Optimize `module` on up to `threads` threads.
+pub unsafe fn optimize_module(module: LLVMModuleRef, threads: usize) {
+    let partitions = partition_regions(module, threads);
+    if partitions.len() <= 1 {
+        run_passes(module);
+        return;
+    }
+    debug!(
+        "Optimizing {} regions in {} partitions",
+        partitions.iter().map(|p| p.len()).sum::<usize>(),
+        partitions.len()
+    );
+
+    let bitcode = write_bitcode(module);
+    let optimized = crossbeam_utils::thread::scope(|s| {
+        let handles: Vec<_> = partitions
+            .iter()
+            .map(|names| {
+                let bitcode = &bitcode;
+                s.spawn(move |_| optimize_partition(bitcode, names))
+            })
+            .collect();
+
+        // Optimize what remains once the regions are moved out.
+        for names in &partitions {
+            for name in names {
+                declare_function(module, name);
+            }
+        }
+        run_passes(module);
+
+        handles
+            .into_iter()
+            .map(|h| h.join().expect("partition optimization panicked"))
+            .collect::<Vec<_>>()
+    })
+    .expect("partition optimization panicked");
+
+    // Link the optimized regions back in.
+    let context = LLVMGetModuleContext(module);
+    for bitcode in optimized {
+        let part = read_bitcode(context, &bitcode);
+        if LLVMLinkModules2(module, part) != 0 {
+            error!("Cannot link optimized partition");
+        }
+    }
+}
+
+/// Distribute the region functions of `module` over up to `threads`
+/// partitions of similar size.
+unsafe fn partition_regions(module: LLVMModuleRef, threads: usize) -> Vec<Vec<String>> {
+    let mut regions = vec![];
+    let mut func = LLVMGetFirstFunction(module);
+    while !func.is_null() {
+        let name = value_name(func);
+        if name.starts_with(REGION_PREFIX) && LLVMIsDeclaration(func) == 0 {
+            regions.push((LLVMCountBasicBlocks(func), name));
+        }
+        func = LLVMGetNextFunction(func);
+    }
+
+    // Hand out the largest regions first, each to the smallest partition.
+    regions.sort_by(|a, b| b.cmp(a));
+    let num = threads.max(1).min(regions.len());
+    let mut partitions: Vec<(u32, Vec<String>)> = vec![Default::default(); num];
+    for (size, name) in regions {
+        let part = partitions.iter_mut().min_by_key(|p| p.0).unwrap();
+        part.0 += size;
+        part.1.push(name);
+    }
+    partitions.into_iter().map(|p| p.1).collect()
+}
+
+/// Optimize the regions `names` in a private copy of the module, and return
+/// the bitcode of a module holding only them.
+fn optimize_partition(bitcode: &[u8], names: &[String]) -> Vec<u8> {
+    unsafe {
+        let context = LLVMContextCreate();
+        let module = read_bitcode(context, bitcode);
+
+        // Keep the regions of the partition and everything they may call.
+        let keep = |name: &str| names.iter().any(|n| n == name);
+        let mut others = vec![];
+        let mut func = LLVMGetFirstFunction(module);
+        while !func.is_null() {
+            let name = value_name(func);
+            if (name.starts_with(REGION_PREFIX) && !keep(&name)) || name == "execute_binary" {
+                others.push(name);
+            }
+            func = LLVMGetNextFunction(func);
+        }
+        for name in &others {
+            declare_function(module, name);
+        }
+        run_passes(module);
+
+        // Drop everything else that is externally visible, which the original
+        // module already defines.
+        let mut others = vec![];
+        let mut func = LLVMGetFirstFunction(module);
+        while !func.is_null() {
+            let name = value_name(func);
+            if LLVMIsDeclaration(func) == 0
+                && LLVMGetLinkage(func) == LLVMLinkage::LLVMExternalLinkage
+                && !keep(&name)
+            {
+                others.push(name);
+            }
+            func = LLVMGetNextFunction(func);
+        }
+        for name in &others {
+            declare_function(module, name);
+        }
+        let mut global = LLVMGetFirstGlobal(module);
+        while !global.is_null() {
+            if LLVMIsDeclaration(global) == 0
+                && LLVMGetLinkage(global) == LLVMLinkage::LLVMExternalLinkage
+            {
+                LLVMSetInitializer(global, std::ptr::null_mut());
+            }
+            global = LLVMGetNextGlobal(global);
+        }
+
+        let bitcode = write_bitcode(module);
+        LLVMDisposeModule(module);
+        LLVMContextDispose(context);
+        bitcode
+    }
+}
+
+/// Replace the definition of function `name` with a declaration.
+unsafe fn declare_function(module: LLVMModuleRef, name: &str) {
+    // The C API cannot drop a function body, so swap in a fresh declaration.
+    let cname = CString::new(name).unwrap();
+    let func = LLVMGetNamedFunction(module, cname.as_ptr());
+    if func.is_null() || LLVMIsDeclaration(func) != 0 {
+        return;
+    }
+    LLVMSetValueName2(func, "\0".as_ptr() as *const _, 0);
+    let decl = LLVMAddFunction(module, cname.as_ptr(), LLVMGlobalGetValueType(func));
+    LLVMReplaceAllUsesWith(func, decl);
+    LLVMDeleteFunction(func);
+}
+
+unsafe fn value_name(value: LLVMValueRef) -> String {
+    let mut len = 0;
+    let name = LLVMGetValueName2(value, &mut len);
+    let name = std::slice::from_raw_parts(name as *const u8, len as usize);
+    String::from_utf8_lossy(name).into_owned()
+}
+
+unsafe fn write_bitcode(module: LLVMModuleRef) -> Vec<u8> {
+    let buf = LLVMWriteBitcodeToMemoryBuffer(module);
+    let data = std::slice::from_raw_parts(
+        LLVMGetBufferStart(buf) as *const u8,
+        LLVMGetBufferSize(buf) as usize,
+    )
+    .to_vec();
+    LLVMDisposeMemoryBuffer(buf);
+    data
+}
+
+unsafe fn read_bitcode(context: LLVMContextRef, bitcode: &[u8]) -> LLVMModuleRef {
+    let buf = LLVMCreateMemoryBufferWithMemoryRange(
+        bitcode.as_ptr() as *const _,
+        bitcode.len(),
+        b"partition\0".as_ptr() as *const _,
+        0,
+    );
+    let mut module = std::ptr::null_mut();
+    let failed = LLVMParseBitcodeInContext2(context, buf, &mut module) != 0;
+    LLVMDisposeMemoryBuffer(buf);
+    assert!(!failed, "cannot parse partition bitcode");
+    module
+}
+
+/// Run the optimization pipeline on `module`.
+pub unsafe fn run_passes(module: LLVMModuleRef) {
+    let func_passes = LLVMCreateFunctionPassManagerForModule(module);
+    let module_passes = LLVMCreatePassManager();
+
+    // Determine the target machine we are running on.
+    let tm_triple = LLVMGetDefaultTargetTriple();
+    let mut tm_target = std::ptr::null_mut();
+    let mut tm_target_msg = std::ptr::null_mut();
+    assert_eq!(
+        LLVMGetTargetFromTriple(tm_triple, &mut tm_target, &mut tm_target_msg),
+        0
+    );
+    let tm_cpu = LLVMGetHostCPUName();
+    let tm_features = LLVMGetHostCPUFeatures();
+    let tm = LLVMCreateTargetMachine(
+        tm_target,
+        tm_triple,
+        tm_cpu,
+        tm_features,
+        LLVMCodeGenOptLevel::LLVMCodeGenLevelAggressive,
+        LLVMRelocMode::LLVMRelocDefault,
+        LLVMCodeModel::LLVMCodeModelJITDefault,
+    );
+    LLVMDisposeMessage(tm_triple);
+    LLVMDisposeMessage(tm_cpu);
+    LLVMDisposeMessage(tm_features);
+
+    // Create a pass manager builder.
+    let builder = LLVMPassManagerBuilderCreate();
+    LLVMPassManagerBuilderSetOptLevel(builder, 3);
+    LLVMPassManagerBuilderSetSizeLevel(builder, 0);
+    LLVMPassManagerBuilderUseInlinerWithThreshold(builder, 275);
+
+    LLVMPassManagerBuilderPopulateFunctionPassManager(builder, func_passes);
+    LLVMAddAnalysisPasses(tm, module_passes);
+    LLVMPassManagerBuilderPopulateLTOPassManager(builder, module_passes, 0, 1);
+    LLVMPassManagerBuilderPopulateModulePassManager(builder, module_passes);
+
+    // Create and run the function pass manager.
+    LLVMInitializeFunctionPassManager(func_passes);
+    let mut func = LLVMGetFirstFunction(module);
+    while !func.is_null() {
+        trace!("  - Optimizing function {}", value_name(func));
+        LLVMRunFunctionPassManager(func_passes, func);
+        func = LLVMGetNextFunction(func);
+    }
+    LLVMFinalizeFunctionPassManager(func_passes);
+
+    // Create and run the module pass manager.
+    trace!("  - Optimizing module");
+    LLVMRunPassManager(module_passes, module);
+
+    // Clean up.
+    LLVMPassManagerBuilderDispose(builder);
+    LLVMDisposePassManager(func_passes);
+    LLVMDisposePassManager(module_passes);
+    LLVMDisposeTargetMachine(tm);
+}
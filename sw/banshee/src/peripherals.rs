@@ -4,7 +4,12 @@
 
 /// Generic, memory-mapped peripherals implemented using runtime callbacks.
 use crate::configuration::Callback;
-use std::sync::atomic::{AtomicU32, Ordering};
+use crate::engine::Cpu;
+use crate::runtime::PERF_NUM_EVENTS;
+use std::sync::{
+    atomic::{AtomicU32, Ordering},
+    Mutex,
+};
 use PeriphReq::{Load, Store};
 
 /// Reference held by execution engine, referencing each peripheral instance in each cluster
@@ -40,15 +45,16 @@ impl Peripherals {
         );
     }
 
-    pub fn load(&self, cluster_id: usize, addr: u32, size: u8) -> u32 {
-        self.load_store(cluster_id, addr, size, Load)
+    pub fn load(&self, cpu: &Cpu, addr: u32, size: u8) -> u32 {
+        self.load_store(cpu, addr, size, Load)
     }
 
-    pub fn store(&self, cluster_id: usize, addr: u32, value: u32, mask: u32, size: u8) {
-        self.load_store(cluster_id, addr, size, Store(value, mask));
+    pub fn store(&self, cpu: &Cpu, addr: u32, value: u32, mask: u32, size: u8) {
+        self.load_store(cpu, addr, size, Store(value, mask));
     }
 
-    fn load_store(&self, cluster_id: usize, mut addr: u32, size: u8, req: PeriphReq) -> u32 {
+    fn load_store(&self, cpu: &Cpu, mut addr: u32, size: u8, req: PeriphReq) -> u32 {
+        let cluster_id = cpu.cluster_id;
         for i in &self.cluster_peripherals[cluster_id] {
             if addr < i.0 {
                 return match req {
@@ -60,7 +66,7 @@ impl Peripherals {
                             addr,
                             size
                         );
-                        self.peripherals[i.1].load(addr, size)
+                        self.peripherals[i.1].load(cpu, addr, size)
                     }
                     Store(val, mask) => {
                         trace!(
@@ -72,7 +78,7 @@ impl Peripherals {
                             mask,
                             val
                         );
-                        self.peripherals[i.1].store(addr, val, mask, size);
+                        self.peripherals[i.1].store(cpu, addr, val, mask, size);
                         0
                     }
                 };
@@ -110,10 +116,10 @@ enum PeriphReq {
 pub trait Peripheral {
     /// should return the same name as in the config file
     fn get_name(&self) -> &'static str;
-    /// store instruction
-    fn store(&self, addr: u32, value: u32, mask: u32, size: u8);
-    /// load instruction
-    fn load(&self, addr: u32, size: u8) -> u32;
+    /// store instruction issued by `cpu`
+    fn store(&self, cpu: &Cpu, addr: u32, value: u32, mask: u32, size: u8);
+    /// load instruction issued by `cpu`
+    fn load(&self, cpu: &Cpu, addr: u32, size: u8) -> u32;
 }
 
 /// Function called by the engine to get the peripheral types. This function should
@@ -124,6 +130,7 @@ pub fn get_peripheral_types() -> Vec<Box<dyn Peripheral>> {
         Box::new(Semaphores::default()),
         Box::new(Fence::default()),
         Box::new(ZeroMemory::default()),
+        Box::new(PerfCounters::default()),
     ]
 }
 
@@ -138,14 +145,14 @@ impl Peripheral for Fence {
         "fence"
     }
 
-    fn store(&self, addr: u32, val: u32, _mask: u32, _: u8) {
+    fn store(&self, _: &Cpu, addr: u32, val: u32, _mask: u32, _: u8) {
         match addr {
             0x0 => self.set.store(val, Ordering::SeqCst),
             _ => self.current.store(val, Ordering::SeqCst),
         }
     }
 
-    fn load(&self, _: u32, _: u8) -> u32 {
+    fn load(&self, _: &Cpu, _: u32, _: u8) -> u32 {
         self.current.fetch_add(1, Ordering::SeqCst);
         while self.set.load(Ordering::SeqCst) != self.current.load(Ordering::SeqCst) {}
         0
@@ -164,7 +171,7 @@ impl Peripheral for Semaphores {
         "semaphores"
     }
 
-    fn store(&self, addr: u32, val: u32, _mask: u32, _: u8) {
+    fn store(&self, _: &Cpu, addr: u32, val: u32, _mask: u32, _: u8) {
         match addr {
             0x0 => self.empty_count.store(val, Ordering::SeqCst),
             0x4 => {
@@ -220,7 +227,7 @@ impl Peripheral for Semaphores {
         }
     }
 
-    fn load(&self, _: u32, _: u8) -> u32 {
+    fn load(&self, _: &Cpu, _: u32, _: u8) -> u32 {
         0
     }
 }
@@ -233,9 +240,129 @@ impl Peripheral for ZeroMemory {
         "zero-memory"
     }
 
-    fn store(&self, _: u32, _: u32, _: u32, _: u8) {}
+    fn store(&self, _: &Cpu, _: u32, _: u32, _: u32, _: u8) {}
 
-    fn load(&self, _: u32, _: u8) -> u32 {
+    fn load(&self, _: &Cpu, _: u32, _: u8) -> u32 {
         0
     }
 }
+
+/// Number of performance counters in a cluster.
+const PERF_NUM_COUNTERS: usize = 16;
+
+/// The configuration and value of a single performance counter.
+#[derive(Default, Clone, Copy)]
+struct PerfCounter {
+    /// Bit mask of the events counted.
+    enable: u32,
+    /// Core index of the hart whose events are counted.
+    hart_select: u32,
+    /// Value when the counter was last written or reconfigured.
+    value: u64,
+    /// Events of the selected hart at that point.
+    base: u64,
+}
+
+impl PerfCounter {
+    fn read(&self, cpu: &Cpu) -> u64 {
+        let now = PerfCounters::events(cpu, self.enable, self.hart_select);
+        self.value.wrapping_add(now.wrapping_sub(self.base))
+    }
+
+    /// Restart counting from `value` with a new configuration.
+    fn rebase(&mut self, cpu: &Cpu, value: u64, enable: u32, hart_select: u32) {
+        self.value = value;
+        self.enable = enable;
+        self.hart_select = hart_select;
+        self.base = PerfCounters::events(cpu, enable, hart_select);
+    }
+}
+
+/// The cluster performance counters, with the register layout of `perf_regs_t`
+/// in `snRuntime/src/perf_cnt.h`: 16 `enable`, 16 `hart_select` and 16
+/// `perf_counter` registers, each padded to 8 bytes. The upper half of a
+/// counter reads as its upper 32 bits.
+///
+/// Counters are computed from the event counts that harts publish when they
+/// access the peripherals, synchronize, or sleep; see
+/// `Cpu::publish_perf_events`.
+#[derive(Default)]
+struct PerfCounters {
+    clusters: Mutex<Vec<[PerfCounter; PERF_NUM_COUNTERS]>>,
+}
+
+impl PerfCounters {
+    /// The sum of the events in `enable` that `hart_select` published.
+    fn events(cpu: &Cpu, enable: u32, hart_select: u32) -> u64 {
+        if hart_select as usize >= cpu.num_cores {
+            return 0;
+        }
+        let events = &cpu.perf_events[cpu.cluster_id * cpu.num_cores + hart_select as usize];
+        (0..PERF_NUM_EVENTS)
+            .filter(|&e| enable & (1 << e) != 0)
+            .map(|e| events[e].load(Ordering::Relaxed))
+            .fold(0, u64::wrapping_add)
+    }
+
+    /// Access the counters of `cpu`'s cluster.
+    fn with_counters<R>(
+        &self,
+        cpu: &Cpu,
+        f: impl FnOnce(&mut [PerfCounter; PERF_NUM_COUNTERS]) -> R,
+    ) -> R {
+        // Make the accessing hart's own events exact.
+        cpu.publish_perf_events();
+        let mut clusters = self.clusters.lock().unwrap();
+        if clusters.len() <= cpu.cluster_id {
+            clusters.resize(cpu.cluster_id + 1, Default::default());
+        }
+        f(&mut clusters[cpu.cluster_id])
+    }
+}
+
+impl Peripheral for PerfCounters {
+    fn get_name(&self) -> &'static str {
+        "perf-counters"
+    }
+
+    fn store(&self, cpu: &Cpu, addr: u32, val: u32, mask: u32, _: u8) {
+        let idx = (addr as usize >> 3) % PERF_NUM_COUNTERS;
+        let upper = addr & 4 != 0;
+        self.with_counters(cpu, |counters| {
+            let c = &mut counters[idx];
+            let value = c.read(cpu);
+            match addr >> 7 {
+                0 if !upper => {
+                    let enable = (c.enable & !mask) | (val & mask);
+                    c.rebase(cpu, value, enable, c.hart_select)
+                }
+                1 if !upper => {
+                    let hart_select = (c.hart_select & !mask) | (val & mask);
+                    c.rebase(cpu, value, c.enable, hart_select)
+                }
+                2 => {
+                    let shift = if upper { 32 } else { 0 };
+                    let mask = (mask as u64) << shift;
+                    let value = (value & !mask) | (((val as u64) << shift) & mask);
+                    c.rebase(cpu, value, c.enable, c.hart_select)
+                }
+                _ => (),
+            }
+        })
+    }
+
+    fn load(&self, cpu: &Cpu, addr: u32, _: u8) -> u32 {
+        let idx = (addr as usize >> 3) % PERF_NUM_COUNTERS;
+        let upper = addr & 4 != 0;
+        self.with_counters(cpu, |counters| {
+            let c = &counters[idx];
+            match addr >> 7 {
+                0 if !upper => c.enable,
+                1 if !upper => c.hart_select,
+                2 if !upper => c.read(cpu) as u32,
+                2 => (c.read(cpu) >> 32) as u32,
+                _ => 0,
+            }
+        })
+    }
+}
@@ -0,0 +1,161 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+//! Statistical PC-sampling profiler
+//!
+//! With `--profile`, every hart samples its PC and call stack once per
+//! profiling period of retired instructions, or of cycles with `--latency`.
+//! The translated code keeps a shadow call stack by pushing the return address
+//! on each call and popping it on the matching return. After execution, the
+//! samples are attributed to the function symbols of the binary and written
+//! as a flat profile per hart and a folded-stack file for flamegraph tools.
+
+use crate::runtime::HartProfile;
+use std::{
+    borrow::Cow,
+    collections::HashMap,
+    io::{self, Write},
+    path::Path,
+};
+
+/// Maximum depth of the shadow call stack. Deeper calls are not recorded.
+const MAX_DEPTH: usize = 256;
+
+/// The function symbols of a binary, for attributing addresses.
+#[derive(Default)]
+pub struct Symbols {
+    /// Start and end address and name, sorted by start address.
+    funcs: Vec<(u32, u32, String)>,
+}
+
+impl Symbols {
+    /// Collect the function symbols of `elf`.
+    pub fn new(elf: &elf::File) -> Self {
+        let mut funcs: Vec<_> = crate::tran::function_symbols(elf)
+            .into_iter()
+            .map(|sym| {
+                let start = sym.value as u32;
+                (start, start.wrapping_add(sym.size as u32), sym.name)
+            })
+            .collect();
+        funcs.sort();
+        funcs.dedup_by_key(|f| f.0);
+        // Symbols without a size extend to the next one.
+        for i in 0..funcs.len() {
+            if funcs[i].1 == funcs[i].0 {
+                funcs[i].1 = funcs.get(i + 1).map_or(u32::MAX, |f| f.0);
+            }
+        }
+        Self { funcs }
+    }
+
+    /// The name of the function containing `addr`, or the address itself.
+    pub fn name(&self, addr: u32) -> Cow<'_, str> {
+        let i = self.funcs.partition_point(|f| f.0 <= addr);
+        match i.checked_sub(1).map(|i| &self.funcs[i]) {
+            Some((_, end, name)) if addr < *end => Cow::Borrowed(name),
+            _ => Cow::Owned(format!("0x{:08x}", addr)),
+        }
+    }
+}
+
+impl HartProfile {
+    /// Record a call returning to `ret_addr`.
+    pub fn call(&mut self, ret_addr: u32) {
+        if self.stack.len() < MAX_DEPTH {
+            self.stack.push(ret_addr);
+        }
+    }
+
+    /// Record a return to `target`, unwinding to the matching call.
+    ///
+    /// Returns without a matching call, e.g. after a dropped call or a
+    /// `longjmp`, leave the stack as is.
+    pub fn ret(&mut self, target: u32) {
+        if let Some(i) = self.stack.iter().rposition(|&a| a == target) {
+            self.stack.truncate(i);
+        }
+    }
+
+    /// Record `weight` samples of the current call stack at `pc`.
+    pub fn sample(&mut self, pc: u32, weight: u64) {
+        // Attribute the frames to their call sites.
+        let mut key: Vec<u32> = self.stack.iter().map(|a| a.wrapping_sub(4)).collect();
+        key.push(pc);
+        *self.samples.entry(key).or_default() += weight;
+    }
+}
+
+/// Write the profiles of the harts to `dir`.
+///
+/// Creates `hart_<id>.prof` with the flat profile of each hart, and
+/// `profile.folded` with the call stacks of all harts, one line per stack.
+pub fn write(
+    dir: &Path,
+    symbols: &Symbols,
+    period: u64,
+    harts: &[(usize, &HartProfile)],
+) -> io::Result<()> {
+    std::fs::create_dir_all(dir)?;
+    let mut folded: HashMap<String, u64> = HashMap::new();
+    for &(hartid, profile) in harts {
+        let mut flat: HashMap<Cow<str>, (u64, u64)> = HashMap::new();
+        let mut total = 0;
+        for (stack, &n) in &profile.samples {
+            let names: Vec<_> = stack.iter().map(|&a| symbols.name(a)).collect();
+            total += n;
+            // Count each function once per sample, even if recursive.
+            let mut seen: Vec<&Cow<str>> = vec![];
+            for name in &names {
+                if !seen.contains(&name) {
+                    seen.push(name);
+                    flat.entry(name.clone()).or_default().1 += n;
+                }
+            }
+            if let Some(leaf) = names.last() {
+                flat.entry(leaf.clone()).or_default().0 += n;
+            }
+            let line = std::iter::once(format!("hart_{:04}", hartid))
+                .chain(names.iter().map(|n| n.to_string()))
+                .collect::<Vec<_>>()
+                .join(";");
+            *folded.entry(line).or_default() += n;
+        }
+
+        let mut flat: Vec<_> = flat.into_iter().collect();
+        flat.sort_by(|a, b| (b.1).0.cmp(&(a.1).0).then((b.1).1.cmp(&(a.1).1)));
+        let path = dir.join(format!("hart_{:04}.prof", hartid));
+        let mut f = io::BufWriter::new(std::fs::File::create(path)?);
+        writeln!(
+            f,
+            "# hart {}: {} samples, one per {} instructions or cycles",
+            hartid, total, period
+        )?;
+        writeln!(
+            f,
+            "{:>10} {:>7} {:>10} {:>7}  function",
+            "self", "%", "total", "%"
+        )?;
+        let pct = |n: u64| 100.0 * n as f64 / total.max(1) as f64;
+        for (name, (own, all)) in flat {
+            writeln!(
+                f,
+                "{:>10} {:>7.2} {:>10} {:>7.2}  {}",
+                own,
+                pct(own),
+                all,
+                pct(all),
+                name
+            )?;
+        }
+    }
+
+    let mut folded: Vec<_> = folded.into_iter().collect();
+    folded.sort();
+    let mut f = io::BufWriter::new(std::fs::File::create(dir.join("profile.folded"))?);
+    for (line, n) in folded {
+        writeln!(f, "{} {}", line, n)?;
+    }
+    Ok(())
+}
@@ -13,18 +13,123 @@
 
 use std::{
     sync::{
-        atomic::{AtomicU32, AtomicUsize},
-        Mutex,
+        atomic::{AtomicU32, AtomicU64, AtomicUsize},
+        Barrier, Condvar, Mutex,
     },
 };
 
+/// Sleep state of the harts in a cluster, indexed by the core ID.
 #[repr(C)]
 pub struct WakeupState {
-    pub num: usize,
+    /// Cycle at which a hart was requested to wake up, or 0 if none pending.
     pub req: Vec<u64>,
+    /// Whether a hart is sleeping in `wfi`.
     pub wfi: Vec<bool>,
 }
 
+/// A cluster's sleep state and one condition variable per hart to park on.
+pub struct ClusterWakeup {
+    pub state: Mutex<WakeupState>,
+    pub cond: Vec<Condvar>,
+}
+
+/// Number of events the performance counters can select from.
+pub const PERF_NUM_EVENTS: usize = 32;
+
+// Events of the performance counters, numbered as `snrt_perf_cnt_type` in
+// `snRuntime/src/perf_cnt.h`. Only the events banshee observes are counted.
+pub const PERF_CYCLES: usize = 0;
+pub const PERF_ISSUE_FPU: usize = 3;
+/// banshee does not model the FPU sequencer; this counts the FPU
+/// instructions fed by an SSR instead, which is what frep loops issue.
+pub const PERF_ISSUE_FPU_SEQ: usize = 4;
+pub const PERF_RETIRED_INSTR: usize = 6;
+pub const PERF_RETIRED_LOAD: usize = 7;
+pub const PERF_DMA_AW_BW: usize = 17;
+pub const PERF_DMA_AR_BW: usize = 19;
+pub const PERF_DMA_R_BW: usize = 21;
+pub const PERF_DMA_W_BW: usize = 23;
+/// The instruction cache events count L1 accesses on L0 misses, and the
+/// cycles fetches stall for them.
+pub const PERF_ICACHE_MISS: usize = 26;
+pub const PERF_ICACHE_HIT: usize = 27;
+pub const PERF_ICACHE_STALL: usize = 30;
+
+/// A hart's event counts as last published to the performance counters.
+pub type PerfEvents = [AtomicU64; PERF_NUM_EVENTS];
+
+/// Number of cycles of history each TCDM bank keeps for the conflict model.
+pub const TCDM_BANK_WINDOW: u64 = 1024;
+
+/// A cluster's TCDM banks, for the bank conflict model.
+pub struct TcdmBanks {
+    /// Number of banks, or 0 if conflicts are not modelled.
+    pub num: u32,
+    /// Log2 of the bank width in bytes.
+    pub shift: u32,
+    /// For each bank and cycle modulo `TCDM_BANK_WINDOW`, one plus the last
+    /// cycle in which the bank was accessed.
+    pub slots: Vec<AtomicU64>,
+}
+
+/// The maximum number of lines in the L0 instruction cache of a hart.
+pub const ICACHE_L0_MAX_LINES: usize = 16;
+
+/// A cluster's shared L1 instruction cache, for the fetch model.
+pub struct Icache {
+    /// Log2 of the line size in bytes, or 0 if fetches are not modelled.
+    pub shift: u32,
+    /// Number of lines in the L0 of each hart.
+    pub l0_lines: u32,
+    /// Number of sets minus one, a mask for the set index.
+    pub set_mask: u32,
+    /// Number of ways.
+    pub ways: u32,
+    /// Cycles to fetch a line from the L1, and to refill it from memory.
+    pub l1_latency: u64,
+    pub refill_latency: u64,
+    /// For each set and way, one plus the line address held, or 0 if empty.
+    pub tags: Vec<AtomicU32>,
+    /// For each set, the way to replace next.
+    pub victims: Vec<AtomicU32>,
+}
+
+/// A hart's samples for the profiler.
+#[derive(Default)]
+pub struct HartProfile {
+    /// The return addresses of the calls in progress, innermost last.
+    pub stack: Vec<u32>,
+    /// Number of samples per call stack, each ending in the sampled PC.
+    pub samples: std::collections::HashMap<Vec<u32>, u64>,
+}
+
+/// The rendezvous of all harts to take a checkpoint.
+pub struct CheckpointSync<'b> {
+    /// Number of harts across all clusters.
+    pub num_harts: usize,
+    /// The harts that have arrived at the rendezvous.
+    pub state: Mutex<CheckpointState>,
+    /// Notified once the checkpoint has been written.
+    pub done: Condvar,
+    /// The PC to resume at and the saved state of each hart, indexed
+    /// relative to the base hart ID.
+    pub harts: Mutex<Vec<(u32, Vec<u8>)>>,
+    /// The cluster-local CLINT registers of all clusters.
+    pub cl_clints: &'b Vec<AtomicUsize>,
+}
+
+/// Progress of the rendezvous in `CheckpointSync`.
+#[derive(Default)]
+pub struct CheckpointState {
+    /// Number of harts that stored to the checkpoint register.
+    pub arrived: usize,
+    /// Number of harts parked in `wfi`. They cannot reach the checkpoint
+    /// register and count as arrived.
+    pub parked: usize,
+    /// Number of checkpoints taken so far.
+    pub generation: usize,
+}
+
 /// A CPU pointer to be passed to the binary code.
 #[repr(C)]
 pub struct Cpu<'a, 'b> {
@@ -37,12 +142,30 @@ pub struct Cpu<'a, 'b> {
     pub cluster_base_hartid: usize,
     /// The cluster's identifier.
     pub cluster_id: usize,
-    /// The cluster's shared barrier state.
-    pub barrier: &'b AtomicUsize,
-    pub wakeup_state: &'b Mutex<WakeupState>,
+    /// The cluster's TCDM address range, for code shared across clusters.
+    pub tcdm_start: u32,
+    pub tcdm_end: u32,
+    /// The cluster's shared barrier.
+    pub barrier: &'b Barrier,
+    /// The sleep state of all clusters.
+    pub wakeup: &'b Vec<ClusterWakeup>,
+    /// Number of harts that are running or have a wake request pending.
+    pub num_awake: &'b AtomicUsize,
     pub clint: &'b Vec<AtomicU32>,
     /// cluster's shared CLINT state
     pub cl_clint: &'b AtomicUsize,
+    /// The cluster's TCDM banks.
+    pub tcdm_banks: &'b TcdmBanks,
+    /// The cluster's L1 instruction cache.
+    pub icache: &'b Icache,
+    /// The published event counts of all harts, for the performance counters.
+    pub perf_events: &'b Vec<PerfEvents>,
+    /// The rendezvous for checkpoints.
+    pub checkpoint: &'b CheckpointSync<'b>,
+    /// The hart's binary trace, if enabled.
+    pub trace_writer: Option<Mutex<std::io::BufWriter<std::fs::File>>>,
+    /// The hart's profile, if enabled.
+    pub profile: Option<HartProfile>,
 }
 
 /// A representation of a single CPU core's state.
@@ -62,6 +185,12 @@ pub struct CpuState {
     pub dma: DmaState,
     pub wfi: bool,
     pub irq: IrqState,
+    /// Event counts for the performance counters, indexed by event.
+    pub perf: [u64; PERF_NUM_EVENTS],
+    /// Instruction or cycle count at which to take the next profile sample.
+    pub profile_next: u64,
+    /// The L0 instruction cache and fetch statistics.
+    pub icache: IcacheState,
 }
 
 /// A representation of a single SSR address generator's state.
@@ -86,6 +215,24 @@ pub struct SsrState {
     accessed: bool,
 }
 
+/// A hart's L0 instruction cache and fetch statistics.
+#[derive(Default)]
+#[repr(C)]
+pub struct IcacheState {
+    /// One plus the line address of the last fetch, or 0 if none.
+    line: u32,
+    /// One plus the line addresses held in the L0, most recently used first,
+    /// or 0 if empty.
+    l0: [u32; ICACHE_L0_MAX_LINES],
+    pub l0_hits: u64,
+    pub l0_misses: u64,
+    pub l1_hits: u64,
+    pub l1_misses: u64,
+}
+
+/// The maximum number of DMA transfers that can be tracked in flight.
+pub const DMA_MAX_OUTSTANDING: usize = 16;
+
 /// A representation of a DMA backend's state.
 #[derive(Default)]
 #[repr(C)]
@@ -96,7 +243,21 @@ pub struct DmaState {
     dst_stride: u32,
     reps: u32,
     size: u32,
+    /// Number of completed transfers.
     done_id: u32,
+    /// ID of the next transfer to be issued.
+    next_id: u32,
+    /// Timing model: bytes per cycle (0 for instant transfers), setup
+    /// latency, and number of transfers in flight before issuing stalls.
+    bandwidth: u32,
+    outstanding: u32,
+    latency: u64,
+    /// Cycle at which the data channel becomes free.
+    free_cycle: u64,
+    /// Completion cycles of the transfers in flight, as a ring buffer.
+    pending: [u64; DMA_MAX_OUTSTANDING],
+    pending_head: u32,
+    num_pending: u32,
 }
 
 /// Store IRQ relevant CSRs
@@ -20,6 +20,7 @@
 declare i32 @banshee_load(%Cpu* %cpu, i32 %addr, i8 %size)
 declare void @banshee_store(%Cpu* %cpu, i32 %addr, i32 %value, i32 %mask, i8 %size)
 declare i32 @banshee_rmw(%Cpu* %cpu, i32 %addr, i32 %value, i8 %op)
+declare void @banshee_dma_copy(%Cpu* %cpu, i32 %dst, i32 %src, i32 %size, i32 %dst_stride, i32 %src_stride, i32 %reps)
 declare i32 @banshee_csr_read(%Cpu* %cpu, i16 %csr, i32 %notrace)
 declare void @banshee_csr_write(%Cpu* %cpu, i16 %csr, i32 %value, i32 %notrace)
 declare void @banshee_abort_escape(%Cpu* %cpu, i32 %addr)
@@ -27,6 +28,9 @@ declare void @banshee_abort_illegal_inst(%Cpu* %cpu, i32 %addr, i32 %raw)
 declare void @banshee_abort_illegal_branch(%Cpu* %cpu, i32 %addr, i32 %target)
 declare void @banshee_trace(%Cpu* %cpu, i32 %addr, i32 %raw, [2 x i64] %access_slice, [2 x i64] %data_slice)
 declare i32 @banshee_wfi(%Cpu* %cpu)
+declare void @banshee_profile_sample(%Cpu* %cpu, i64 %count)
+declare void @banshee_profile_call(%Cpu* %cpu, i32 %ret_addr)
+declare void @banshee_profile_ret(%Cpu* %cpu, i32 %target)
 declare i32 @banshee_check_clint(%Cpu* %cpu)
 declare i32 @banshee_check_cl_clint(%Cpu* %cpu)
 declare i64 @banshee_faddh(i64 %rs1, i64 %rs2, i8 %op)
@@ -68,7 +72,7 @@ declare void @banshee_dma_dst(%DmaState* writeonly %dma, i32 %lo, i32 %hi)
 declare i32 @banshee_dma_strt(%DmaState* %dma, %Cpu* %cpu, i32 %size, i32 %flags)
 declare void @banshee_dma_str(%DmaState* writeonly %dma, i32 %src, i32 %dst)
 declare void @banshee_dma_rep(%DmaState* writeonly %dma, i32 %reps)
-declare i32 @banshee_dma_stat(%DmaState* readonly %dma, i32 %addr)
+declare i32 @banshee_dma_stat(%DmaState* %dma, %Cpu* %cpu, i32 %addr)
 
 declare i32* @banshee_reg_ptr(%Cpu* %cpu, i32 %reg)
 declare i64* @banshee_reg_cycle_ptr(%Cpu* %cpu, i32 %reg)
@@ -78,8 +82,14 @@ declare i32* @banshee_cas_value_ptr(%Cpu* %cpu)
 declare i32* @banshee_pc_ptr(%Cpu* %cpu)
 declare i64* @banshee_cycle_ptr(%Cpu* %cpu)
 declare i64* @banshee_instret_ptr(%Cpu* %cpu)
+declare i64* @banshee_perf_ptr(%Cpu* %cpu, i32 %event)
+declare void @banshee_profile_tick(%Cpu* %cpu, i64 %count)
 declare i32* @banshee_tcdm_ptr(%Cpu* %cpu)
 declare i32* @banshee_tcdm_ext_ptr(%Cpu* %cpu, i32 %cluster_id)
+declare i32 @banshee_tcdm_start(%Cpu* %cpu)
+declare i32 @banshee_tcdm_end(%Cpu* %cpu)
+declare i64 @banshee_tcdm_bank_access(%Cpu* %cpu, i32 %addr, i64 %cycle)
+declare i64 @banshee_icache_fetch(%Cpu* %cpu, i32 %addr)
 declare %SsrState* @banshee_ssr_ptr(%Cpu* %cpu, i32 %ssr)
 declare i32* @banshee_ssr_enabled_ptr(%Cpu* %cpu)
 declare %DmaState* @banshee_dma_ptr(%Cpu* %cpu)
@@ -73,6 +73,26 @@ pub unsafe fn banshee_instret_ptr<'a>(cpu: &'a mut Cpu) -> &'a mut u64 {
     &mut cpu.state.instret
 }
 
+/// Get a pointer to the count of a performance counter event.
+#[no_mangle]
+#[inline(always)]
+pub unsafe fn banshee_perf_ptr<'a>(cpu: &'a mut Cpu, event: u32) -> &'a mut u64 {
+    cpu.state.perf.get_unchecked_mut(event as usize)
+}
+
+/// Take a profile sample if `count` instructions or cycles have passed since
+/// the last one.
+#[no_mangle]
+#[inline(always)]
+pub unsafe fn banshee_profile_tick(cpu: &mut Cpu, count: u64) {
+    extern "C" {
+        fn banshee_profile_sample(cpu: &mut Cpu, count: u64);
+    }
+    if count >= cpu.state.profile_next {
+        banshee_profile_sample(cpu, count);
+    }
+}
+
 /// Get a pointer to the TCDM buffer.
 #[no_mangle]
 #[inline(always)]
@@ -80,6 +100,20 @@ pub unsafe fn banshee_tcdm_ptr<'a>(cpu: &'a mut Cpu) -> &'a mut u32 {
     &mut *(cpu.tcdm_ptr as *const _ as *mut _)
 }
 
+/// Get the start address of the TCDM.
+#[no_mangle]
+#[inline(always)]
+pub unsafe fn banshee_tcdm_start(cpu: &Cpu) -> u32 {
+    cpu.tcdm_start
+}
+
+/// Get the end address of the TCDM.
+#[no_mangle]
+#[inline(always)]
+pub unsafe fn banshee_tcdm_end(cpu: &Cpu) -> u32 {
+    cpu.tcdm_end
+}
+
 /// Get a pointer to an external TCDM buffer.
 #[no_mangle]
 #[inline(always)]
@@ -196,51 +230,191 @@ pub unsafe fn banshee_ssr_read_cfg(ssr: &mut SsrState, addr: u32) -> u32 {
 }
 
 /// Generate the next address from an SSR.
+///
+/// This is inlined into the translated code. The common cases of repeating
+/// the current element and stepping along the innermost dimension of an
+/// affine stream stay inline; wrapping into outer dimensions and indirect
+/// streams are handled by `banshee_ssr_advance`.
 #[no_mangle]
+#[inline(always)]
 pub unsafe fn banshee_ssr_next(ssr: &mut SsrState, cpu: &mut Cpu) -> u32 {
-    extern "C" {
-        fn banshee_load(cpu: &mut Cpu, addr: u32, size: u8) -> u32;
-    }
-    // TODO: Assert that the SSR is not done.
     let ptr = ssr.ptr;
     // execute increment only, if SSR register has not been previously
     // accessed. The ssr.accessed flag is cleared after an instruction
     // is retired. This prohibits that an instruction using ftX multiple
     // times (e.g. fmul.d ft3, ft0, ft0) from being served different values
-    if !ssr.accessed {
-        if ssr.repeat_count == ssr.repeat_bound {
-            ssr.repeat_count = 0;
-            let mut stride = 0;
-            ssr.done = true;
-            for i in 0..=(ssr.dims as usize) {
-                stride = *ssr.stride.get_unchecked(i);
-                if *ssr.index.get_unchecked(i) == *ssr.bound.get_unchecked(i) {
-                    *ssr.index.get_unchecked_mut(i) = 0;
-                } else {
-                    *ssr.index.get_unchecked_mut(i) += 1;
-                    ssr.done = false;
-                    break;
-                }
-            }
-            if ssr.indir {
-                ssr.idx_ptr = ssr.idx_ptr.wrapping_add(1 << ssr.idx_size);
-                let idx = banshee_load(cpu, ssr.idx_ptr, ssr.idx_size as u8);
-                ssr.ptr_next = ssr
-                    .idx_base
-                    .wrapping_add((idx << ssr.idx_shift) * ssr.stride.get_unchecked(0))
-            } else {
-                ssr.ptr_next = ssr.ptr.wrapping_add(stride);
-            }
-        } else {
-            ssr.repeat_count += 1;
-        }
+    if ssr.accessed {
+        return ptr;
+    }
+    if ssr.repeat_count != ssr.repeat_bound {
+        ssr.repeat_count += 1;
+    } else if !ssr.indir && *ssr.index.get_unchecked(0) != *ssr.bound.get_unchecked(0) {
+        ssr.repeat_count = 0;
+        *ssr.index.get_unchecked_mut(0) += 1;
+        ssr.done = false;
+        ssr.ptr_next = ptr.wrapping_add(*ssr.stride.get_unchecked(0));
+    } else {
+        banshee_ssr_advance(ssr, cpu);
+    }
+    if cpu.tcdm_banks.num != 0 {
+        // The stream competes for TCDM banks as the instruction issues.
+        cpu.state.cycle += banshee_tcdm_bank_access(cpu, ptr, cpu.state.cycle + 1);
     }
     ssr.accessed = true;
     ptr
 }
 
+/// Advance an SSR past the end of its innermost dimension, or to the next
+/// index of an indirect stream.
+#[no_mangle]
+#[inline(never)]
+pub unsafe fn banshee_ssr_advance(ssr: &mut SsrState, cpu: &mut Cpu) {
+    extern "C" {
+        fn banshee_load(cpu: &mut Cpu, addr: u32, size: u8) -> u32;
+    }
+    // TODO: Assert that the SSR is not done.
+    ssr.repeat_count = 0;
+    let mut stride = 0;
+    ssr.done = true;
+    for i in 0..=(ssr.dims as usize) {
+        stride = *ssr.stride.get_unchecked(i);
+        if *ssr.index.get_unchecked(i) == *ssr.bound.get_unchecked(i) {
+            *ssr.index.get_unchecked_mut(i) = 0;
+        } else {
+            *ssr.index.get_unchecked_mut(i) += 1;
+            ssr.done = false;
+            break;
+        }
+    }
+    if ssr.indir {
+        ssr.idx_ptr = ssr.idx_ptr.wrapping_add(1 << ssr.idx_size);
+        let idx = banshee_load(cpu, ssr.idx_ptr, ssr.idx_size as u8);
+        ssr.ptr_next = ssr
+            .idx_base
+            .wrapping_add((idx << ssr.idx_shift) * ssr.stride.get_unchecked(0))
+    } else {
+        ssr.ptr_next = ssr.ptr.wrapping_add(stride);
+    }
+}
+
+/// Claim the TCDM bank holding `addr` for an access issued in `cycle`.
+///
+/// Returns the number of cycles the access stalls because other harts or
+/// streams claimed the bank in the same cycles. Accesses outside the
+/// cluster's TCDM never stall.
+#[no_mangle]
+pub unsafe fn banshee_tcdm_bank_access(cpu: &Cpu, addr: u32, cycle: u64) -> u64 {
+    use std::sync::atomic::Ordering;
+    let banks = cpu.tcdm_banks;
+    let offset = addr.wrapping_sub(cpu.tcdm_start);
+    if banks.num == 0 || offset >= cpu.tcdm_end.wrapping_sub(cpu.tcdm_start) {
+        return 0;
+    }
+    let bank = ((offset >> banks.shift) % banks.num) as u64;
+    let mut c = cycle;
+    while c - cycle < TCDM_BANK_WINDOW {
+        let slot = banks
+            .slots
+            .get_unchecked((bank * TCDM_BANK_WINDOW + c % TCDM_BANK_WINDOW) as usize);
+        let prev = slot.load(Ordering::Relaxed);
+        if prev == c + 1 {
+            // Taken in this cycle; retry in the next one.
+            c += 1;
+        } else if prev > c + 1
+            || slot
+                .compare_exchange(prev, c + 1, Ordering::Relaxed, Ordering::Relaxed)
+                .is_ok()
+        {
+            // A claim for a later cycle in the same slot is kept over
+            // this one, which then goes unrecorded.
+            break;
+        }
+    }
+    c - cycle
+}
+
+/// Fetch the instruction at `addr` through the instruction caches.
+///
+/// Returns the number of cycles the fetch stalls. Fetches from the line of
+/// the previous fetch always hit in the L0.
+#[no_mangle]
+#[inline(always)]
+pub unsafe fn banshee_icache_fetch(cpu: &mut Cpu, addr: u32) -> u64 {
+    let line = (addr >> cpu.icache.shift) + 1;
+    if line == cpu.state.icache.line {
+        cpu.state.icache.l0_hits += 1;
+        return 0;
+    }
+    cpu.state.icache.line = line;
+    banshee_icache_lookup(cpu, line)
+}
+
+/// Look up `line` (plus one) in the L0 and then the L1, and refill them on a
+/// miss.
+#[no_mangle]
+#[inline(never)]
+pub unsafe fn banshee_icache_lookup(cpu: &mut Cpu, line: u32) -> u64 {
+    use std::sync::atomic::Ordering;
+    let icache = cpu.icache;
+    let l0 = &mut cpu.state.icache.l0;
+
+    // The L0 is fully associative and keeps its lines in LRU order.
+    let num = icache.l0_lines as usize;
+    let mut i = 0;
+    while i < num && *l0.get_unchecked(i) != line {
+        i += 1;
+    }
+    let hit = i < num;
+    let last = if hit { i } else { num.saturating_sub(1) };
+    for j in (1..=last).rev() {
+        *l0.get_unchecked_mut(j) = *l0.get_unchecked(j - 1);
+    }
+    if num > 0 {
+        *l0.get_unchecked_mut(0) = line;
+    }
+    if hit {
+        cpu.state.icache.l0_hits += 1;
+        return 0;
+    }
+    cpu.state.icache.l0_misses += 1;
+
+    // The L1 is shared by the cluster and replaces its ways round robin.
+    let set = (line - 1) & icache.set_mask;
+    let ways = icache.ways;
+    let base = (set * ways) as usize;
+    let mut stall = icache.l1_latency;
+    let mut way = 0;
+    while way < ways
+        && icache
+            .tags
+            .get_unchecked(base + way as usize)
+            .load(Ordering::Relaxed)
+            != line
+    {
+        way += 1;
+    }
+    if way < ways {
+        cpu.state.icache.l1_hits += 1;
+        *cpu.state.perf.get_unchecked_mut(PERF_ICACHE_HIT) += 1;
+    } else {
+        let victim = icache.victims.get_unchecked(set as usize);
+        let way = victim.load(Ordering::Relaxed);
+        victim.store(if way + 1 < ways { way + 1 } else { 0 }, Ordering::Relaxed);
+        icache
+            .tags
+            .get_unchecked(base + way as usize)
+            .store(line, Ordering::Relaxed);
+        cpu.state.icache.l1_misses += 1;
+        *cpu.state.perf.get_unchecked_mut(PERF_ICACHE_MISS) += 1;
+        stall += icache.refill_latency;
+    }
+    *cpu.state.perf.get_unchecked_mut(PERF_ICACHE_STALL) += stall;
+    stall
+}
+
 /// Deassert the accessed flag at the end of instruction parsing
 #[no_mangle]
+#[inline(always)]
 pub unsafe fn banshee_ssr_eoi(ssr: &mut SsrState) {
     ssr.accessed = false;
     ssr.ptr = ssr.ptr_next;
@@ -272,47 +446,97 @@ pub unsafe fn banshee_dma_rep(dma: &mut DmaState, reps: u32) {
 }
 
 /// Implementation of the `dm.strt` and `dm.strti` instructions.
+///
+/// The data is copied immediately. With the timing model enabled, the
+/// transfer only completes once the issuing hart's cycle counter passes its
+/// modeled completion cycle: transfers occupy the data channel in order at
+/// `bandwidth` bytes per cycle, after `latency` cycles of setup that overlap
+/// with earlier transfers. Issuing stalls the hart while `outstanding`
+/// transfers are in flight.
 #[no_mangle]
 pub unsafe fn banshee_dma_strt(dma: &mut DmaState, cpu: &mut Cpu, size: u32, flags: u32) -> u32 {
     extern "C" {
-        fn banshee_load(cpu: &mut Cpu, addr: u32, size: u8) -> u32;
-        fn banshee_store(cpu: &mut Cpu, addr: u32, value: u32, mask: u32, size: u8);
+        fn banshee_dma_copy(
+            cpu: &mut Cpu,
+            dst: u32,
+            src: u32,
+            size: u32,
+            dst_stride: u32,
+            src_stride: u32,
+            reps: u32,
+        );
     }
 
-    let id = dma.done_id;
-    dma.done_id += 1;
+    let id = dma.next_id;
+    dma.next_id += 1;
     dma.size = size;
 
-    // assert_eq!(
-    //     size % 4,
-    //     0,
-    //     "DMA transfer size must be a multiple of 4B for now"
-    // );
-    let num_beats = size / 4;
     let enable_2d = (flags & (1 << 1)) != 0;
     let steps = if enable_2d { dma.reps } else { 1 };
 
-    for i in 0..steps as u64 {
-        let src = dma.src + i * dma.src_stride as u64;
-        let dst = dma.dst + i * dma.dst_stride as u64;
-        // assert_eq!(src % 4, 0, "DMA src transfer block must be 4-byte-aligned");
-        // assert_eq!(dst % 4, 0, "DMA dst transfer block must be 4-byte-aligned");
-        for j in 0..num_beats as u64 {
-            let tmp = banshee_load(cpu, (src + j * 4) as u32, 2);
-            banshee_store(cpu, (dst + j * 4) as u32, tmp, u32::max_value(), 2);
-        }
+    banshee_dma_copy(
+        cpu,
+        dma.dst as u32,
+        dma.src as u32,
+        size,
+        dma.dst_stride,
+        dma.src_stride,
+        steps,
+    );
+
+    let bytes = size as u64 * steps as u64;
+    for &event in &[PERF_DMA_AW_BW, PERF_DMA_AR_BW, PERF_DMA_R_BW, PERF_DMA_W_BW] {
+        *cpu.state.perf.get_unchecked_mut(event) += bytes;
     }
 
+    if dma.bandwidth == 0 {
+        dma.done_id = dma.next_id;
+        return id;
+    }
+
+    // Stall until the oldest transfer completes if too many are in flight.
+    let mut cycle = cpu.state.cycle;
+    banshee_dma_retire(dma, cycle);
+    if dma.num_pending >= dma.outstanding {
+        cycle = std::cmp::max(cycle, *dma.pending.get_unchecked(dma.pending_head as usize));
+        cpu.state.cycle = cycle;
+        banshee_dma_retire(dma, cycle);
+    }
+
+    // Every row takes at least one beat on the data channel.
+    let beats = (size as u64 + dma.bandwidth as u64 - 1)
+        .checked_div(dma.bandwidth as u64)
+        .unwrap_or(0);
+    let beats = std::cmp::max(beats, 1) * std::cmp::max(steps, 1) as u64;
+    let start = std::cmp::max(cycle + dma.latency, dma.free_cycle);
+    dma.free_cycle = start + beats;
+
+    let slot = (dma.pending_head + dma.num_pending) as usize % DMA_MAX_OUTSTANDING;
+    *dma.pending.get_unchecked_mut(slot) = dma.free_cycle;
+    dma.num_pending += 1;
+
     id
 }
 
+/// Retire the transfers that completed by `cycle`.
+#[inline(always)]
+unsafe fn banshee_dma_retire(dma: &mut DmaState, cycle: u64) {
+    while dma.num_pending != 0 && *dma.pending.get_unchecked(dma.pending_head as usize) <= cycle {
+        dma.pending_head = (dma.pending_head + 1) % DMA_MAX_OUTSTANDING as u32;
+        dma.num_pending -= 1;
+        dma.done_id += 1;
+    }
+}
+
 /// Implementation of the `dm.stat` and `dm.stati` instructions.
 #[no_mangle]
-pub unsafe fn banshee_dma_stat(dma: &DmaState, addr: u32) -> u32 {
+pub unsafe fn banshee_dma_stat(dma: &mut DmaState, cpu: &Cpu, addr: u32) -> u32 {
+    banshee_dma_retire(dma, cpu.state.cycle);
     match addr & 0x3 {
-        0 => dma.done_id,     // completed_id
-        1 => dma.done_id + 1, // next_id
-        2 | 3 => 0,           // busy
+        0 => dma.done_id,                                 // completed_id
+        1 => dma.next_id,                                 // next_id
+        2 => (dma.num_pending != 0) as u32,               // busy
+        3 => (dma.num_pending >= dma.outstanding) as u32, // would_block
         _ => 0,
     }
 }
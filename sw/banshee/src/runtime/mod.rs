@@ -27,6 +27,7 @@
 //! - Binary translation emits code into the module.
 //! - The module is linked with the LLVM IR obtained from `jit.rs`.
 
+use crate::checkpoint::snapshot_fields;
 use crate::engine::Engine;
 use itertools::Itertools;
 
@@ -108,6 +109,142 @@ impl std::fmt::Debug for SsrState {
     }
 }
 
+impl DmaState {
+    /// Create a DMA backend with the timing model in `config`.
+    ///
+    /// Without `timed`, transfers complete as soon as they are issued.
+    pub fn new(config: &crate::configuration::Dma, timed: bool) -> Self {
+        Self {
+            bandwidth: if timed { config.bandwidth } else { 0 },
+            outstanding: config.outstanding.max(1).min(DMA_MAX_OUTSTANDING as u32),
+            latency: config.latency,
+            ..Default::default()
+        }
+    }
+}
+
+// The architectural state of a hart, as saved in checkpoints.
+snapshot_fields!(CpuState {
+    regs,
+    regs_cycle,
+    fregs,
+    fregs_cycle,
+    cas_value,
+    pc,
+    cycle,
+    instret,
+    ssrs,
+    ssr_enable,
+    fpmode,
+    dma,
+    wfi,
+    irq,
+    perf,
+    profile_next,
+    icache,
+});
+
+snapshot_fields!(SsrState {
+    index,
+    bound,
+    stride,
+    idx_shift,
+    idx_base,
+    idx_size,
+    idx_ptr,
+    ptr,
+    ptr_next,
+    repeat_count,
+    repeat_bound,
+    write,
+    dims,
+    done,
+    indir,
+    accessed,
+});
+
+snapshot_fields!(IcacheState {
+    line,
+    l0,
+    l0_hits,
+    l0_misses,
+    l1_hits,
+    l1_misses,
+});
+
+snapshot_fields!(DmaState {
+    src,
+    dst,
+    src_stride,
+    dst_stride,
+    reps,
+    size,
+    done_id,
+    next_id,
+    bandwidth,
+    outstanding,
+    latency,
+    free_cycle,
+    pending,
+    pending_head,
+    num_pending,
+});
+
+snapshot_fields!(IrqState {
+    sample_ctr,
+    mstatus,
+    mie,
+    mip,
+    mtvec,
+    mepc,
+    mcause,
+});
+
+impl TcdmBanks {
+    /// Create the banks of a TCDM as described in `config`.
+    ///
+    /// Without `timed`, there are no cycles to stall, and conflicts are not
+    /// modelled.
+    pub fn new(config: &crate::configuration::Memory, timed: bool) -> Self {
+        let num = if timed { config.banks } else { 0 };
+        Self {
+            num,
+            shift: config.bank_width.max(1).trailing_zeros(),
+            slots: (0..num as u64 * TCDM_BANK_WINDOW)
+                .map(|_| AtomicU64::new(0))
+                .collect(),
+        }
+    }
+}
+
+impl Icache {
+    /// Create the L1 instruction cache of a cluster as described in `config`.
+    ///
+    /// Without `timed`, fetches take no cycles, and are not modelled.
+    pub fn new(config: &crate::configuration::Icache, timed: bool) -> Self {
+        let enabled = timed && config.enabled();
+        let sets = if enabled {
+            config.sets.next_power_of_two()
+        } else {
+            0
+        };
+        Self {
+            shift: if enabled {
+                config.line_size.next_power_of_two().trailing_zeros()
+            } else {
+                0
+            },
+            l0_lines: config.l0_lines.min(ICACHE_L0_MAX_LINES as u32),
+            set_mask: sets.saturating_sub(1),
+            ways: config.ways,
+            l1_latency: config.l1_latency,
+            refill_latency: config.refill_latency,
+            tags: (0..sets * config.ways).map(|_| AtomicU32::new(0)).collect(),
+            victims: (0..sets).map(|_| AtomicU32::new(0)).collect(),
+        }
+    }
+}
+
 impl std::fmt::Debug for DmaState {
     fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
         f.debug_struct("DmaState")
@@ -118,6 +255,9 @@ impl std::fmt::Debug for DmaState {
             .field("reps", &self.reps)
             .field("size", &self.size)
             .field("done_id", &self.done_id)
+            .field("next_id", &self.next_id)
+            .field("free_cycle", &self.free_cycle)
+            .field("num_pending", &self.num_pending)
             .finish()
     }
 }
@@ -0,0 +1,359 @@
+// Copyright 2020 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+//! Instruction traces
+//!
+//! Traces are either printed as text lines, or written in a compact binary
+//! format to one file per hart and decoded into the same text lines later by
+//! `banshee-trace`. This module is shared between the two binaries.
+//!
+//! A binary trace file starts with the 8-byte `MAGIC`, followed by one record
+//! per retired instruction. All values are little-endian. A record is a
+//! fixed-size header
+//!
+//! | Bytes  | Field               |
+//! |--------|---------------------|
+//! | 0..8   | cycle               |
+//! | 8..16  | instret             |
+//! | 16..20 | pc                  |
+//! | 20..24 | instruction word    |
+//! | 24..26 | hart ID             |
+//! | 26     | number of accesses  |
+//! | 27..32 | reserved            |
+//!
+//! followed by one fixed-size entry per access
+//!
+//! | Bytes  | Field                              |
+//! |--------|------------------------------------|
+//! | 0..2   | `TraceAccess` (tag and register)   |
+//! | 2..8   | reserved                           |
+//! | 8..16  | data                               |
+
+use std::convert::TryInto;
+use std::io::{self, Read, Write};
+
+/// Identifies a binary trace file and its format version.
+pub const MAGIC: [u8; 8] = *b"BNSHTRC1";
+
+/// Size of a record header in bytes.
+const HEADER_SIZE: usize = 32;
+/// Size of an access entry in bytes.
+const ACCESS_SIZE: usize = 16;
+/// Number of `TraceAccess` variants; see `TraceAccess::from_raw`.
+const NUM_ACCESS_KINDS: u8 = 19;
+
+/// A single register or memory access as recorded in a trace.
+#[derive(Debug, Clone, Copy)]
+#[repr(C, u8)]
+pub enum TraceAccess {
+    ReadMem,
+    ReadReg(u8),
+    ReadFReg(u8),
+    Readf8Reg(u8),
+    Readf16Reg(u8),
+    ReadF32Reg(u8),
+    Readvf64sReg(u8),
+    Readvf64hReg(u8),
+    Readvf64bReg(u8),
+    WriteMem,
+    WriteReg(u8),
+    WriteFReg(u8),
+    Writef8Reg(u8),
+    Writef16Reg(u8),
+    WriteF32Reg(u8),
+    Writevf64sReg(u8),
+    Writevf64hReg(u8),
+    Writevf64bReg(u8),
+    RMWMem,
+}
+
+impl TraceAccess {
+    /// The in-memory representation: the variant tag and register index.
+    fn to_raw(self) -> [u8; 2] {
+        use TraceAccess::*;
+        // SAFETY: `repr(C, u8)` places the tag in the first byte.
+        let tag = unsafe { *(&self as *const Self as *const u8) };
+        let reg = match self {
+            ReadReg(x) | ReadFReg(x) | Readf8Reg(x) | Readf16Reg(x) | ReadF32Reg(x)
+            | Readvf64sReg(x) | Readvf64hReg(x) | Readvf64bReg(x) | WriteReg(x) | WriteFReg(x)
+            | Writef8Reg(x) | Writef16Reg(x) | WriteF32Reg(x) | Writevf64sReg(x)
+            | Writevf64hReg(x) | Writevf64bReg(x) => x,
+            ReadMem | WriteMem | RMWMem => 0,
+        };
+        [tag, reg]
+    }
+
+    /// The float register accessed, if any.
+    pub fn freg(self) -> Option<u8> {
+        use TraceAccess::*;
+        match self {
+            ReadFReg(x) | Readf8Reg(x) | Readf16Reg(x) | ReadF32Reg(x) | Readvf64sReg(x)
+            | Readvf64hReg(x) | Readvf64bReg(x) | WriteFReg(x) | Writef8Reg(x) | Writef16Reg(x)
+            | WriteF32Reg(x) | Writevf64sReg(x) | Writevf64hReg(x) | Writevf64bReg(x) => Some(x),
+            _ => None,
+        }
+    }
+
+    /// Inverse of `to_raw`, rejecting unknown tags.
+    fn from_raw(raw: [u8; 2]) -> Option<Self> {
+        if raw[0] < NUM_ACCESS_KINDS {
+            // SAFETY: The tag is valid, and every payload value is valid.
+            // Variants without payload ignore the second byte.
+            Some(unsafe { std::mem::transmute(raw) })
+        } else {
+            None
+        }
+    }
+}
+
+/// The retired instruction described by a trace record.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord)]
+pub struct TraceHeader {
+    pub cycle: u64,
+    pub instret: u64,
+    pub hartid: u16,
+    pub pc: u32,
+    pub inst: u32,
+}
+
+/// Convert a small float to `f32` for printing.
+fn cvt_to_s(bits: u64, op: flexfloat::FfOpCvt) -> f32 {
+    f32::from_bits(unsafe { flexfloat::ff_instruction_cvt_to_s(bits, op, false, false) } as u32)
+}
+
+/// Format a single access as in the text trace.
+pub fn format_access(access: TraceAccess, data: u64) -> String {
+    match access {
+        TraceAccess::ReadMem => format!("RA:{:08x}", data as u32),
+        TraceAccess::WriteMem => format!("WA:{:08x}", data as u32),
+        TraceAccess::RMWMem => format!("AMO:{:08x}", data as u32),
+        TraceAccess::ReadReg(x) => format!("x{}:{:08x}", x, data as u32),
+        TraceAccess::WriteReg(x) => format!("x{}={:08x}", x, data as u32),
+        TraceAccess::ReadFReg(x) => format!("f{:02}:{:>16.6}", x, f64::from_bits(data)),
+        TraceAccess::WriteFReg(x) => format!("f{:02}={:>16.6}", x, f64::from_bits(data)),
+        TraceAccess::ReadF32Reg(x) => {
+            format!("f{:02}:{:>12.4}", x, f32::from_bits(data as u32))
+        }
+        TraceAccess::WriteF32Reg(x) => {
+            format!("f{:02}={:>12.4}", x, f32::from_bits(data as u32))
+        }
+        TraceAccess::Readf8Reg(x) => format!(
+            "f{:02}:[{:>5.3}]",
+            x,
+            cvt_to_s(
+                (data & 0x0000_0000_0000_00ff) >> 0,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            )
+        ),
+        TraceAccess::Writef8Reg(x) => format!(
+            "f{:02}=[{:>5.3}]",
+            x,
+            cvt_to_s(
+                (data & 0x0000_0000_0000_00ff) >> 0,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+        ),
+        TraceAccess::Readf16Reg(x) => format!(
+            "f{:02}=[{:>8.4}]",
+            x,
+            cvt_to_s(
+                (data & 0x0000_0000_0000_ffff) >> 0,
+                flexfloat::FfOpCvt::Fcvt16f2f
+            ),
+        ),
+        TraceAccess::Writef16Reg(x) => format!(
+            "f{:02}=[{:>5.3}]",
+            x,
+            cvt_to_s(
+                (data & 0x0000_0000_0000_00ff) >> 0,
+                flexfloat::FfOpCvt::Fcvt16f2f
+            ),
+        ),
+        TraceAccess::Readvf64sReg(x) => format!(
+            "f{:02}:[{:>12.4}, {:>12.4}]",
+            x,
+            f32::from_bits((data >> 32) as u32),
+            f32::from_bits((data) as u32)
+        ),
+        TraceAccess::Writevf64sReg(x) => format!(
+            "f{:02}=[{:>12.4}, {:>12.4}]",
+            x,
+            f32::from_bits((data >> 32) as u32),
+            f32::from_bits((data) as u32)
+        ),
+        TraceAccess::Readvf64hReg(x) => format!(
+            "f{:02}:[{:>8.4}, {:>8.4}, {:>8.4}, {:>8.4}]",
+            x,
+            cvt_to_s(
+                (data & 0xffff_0000_0000_0000) >> 48,
+                flexfloat::FfOpCvt::Fcvt16f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_ffff_0000_0000) >> 32,
+                flexfloat::FfOpCvt::Fcvt16f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_ffff_0000) >> 16,
+                flexfloat::FfOpCvt::Fcvt16f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_0000_ffff) >> 0,
+                flexfloat::FfOpCvt::Fcvt16f2f
+            ),
+        ),
+        TraceAccess::Writevf64hReg(x) => format!(
+            "f{:02}=[{:>8.4}, {:>8.4}, {:>8.4}, {:>8.4}]",
+            x,
+            cvt_to_s(
+                (data & 0xffff_0000_0000_0000) >> 48,
+                flexfloat::FfOpCvt::Fcvt16f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_ffff_0000_0000) >> 32,
+                flexfloat::FfOpCvt::Fcvt16f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_ffff_0000) >> 16,
+                flexfloat::FfOpCvt::Fcvt16f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_0000_ffff) >> 0,
+                flexfloat::FfOpCvt::Fcvt16f2f
+            ),
+        ),
+        TraceAccess::Readvf64bReg(x) => format!(
+            "f{:02}:[{:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}]",
+            x,
+            cvt_to_s(
+                (data & 0xff00_0000_0000_0000) >> 56,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x00ff_0000_0000_0000) >> 48,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_ff00_0000_0000) >> 40,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_00ff_0000_0000) >> 32,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_ff00_0000) >> 24,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_00ff_0000) >> 16,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_0000_ff00) >> 8,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_0000_00ff) >> 0,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+        ),
+        TraceAccess::Writevf64bReg(x) => format!(
+            "f{:02}=[{:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}, {:>5.3}]",
+            x,
+            cvt_to_s(
+                (data & 0xff00_0000_0000_0000) >> 56,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x00ff_0000_0000_0000) >> 48,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_ff00_0000_0000) >> 40,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_00ff_0000_0000) >> 32,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_ff00_0000) >> 24,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_00ff_0000) >> 16,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_0000_ff00) >> 8,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+            cvt_to_s(
+                (data & 0x0000_0000_0000_00ff) >> 0,
+                flexfloat::FfOpCvt::Fcvt8f2f
+            ),
+        ),
+    }
+}
+
+/// Format a trace line from the instruction and its formatted accesses.
+pub fn format_line(header: &TraceHeader, args: &str) -> String {
+    format!(
+        "{:08} {:08} {:04} {:08x}  {:38}  # DASM({:08x})",
+        header.cycle, header.instret, header.hartid, header.pc, args, header.inst
+    )
+}
+
+/// Append a record to a binary trace.
+pub fn write_record(
+    w: &mut impl Write,
+    header: &TraceHeader,
+    accesses: &[TraceAccess],
+    data: &[u64],
+) -> io::Result<()> {
+    let mut buf = [0u8; HEADER_SIZE];
+    buf[0..8].copy_from_slice(&header.cycle.to_le_bytes());
+    buf[8..16].copy_from_slice(&header.instret.to_le_bytes());
+    buf[16..20].copy_from_slice(&header.pc.to_le_bytes());
+    buf[20..24].copy_from_slice(&header.inst.to_le_bytes());
+    buf[24..26].copy_from_slice(&header.hartid.to_le_bytes());
+    buf[26] = accesses.len() as u8;
+    w.write_all(&buf)?;
+    for (&access, &data) in accesses.iter().zip(data) {
+        let mut buf = [0u8; ACCESS_SIZE];
+        buf[0..2].copy_from_slice(&access.to_raw());
+        buf[8..16].copy_from_slice(&data.to_le_bytes());
+        w.write_all(&buf)?;
+    }
+    Ok(())
+}
+
+/// Read the next record from a binary trace, or `None` at the end.
+pub fn read_record(
+    r: &mut impl Read,
+) -> io::Result<Option<(TraceHeader, Vec<(TraceAccess, u64)>)>> {
+    let mut buf = [0u8; HEADER_SIZE];
+    match r.read_exact(&mut buf) {
+        Err(e) if e.kind() == io::ErrorKind::UnexpectedEof => return Ok(None),
+        x => x?,
+    }
+    let u64_at = |b: &[u8], i: usize| u64::from_le_bytes(b[i..i + 8].try_into().unwrap());
+    let u32_at = |b: &[u8], i: usize| u32::from_le_bytes(b[i..i + 4].try_into().unwrap());
+    let header = TraceHeader {
+        cycle: u64_at(&buf, 0),
+        instret: u64_at(&buf, 8),
+        pc: u32_at(&buf, 16),
+        inst: u32_at(&buf, 20),
+        hartid: u16::from_le_bytes([buf[24], buf[25]]),
+    };
+    let mut accesses = Vec::with_capacity(buf[26] as usize);
+    for _ in 0..buf[26] {
+        let mut buf = [0u8; ACCESS_SIZE];
+        r.read_exact(&mut buf)?;
+        let access = TraceAccess::from_raw([buf[0], buf[1]])
+            .ok_or_else(|| io::Error::new(io::ErrorKind::InvalidData, "unknown trace access"))?;
+        accesses.push((access, u64_at(&buf, 8)));
+    }
+    Ok(Some((header, accesses)))
+}
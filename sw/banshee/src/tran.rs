@@ -7,6 +7,7 @@
 use crate::{
     engine::{AtomicOp, Engine, TraceAccess},
     riscv,
+    runtime::{PERF_ISSUE_FPU, PERF_ISSUE_FPU_SEQ, PERF_RETIRED_LOAD},
 };
 use anyhow::{anyhow, bail, Context, Result};
 use llvm_sys::{
@@ -28,6 +29,16 @@ static SSR_BASE: u64 = 0x204800;
 /// Number of arguments the trace maximally shows per instruction.
 const TRACE_BUFFER_LEN: u32 = 8;
 
+/// The minimum size in bytes of the regions translated into separate
+/// functions.
+const REGION_MIN_SIZE: u64 = 8192;
+
+/// The name prefix of the functions holding translated regions.
+pub const REGION_PREFIX: &str = "execute_region_";
+
+/// The value returned by a region when the hart stops executing.
+const REGION_EXIT: u64 = u64::MAX;
+
 /// The length of a sequencer's instruction ring buffer.
 const SEQ_BUFFER_LEN: u8 = 16;
 
@@ -39,6 +50,20 @@ struct SequencerIterators {
     max_rpt_ref: LLVMValueRef,
 }
 
+/// The values and blocks of `execute_binary` needed to dispatch to regions.
+struct Dispatch {
+    builder: LLVMBuilderRef,
+    func: LLVMValueRef,
+    state_ptr: LLVMValueRef,
+    /// The next address to execute.
+    target: LLVMValueRef,
+    /// The address of the jump to `target`.
+    addr: LLVMValueRef,
+    dispatch_bb: LLVMBasicBlockRef,
+    fail_bb: LLVMBasicBlockRef,
+    exit_bb: LLVMBasicBlockRef,
+}
+
 /// The sequencer's context during section-level translation.
 struct SequencerContext {
     /// Whether the sequencer is currently buffering instructions
@@ -140,8 +165,8 @@ pub struct ElfTranslator<'a> {
     pub target_addrs: BTreeSet<u64>,
     /// Symbol name hints.
     pub symbol_hints: HashMap<u64, String>,
-    /// Basic blocks for each instruction address.
-    pub inst_bbs: HashMap<u64, LLVMBasicBlockRef>,
+    /// The addresses of all instructions in the binary.
+    pub inst_addrs: BTreeSet<u64>,
     /// Generate instruction tracing code.
     pub trace: bool,
     /// Generate instruction tracing code.
@@ -196,8 +221,14 @@ impl<'a> ElfTranslator<'a> {
             );
             (di_builder, di_cu, di_file)
         };
-        let tcdm_ext_range: Vec<_> = engine.config.memory[cluster_id]
-            .ext_tcdm
+        // External TCDM windows differ across clusters, so code shared by all
+        // clusters leaves them to `banshee_load` and `banshee_store`.
+        let ext_tcdm: &[_] = if engine.shared_jit {
+            &[]
+        } else {
+            &engine.config.memory[cluster_id].ext_tcdm
+        };
+        let tcdm_ext_range: Vec<_> = ext_tcdm
             .iter()
             .map(|x| {
                 (
@@ -217,7 +248,7 @@ impl<'a> ElfTranslator<'a> {
             di_file,
             target_addrs: Default::default(),
             symbol_hints: Default::default(),
-            inst_bbs: Default::default(),
+            inst_addrs: Default::default(),
             trace: engine.trace,
             latency: engine.latency,
             tcdm_start: engine.config.memory[cluster_id].tcdm.start,
@@ -247,14 +278,6 @@ impl<'a> ElfTranslator<'a> {
             .map(move |(i, raw)| (section.shdr.addr + i as u64 * 4, riscv::parse(raw)))
     }
 
-    /// Get an iterator over the `.symtab` sections.
-    pub fn symtab_sections(&self) -> impl Iterator<Item = &'a elf::Section> + '_ {
-        self.elf
-            .sections
-            .iter()
-            .filter(|section| section.shdr.shtype == elf::types::SHT_SYMTAB)
-    }
-
     /// Get an iterator over all instructions in the binary.
     pub fn all_instructions(&self) -> impl Iterator<Item = (u64, riscv::Format)> + '_ {
         self.sections().flat_map(move |s| self.instructions(s))
@@ -275,20 +298,10 @@ impl<'a> ElfTranslator<'a> {
         }
 
         // Ensure that we can jump to the beginning of symbols.
-        let symbols = self
-            .symtab_sections()
-            .flat_map(|section| self.elf.get_symbols(section))
-            .fold(vec![], |a, mut b| {
-                b.extend(a);
-                b
-            });
-        trace!("Loaded {} symbols", symbols.len());
-        for sym in symbols {
-            if sym.symtype == elf::types::STT_FUNC {
-                debug!("Found symbol 0x{:x}: {}", sym.value, sym.name);
-                target_addrs.insert(sym.value);
-                symbol_hints.insert(sym.value, sym.name);
-            }
+        for sym in function_symbols(self.elf) {
+            debug!("Found symbol 0x{:x}: {}", sym.value, sym.name);
+            target_addrs.insert(sym.value);
+            symbol_hints.insert(sym.value, sym.name);
         }
 
         // Estimate target addresses.
@@ -348,6 +361,34 @@ impl<'a> ElfTranslator<'a> {
         self.symbol_hints = symbol_hints;
     }
 
+    /// Split the executable sections into the regions which are translated
+    /// into separate functions.
+    ///
+    /// Regions start at function symbols and span at least
+    /// `REGION_MIN_SIZE` bytes, such that most calls and all loops stay
+    /// within a region, while large binaries still split into enough
+    /// functions to be optimized in parallel.
+    pub fn regions(&self) -> Vec<(&'a elf::Section, u64, u64)> {
+        let symbols: BTreeSet<u64> = self.symbol_hints.keys().cloned().collect();
+        let mut regions = vec![];
+        for section in self.sections() {
+            let start = section.shdr.addr;
+            let end = section.shdr.addr + section.shdr.size;
+            if start == end {
+                continue;
+            }
+            let mut region_start = start;
+            for &addr in symbols.range(start + 1..end) {
+                if addr - region_start >= REGION_MIN_SIZE {
+                    regions.push((section, region_start, addr));
+                    region_start = addr;
+                }
+            }
+            regions.push((section, region_start, end));
+        }
+        regions
+    }
+
     /// Translate the binary.
     pub fn translate(&mut self) -> Result<()> {
         unsafe { self.translate_inner() }
@@ -365,30 +406,70 @@ impl<'a> ElfTranslator<'a> {
 
         let state_ptr_type = LLVMPointerType(state_type, 0u32);
 
-        // Emit the function which will run the binary.
-        let func_name = format!("execute_binary\0");
-        let func_type = LLVMFunctionType(LLVMVoidType(), [state_ptr_type].as_mut_ptr(), 1, 0);
-        let func = LLVMAddFunction(
-            self.engine.modules[self.cluster_id],
-            func_name.as_ptr() as *const _,
-            func_type,
+        // Gather the set of executable addresses.
+        self.inst_addrs = self.all_instructions().map(|(addr, _)| addr).collect();
+        if !self.inst_addrs.contains(&self.elf.ehdr.entry) {
+            error!("No instruction at entry point 0x{:x}", self.elf.ehdr.entry);
+        }
+
+        // Declare a function for every region. It takes the address to start
+        // at and the address of the jump that led there.
+        let regions = self.regions();
+        let region_type = LLVMFunctionType(
+            LLVMInt64Type(),
+            [state_ptr_type, LLVMInt32Type(), LLVMInt32Type()].as_mut_ptr(),
+            3,
+            0,
         );
-        let state_ptr = LLVMGetParam(func, 0);
+        let region_funcs: Vec<_> = regions
+            .iter()
+            .map(|&(_, start, _)| {
+                let name = format!("{}{:x}\0", REGION_PREFIX, start);
+                LLVMAddFunction(
+                    self.engine.modules[self.cluster_id],
+                    name.as_ptr() as *const _,
+                    region_type,
+                )
+            })
+            .collect();
+
+        // Emit the function which will run the binary.
+        self.emit_dispatcher(builder, state_ptr_type, &regions, &region_funcs);
 
-        // Emit the subprogram debug information for this function.
-        // let di_builder = LLVMCreateDIBuilder(self.engine.module);
+        // Emit the instructions for each region.
+        let mut inst_index = 0;
+        for (&(section, start, end), &func) in regions.iter().zip(&region_funcs) {
+            debug!(
+                "Translating section `{}` from 0x{:x} to 0x{:x}",
+                section.shdr.name, start, end
+            );
+            self.emit_region(builder, func, section, start, end, &mut inst_index)?;
+        }
+
+        // Clean up.
+        LLVMDIBuilderFinalize(self.di_builder);
+        LLVMDisposeBuilder(builder);
+        Ok(())
+    }
+
+    /// Emit the subprogram debug information for a function, and point the
+    /// builder's debug location at it.
+    unsafe fn emit_subprogram(
+        &self,
+        builder: LLVMBuilderRef,
+        func: LLVMValueRef,
+        name: &str,
+    ) -> LLVMMetadataRef {
         let di_builder = self.di_builder;
-        let di_name = "execute_binary";
-        let di_linkage_name = "execute_binary";
         let di_scope = LLVMDIBuilderCreateFunction(
-            di_builder,                           // Builder
-            self.di_file,                         // Scope
-            di_name.as_ptr() as *const _,         // Name
-            di_name.len(),                        // NameLen
-            di_linkage_name.as_ptr() as *const _, // LinkageName
-            di_linkage_name.len(),                // LinkageNameLen
-            self.di_file,                         // File
-            0,                                    // LineNo
+            di_builder,                // Builder
+            self.di_file,              // Scope
+            name.as_ptr() as *const _, // Name
+            name.len(),                // NameLen
+            name.as_ptr() as *const _, // LinkageName
+            name.len(),                // LinkageNameLen
+            self.di_file,              // File
+            0,                         // LineNo
             LLVMDIBuilderCreateSubroutineType(
                 di_builder,
                 self.di_file,
@@ -396,11 +477,11 @@ impl<'a> ElfTranslator<'a> {
                 0,
                 LLVMDIFlagZero,
             ), // Ty
-            0,                                    // IsLocalToUnit
-            1,                                    // IsDefinition
-            0,                                    // ScopeLine
-            LLVMDIFlagPrototyped,                 // Flags
-            0,                                    // IsOptimized
+            0,                         // IsLocalToUnit
+            1,                         // IsDefinition
+            0,                         // ScopeLine
+            LLVMDIFlagPrototyped,      // Flags
+            0,                         // IsOptimized
         );
         LLVMSetSubprogram(func, di_scope);
         let di_loc = LLVMDIBuilderCreateDebugLocation(
@@ -411,6 +492,191 @@ impl<'a> ElfTranslator<'a> {
             std::ptr::null_mut(), // InlinedAt
         );
         LLVMSetCurrentDebugLocation2(builder, di_loc);
+        di_scope
+    }
+
+    /// Emit `execute_binary`, which calls the function of the region holding
+    /// the next address until one of them exits.
+    unsafe fn emit_dispatcher(
+        &self,
+        builder: LLVMBuilderRef,
+        state_ptr_type: LLVMTypeRef,
+        regions: &[(&elf::Section, u64, u64)],
+        region_funcs: &[LLVMValueRef],
+    ) {
+        let func_name = format!("execute_binary\0");
+        let func_type = LLVMFunctionType(LLVMVoidType(), [state_ptr_type].as_mut_ptr(), 1, 0);
+        let func = LLVMAddFunction(
+            self.engine.modules[self.cluster_id],
+            func_name.as_ptr() as *const _,
+            func_type,
+        );
+        self.emit_subprogram(builder, func, "execute_binary");
+
+        let append = |name: &[u8]| {
+            LLVMAppendBasicBlockInContext(self.engine.context, func, name.as_ptr() as *const _)
+        };
+        let entry_bb = append(b"entry\0");
+        let dispatch_bb = append(b"dispatch\0");
+        let fail_bb = append(b"indirect_fail\0");
+        let exit_bb = append(b"exit\0");
+        // Start at the hart's PC, which is the entry point unless resuming from
+        // a checkpoint.
+        LLVMPositionBuilderAtEnd(builder, entry_bb);
+        let pc_ptr = LLVMBuildCall(
+            builder,
+            self.lookup_func("banshee_pc_ptr"),
+            [LLVMGetParam(func, 0)].as_mut_ptr(),
+            1,
+            NONAME,
+        );
+        let start = LLVMBuildZExt(
+            builder,
+            LLVMBuildLoad(builder, pc_ptr, NONAME),
+            LLVMInt64Type(),
+            NONAME,
+        );
+        LLVMBuildBr(builder, dispatch_bb);
+
+        // The next address to execute in the lower, and the address of the
+        // jump that led there in the upper half.
+        LLVMPositionBuilderAtEnd(builder, dispatch_bb);
+        let next = LLVMBuildPhi(builder, LLVMInt64Type(), b"next\0".as_ptr() as *const _);
+        let target = LLVMBuildTrunc(builder, next, LLVMInt32Type(), NONAME);
+        let addr = LLVMBuildTrunc(
+            builder,
+            LLVMBuildLShr(builder, next, LLVMConstInt(LLVMInt64Type(), 32, 0), NONAME),
+            LLVMInt32Type(),
+            NONAME,
+        );
+        let mut incoming = vec![(start, entry_bb)];
+
+        // Search the region holding the target.
+        let dispatch = Dispatch {
+            builder,
+            func,
+            state_ptr: LLVMGetParam(func, 0),
+            target,
+            addr,
+            dispatch_bb,
+            fail_bb,
+            exit_bb,
+        };
+        let ranges: Vec<_> = regions
+            .iter()
+            .zip(region_funcs)
+            .map(|(&(_, start, end), &func)| (start, end, func))
+            .collect();
+        let search_bb = if ranges.is_empty() {
+            fail_bb
+        } else {
+            self.emit_region_search(&dispatch, &ranges, &mut incoming)
+        };
+        LLVMPositionBuilderAtEnd(builder, dispatch_bb);
+        LLVMBuildBr(builder, search_bb);
+        let (mut values, mut bbs): (Vec<_>, Vec<_>) = incoming.into_iter().unzip();
+        LLVMAddIncoming(
+            next,
+            values.as_mut_ptr(),
+            bbs.as_mut_ptr(),
+            values.len() as u32,
+        );
+
+        // Emit the illegal branch code.
+        LLVMPositionBuilderAtEnd(builder, fail_bb);
+        LLVMBuildCall(
+            builder,
+            self.lookup_func("banshee_abort_illegal_branch"),
+            [dispatch.state_ptr, addr, target].as_mut_ptr(),
+            3,
+            NONAME,
+        );
+        LLVMBuildRetVoid(builder);
+
+        LLVMPositionBuilderAtEnd(builder, exit_bb);
+        LLVMBuildRetVoid(builder);
+    }
+
+    /// Emit a binary search for the region holding the dispatched target,
+    /// followed by a call to the region. Returns the first block of the
+    /// search.
+    unsafe fn emit_region_search(
+        &self,
+        dispatch: &Dispatch,
+        ranges: &[(u64, u64, LLVMValueRef)],
+        incoming: &mut Vec<(LLVMValueRef, LLVMBasicBlockRef)>,
+    ) -> LLVMBasicBlockRef {
+        let builder = dispatch.builder;
+        let bb = LLVMAppendBasicBlockInContext(self.engine.context, dispatch.func, NONAME);
+        if let [(start, end, func)] = *ranges {
+            LLVMPositionBuilderAtEnd(builder, bb);
+            let offset = LLVMBuildSub(
+                builder,
+                dispatch.target,
+                LLVMConstInt(LLVMInt32Type(), start, 0),
+                NONAME,
+            );
+            let in_range = LLVMBuildICmp(
+                builder,
+                LLVMIntULT,
+                offset,
+                LLVMConstInt(LLVMInt32Type(), end - start, 0),
+                NONAME,
+            );
+            let call_bb = LLVMAppendBasicBlockInContext(self.engine.context, dispatch.func, NONAME);
+            LLVMBuildCondBr(builder, in_range, call_bb, dispatch.fail_bb);
+            LLVMPositionBuilderAtEnd(builder, call_bb);
+            let next = LLVMBuildCall(
+                builder,
+                func,
+                [dispatch.state_ptr, dispatch.target, dispatch.addr].as_mut_ptr(),
+                3,
+                NONAME,
+            );
+            let is_exit = LLVMBuildICmp(
+                builder,
+                LLVMIntEQ,
+                next,
+                LLVMConstInt(LLVMInt64Type(), REGION_EXIT, 0),
+                NONAME,
+            );
+            LLVMBuildCondBr(builder, is_exit, dispatch.exit_bb, dispatch.dispatch_bb);
+            incoming.push((next, call_bb));
+        } else {
+            let mid = ranges.len() / 2;
+            let lo_bb = self.emit_region_search(dispatch, &ranges[..mid], incoming);
+            let hi_bb = self.emit_region_search(dispatch, &ranges[mid..], incoming);
+            LLVMPositionBuilderAtEnd(builder, bb);
+            let is_lo = LLVMBuildICmp(
+                builder,
+                LLVMIntULT,
+                dispatch.target,
+                LLVMConstInt(LLVMInt32Type(), ranges[mid].0, 0),
+                NONAME,
+            );
+            LLVMBuildCondBr(builder, is_lo, lo_bb, hi_bb);
+        }
+        bb
+    }
+
+    /// Emit the function which executes the region `[start, end)` of a
+    /// section.
+    ///
+    /// The function starts at the address passed to it, and returns the next
+    /// address and the address of the jump to it when execution leaves the
+    /// region, or `REGION_EXIT` when the hart is done.
+    unsafe fn emit_region(
+        &self,
+        builder: LLVMBuilderRef,
+        func: LLVMValueRef,
+        section: &'a elf::Section,
+        start: u64,
+        end: u64,
+        inst_index: &mut u32,
+    ) -> Result<()> {
+        let state_ptr = LLVMGetParam(func, 0);
+        let name = format!("{}{:x}", REGION_PREFIX, start);
+        let di_scope = self.emit_subprogram(builder, func, &name);
 
         // Create the entry block.
         let entry_bb = LLVMAppendBasicBlockInContext(
@@ -457,18 +723,8 @@ impl<'a> ElfTranslator<'a> {
             max_rpt_ref,
         };
 
-        // Gather the set of executable addresses.
-        let inst_addrs: BTreeSet<u64> = self
-            .all_instructions()
-            .map(|(addr, _)| addr)
-            .chain(self.sections().map(|section| section.shdr.addr))
-            .chain(
-                self.sections()
-                    .map(|section| section.shdr.addr + section.shdr.size),
-            )
-            .collect();
-
         // Create a basic block for every instruction address.
+        let inst_addrs: Vec<u64> = self.inst_addrs.range(start..end).cloned().collect();
         let inst_bbs: HashMap<u64, LLVMBasicBlockRef> = inst_addrs
             .iter()
             .map(|&addr| {
@@ -484,9 +740,9 @@ impl<'a> ElfTranslator<'a> {
                 (addr, bb)
             })
             .collect();
-        self.inst_bbs = inst_bbs;
 
-        // Create a block for the fallback indirect jump table.
+        // Create a block for the fallback indirect jump table, which is also
+        // where the region is entered.
         let indirect_target_var = LLVMBuildAlloca(
             builder,
             LLVMInt32Type(),
@@ -497,6 +753,8 @@ impl<'a> ElfTranslator<'a> {
             LLVMInt32Type(),
             b"indirect_addr\0".as_ptr() as *const _,
         );
+        LLVMBuildStore(builder, LLVMGetParam(func, 1), indirect_target_var);
+        LLVMBuildStore(builder, LLVMGetParam(func, 2), indirect_addr_var);
         let indirect_fail_bb = LLVMAppendBasicBlockInContext(
             self.engine.context,
             func,
@@ -507,9 +765,10 @@ impl<'a> ElfTranslator<'a> {
             func,
             b"indirect\0".as_ptr() as *const _,
         );
+        LLVMBuildBr(builder, indirect_bb);
         LLVMPositionBuilderAtEnd(builder, indirect_bb);
 
-        // Emit the switch statement with all branch targets.
+        // Emit the switch statement with all branch targets in the region.
         let indirect_target = LLVMBuildLoad(builder, indirect_target_var, NONAME);
         let sw = LLVMBuildSwitch(
             builder,
@@ -517,82 +776,64 @@ impl<'a> ElfTranslator<'a> {
             indirect_fail_bb,
             inst_addrs.len() as u32,
         );
-        for &addr in &inst_addrs {
+        for addr in &inst_addrs {
             LLVMAddCase(
                 sw,
-                LLVMConstInt(LLVMInt32Type(), addr as u64, 0),
-                self.inst_bbs[&addr],
+                LLVMConstInt(LLVMInt32Type(), *addr as u64, 0),
+                inst_bbs[addr],
             );
         }
 
-        // Emit the illegal branch code.
+        // Targets outside the region go back to the dispatcher; the ones
+        // inside it are illegal branches.
         LLVMPositionBuilderAtEnd(builder, indirect_fail_bb);
         let indirect_addr = LLVMBuildLoad(builder, indirect_addr_var, NONAME);
-        LLVMBuildCall(
+        let in_range = LLVMBuildICmp(
             builder,
-            LLVMGetNamedFunction(
-                self.engine.modules[self.cluster_id],
-                "banshee_abort_illegal_branch\0".as_ptr() as *const _,
+            LLVMIntULT,
+            LLVMBuildSub(
+                builder,
+                indirect_target,
+                LLVMConstInt(LLVMInt32Type(), start, 0),
+                NONAME,
             ),
-            [state_ptr, indirect_addr, indirect_target].as_mut_ptr(),
-            3,
+            LLVMConstInt(LLVMInt32Type(), end - start, 0),
             NONAME,
         );
-        LLVMBuildRetVoid(builder);
-        LLVMPositionBuilderAtEnd(builder, entry_bb);
+        let illegal_bb = LLVMAppendBasicBlockInContext(self.engine.context, func, NONAME);
+        let leave_bb = LLVMAppendBasicBlockInContext(self.engine.context, func, NONAME);
+        LLVMBuildCondBr(builder, in_range, illegal_bb, leave_bb);
 
-        // Emit the branch to the entry symbol.
-        match self.inst_bbs.get(&self.elf.ehdr.entry) {
-            Some(&bb) => {
-                LLVMBuildBr(builder, bb);
-            }
-            None => {
-                error!("No instruction at entry point 0x{:x}", self.elf.ehdr.entry);
-                LLVMBuildBr(builder, entry_bb);
-            }
-        }
-
-        // Emit the instructions for each section.
-        let mut last_section_tran = None;
-        let mut inst_index = 0;
-        for section in self.sections() {
-            debug!("Translating section `{}`", section.shdr.name);
-            let tran = SectionTranslator {
-                elf: self,
-                section,
-                engine: self.engine,
-                di_scope,
-                state_ptr,
-                trace_access_buffer,
-                trace_data_buffer,
-                builder,
-                addr_start: section.shdr.addr,
-                addr_end: section.shdr.addr + section.shdr.size,
-                indirect_target_var,
-                indirect_addr_var,
-                indirect_bb,
-                fseq_iter: &fseq_iter,
-            };
-            tran.emit(&mut inst_index)?;
-            last_section_tran = Some(tran);
-        }
-
-        // Emit escape abort code into all unpopulated instruction locations.
-        for (&addr, &bb) in &self.inst_bbs {
-            if LLVMGetBasicBlockTerminator(bb).is_null() {
-                trace!("Plugging instruction slot hole at 0x{:x}", addr);
-                LLVMPositionBuilderAtEnd(builder, bb);
-                last_section_tran
-                    .as_ref()
-                    .expect("missing section; can't emit escape abort")
-                    .emit_escape_abort(addr);
-            }
-        }
+        let tran = SectionTranslator {
+            elf: self,
+            section,
+            engine: self.engine,
+            func,
+            di_scope,
+            state_ptr,
+            trace_access_buffer,
+            trace_data_buffer,
+            builder,
+            addr_start: start,
+            addr_end: end,
+            inst_bbs,
+            exit_bbs: Default::default(),
+            indirect_target_var,
+            indirect_addr_var,
+            indirect_bb,
+            fseq_iter: &fseq_iter,
+        };
+        LLVMPositionBuilderAtEnd(builder, illegal_bb);
+        tran.emit_call(
+            "banshee_abort_illegal_branch",
+            [state_ptr, indirect_addr, indirect_target],
+        );
+        tran.emit_exit();
+        LLVMPositionBuilderAtEnd(builder, leave_bb);
+        tran.emit_leave(indirect_target, indirect_addr);
 
-        // Clean up.
-        LLVMDIBuilderFinalize(di_builder);
-        LLVMDisposeBuilder(builder);
-        Ok(())
+        // Emit the instructions.
+        tran.emit(inst_index)
     }
 
     unsafe fn lookup_func(&self, name: &str) -> LLVMValueRef {
@@ -608,11 +849,29 @@ impl<'a> ElfTranslator<'a> {
     }
 }
 
-/// A translator for a section.
+/// Get the function symbols in the `.symtab` sections of a binary.
+pub fn function_symbols(elf: &elf::File) -> Vec<elf::types::Symbol> {
+    let symbols: Vec<_> = elf
+        .sections
+        .iter()
+        .filter(|section| section.shdr.shtype == elf::types::SHT_SYMTAB)
+        .flat_map(|section| elf.get_symbols(section))
+        .flatten()
+        .collect();
+    trace!("Loaded {} symbols", symbols.len());
+    symbols
+        .into_iter()
+        .filter(|sym| sym.symtype == elf::types::STT_FUNC)
+        .collect()
+}
+
+/// A translator for a region of a section.
 pub struct SectionTranslator<'a> {
     elf: &'a ElfTranslator<'a>,
     section: &'a elf::Section,
     engine: &'a Engine,
+    /// The function the region is translated into.
+    func: LLVMValueRef,
     /// The debug info scope for additional debug info emitted in the section.
     di_scope: LLVMMetadataRef,
     /// An LLVM value that holds the pointer to the CPU state structure.
@@ -623,12 +882,14 @@ pub struct SectionTranslator<'a> {
     trace_data_buffer: LLVMValueRef,
     /// The builder to emit instructions with.
     builder: LLVMBuilderRef,
-    /// The first address in the section.
-    #[allow(dead_code)]
+    /// The first address in the region.
     addr_start: u64,
-    /// The point beyond the last address in the section.
-    #[allow(dead_code)]
+    /// The point beyond the last address in the region.
     addr_end: u64,
+    /// Basic blocks for each instruction address in the region.
+    inst_bbs: HashMap<u64, LLVMBasicBlockRef>,
+    /// Basic blocks leaving the region for an address outside of it.
+    exit_bbs: RefCell<HashMap<u64, LLVMBasicBlockRef>>,
     /// The alloca variable holding the indirect jump target address.
     indirect_target_var: LLVMValueRef,
     /// The alloca variable holding the indirect jump instruction address.
@@ -651,7 +912,7 @@ impl<'a> SectionTranslator<'a> {
                 LLVMConstInt(LLVMInt32Type(), addr as u64, 0),
             ],
         );
-        LLVMBuildRetVoid(self.builder);
+        self.emit_exit();
     }
 
     /// Emit the code to handle an illegal instruction.
@@ -669,7 +930,7 @@ impl<'a> SectionTranslator<'a> {
                 LLVMConstInt(LLVMInt32Type(), inst.raw() as u64, 0),
             ],
         );
-        LLVMBuildRetVoid(self.builder);
+        self.emit_exit();
     }
 
     /// Emit the code to handle a branch to an unpredicted instruction.
@@ -684,7 +945,59 @@ impl<'a> SectionTranslator<'a> {
                 target,
             ],
         );
-        LLVMBuildRetVoid(self.builder);
+        self.emit_exit();
+    }
+
+    /// Emit the code to stop executing the binary.
+    unsafe fn emit_exit(&self) {
+        LLVMBuildRet(self.builder, LLVMConstInt(LLVMInt64Type(), REGION_EXIT, 0));
+    }
+
+    /// Emit the code to leave the region, continuing at `target` after a
+    /// jump at `addr`.
+    unsafe fn emit_leave(&self, target: LLVMValueRef, addr: LLVMValueRef) {
+        let target = LLVMBuildZExt(self.builder, target, LLVMInt64Type(), NONAME);
+        let addr = LLVMBuildZExt(self.builder, addr, LLVMInt64Type(), NONAME);
+        let addr = LLVMBuildShl(
+            self.builder,
+            addr,
+            LLVMConstInt(LLVMInt64Type(), 32, 0),
+            NONAME,
+        );
+        LLVMBuildRet(
+            self.builder,
+            LLVMBuildOr(self.builder, target, addr, NONAME),
+        );
+    }
+
+    /// Get the basic block which continues execution at `addr`.
+    ///
+    /// Addresses outside the region get a block which leaves the region, or
+    /// aborts if there is no instruction at the address.
+    unsafe fn inst_bb(&self, addr: u64) -> LLVMBasicBlockRef {
+        if let Some(&bb) = self.inst_bbs.get(&addr) {
+            return bb;
+        }
+        if let Some(&bb) = self.exit_bbs.borrow().get(&addr) {
+            return bb;
+        }
+        let name = format!("exit_0x{:x}\0", addr);
+        let bb = LLVMAppendBasicBlockInContext(
+            self.engine.context,
+            self.func,
+            name.as_ptr() as *const _,
+        );
+        let prev_bb = LLVMGetInsertBlock(self.builder);
+        LLVMPositionBuilderAtEnd(self.builder, bb);
+        if self.elf.inst_addrs.contains(&addr) {
+            let target = LLVMConstInt(LLVMInt32Type(), addr, 0);
+            self.emit_leave(target, target);
+        } else {
+            self.emit_escape_abort(addr);
+        }
+        LLVMPositionBuilderAtEnd(self.builder, prev_bb);
+        self.exit_bbs.borrow_mut().insert(addr, bb);
+        bb
     }
 
     /// Emit the code for the remaining iterations of a buffered FREP loop.
@@ -732,7 +1045,7 @@ impl<'a> SectionTranslator<'a> {
                     self.builder,
                     rpt_cmp,
                     bb_loop_inst,
-                    self.elf.inst_bbs[&(curr_addr + 4)],
+                    self.inst_bb(curr_addr + 4),
                 );
 
                 // Emit loop body for current stagger offset
@@ -819,8 +1132,8 @@ impl<'a> SectionTranslator<'a> {
             LLVMBuildCondBr(
                 self.builder,
                 rpt_cmp,
-                self.elf.inst_bbs[&(fseq.inst_buffer[0].0)],
-                self.elf.inst_bbs[&(curr_addr + 4)],
+                self.inst_bb(fseq.inst_buffer[0].0),
+                self.inst_bb(curr_addr + 4),
             );
 
             Ok(())
@@ -829,12 +1142,17 @@ impl<'a> SectionTranslator<'a> {
         }
     }
 
-    /// Emit the code for the entire section.
+    /// Emit the code for the entire region.
     unsafe fn emit(&self, inst_index: &mut u32) -> Result<()> {
         // Initialize floating point sequencer context.
         let mut fseq = SequencerContext::new();
-        // iterate over section instructions
-        for (addr, inst) in self.elf.instructions(self.section) {
+        // iterate over region instructions
+        let region = self.addr_start..self.addr_end;
+        for (addr, inst) in self
+            .elf
+            .instructions(self.section)
+            .filter(|(addr, _)| region.contains(addr))
+        {
             let tran = InstructionTranslator {
                 section: self,
                 builder: self.builder,
@@ -846,7 +1164,7 @@ impl<'a> SectionTranslator<'a> {
                 trace_disabled: Default::default(),
                 was_freppable: Default::default(),
             };
-            LLVMPositionBuilderAtEnd(self.builder, self.elf.inst_bbs[&addr]);
+            LLVMPositionBuilderAtEnd(self.builder, self.inst_bbs[&addr]);
             match tran.emit(inst_index, &mut fseq) {
                 Ok(()) => (),
                 Err(e) => {
@@ -866,7 +1184,7 @@ impl<'a> SectionTranslator<'a> {
             // (a BB that already has a terminator corresponds to a jump instruction and
             // doesn't need a branch to the next subsequent instruction)
             if LLVMGetBasicBlockTerminator(LLVMGetInsertBlock(self.builder)).is_null() {
-                LLVMBuildBr(self.builder, self.elf.inst_bbs[&(addr + 4)]);
+                LLVMBuildBr(self.builder, self.inst_bb(addr + 4));
             }
         }
         Ok(())
@@ -975,6 +1293,26 @@ impl<'a> InstructionTranslator<'a> {
             self.emit_irq_check();
         }
 
+        // Fetch the instruction through the instruction caches. Execution
+        // only enters a new line at its first instruction or a jump target.
+        let icache = &self.section.engine.config.icache;
+        if self.section.elf.latency
+            && icache.enabled()
+            && (self.addr % icache.line_size.next_power_of_two() as u64 == 0
+                || self.section.elf.target_addrs.contains(&self.addr))
+        {
+            let stall = self.section.emit_call(
+                "banshee_icache_fetch",
+                [
+                    self.section.state_ptr,
+                    LLVMConstInt(LLVMInt32Type(), self.addr, 0),
+                ],
+            );
+            let cycle = LLVMBuildLoad(self.builder, self.cycle_ptr(), NONAME);
+            let cycle = LLVMBuildAdd(self.builder, cycle, stall, NONAME);
+            LLVMBuildStore(self.builder, cycle, self.cycle_ptr());
+        }
+
         // Update the instret counter.
         let instret = LLVMBuildLoad(self.builder, self.instret_ptr(), NONAME);
         let instret = LLVMBuildAdd(
@@ -985,6 +1323,17 @@ impl<'a> InstructionTranslator<'a> {
         );
         LLVMBuildStore(self.builder, instret, self.instret_ptr());
 
+        // Sample the PC for the profiler
+        if self.section.engine.profile_dir.is_some() {
+            let count = if self.section.elf.latency {
+                LLVMBuildLoad(self.builder, self.cycle_ptr(), NONAME)
+            } else {
+                instret
+            };
+            self.section
+                .emit_call("banshee_profile_tick", [self.section.state_ptr, count]);
+        }
+
         // reset ssr streamer flags to serve new values for SSR registers
         for i in 0..self.section.engine.config.ssr.num_dm as u32 {
             self.section.emit_call("banshee_ssr_eoi", [self.ssr_ptr(i)]);
@@ -1094,7 +1443,7 @@ impl<'a> InstructionTranslator<'a> {
                 LLVMConstInt(LLVMInt32Type(), self.inst.raw() as u64, 0),
             ],
         );
-        LLVMBuildRetVoid(self.builder);
+        self.section.emit_exit();
 
         let phi_size = self.section.elf.tcdm_ext_range.len() + 2;
         let mut values: Vec<LLVMValueRef> = Vec::with_capacity(phi_size);
@@ -1234,7 +1583,7 @@ impl<'a> InstructionTranslator<'a> {
                 LLVMConstInt(LLVMInt32Type(), self.inst.raw() as u64, 0),
             ],
         );
-        LLVMBuildRetVoid(self.builder);
+        self.section.emit_exit();
 
         let phi_size = self.section.elf.tcdm_ext_range.len() + 2;
         let mut values: Vec<LLVMValueRef> = Vec::with_capacity(phi_size);
@@ -1500,7 +1849,7 @@ impl<'a> InstructionTranslator<'a> {
             LLVMCreateBasicBlockInContext(self.section.engine.context, b"\0".as_ptr() as *const _);
         LLVMInsertExistingBasicBlockAfterInsertBlock(self.builder, bb);
         self.emit_trace();
-        LLVMBuildCondBr(self.builder, cmp, self.section.elf.inst_bbs[&target], bb);
+        LLVMBuildCondBr(self.builder, cmp, self.section.inst_bb(target), bb);
         LLVMPositionBuilderAtEnd(self.builder, bb);
         Ok(())
     }
@@ -1639,9 +1988,10 @@ impl<'a> InstructionTranslator<'a> {
         let _name = name.as_ptr() as *const _;
 
         let value = match data.op {
-            riscv::OpcodeImm5Rd::Dmstati => self
-                .section
-                .emit_call("banshee_dma_stat", [self.dma_ptr(), imm]),
+            riscv::OpcodeImm5Rd::Dmstati => self.section.emit_call(
+                "banshee_dma_stat",
+                [self.dma_ptr(), self.section.state_ptr, imm],
+            ),
         };
         self.write_reg(data.rd, value);
         Ok(())
@@ -1747,6 +2097,7 @@ impl<'a> InstructionTranslator<'a> {
                     data.rd,
                     LLVMConstInt(LLVMInt32Type(), (self.addr + 4) as u64, 0),
                 );
+                self.emit_profile_jump(data.rd, data.rs1, target);
                 self.emit_trace();
 
                 // Use the prepared indirect jump switch statement.
@@ -1797,6 +2148,18 @@ impl<'a> InstructionTranslator<'a> {
     }
 
     unsafe fn emit_fld(&self, rd: u32, addr: LLVMValueRef) {
+        let value = self.emit_load_f64(addr);
+        self.write_freg(rd, value);
+    }
+
+    unsafe fn emit_fsd(&self, rs: u32, addr: LLVMValueRef) {
+        let ptr = self.freg_ptr(rs);
+        let rs = LLVMBuildLoad(self.builder, ptr, format!("f{}\0", rs).as_ptr() as *const _);
+        self.emit_store_f64(addr, rs);
+    }
+
+    /// Emit the code to load a 64-bit value from memory as two words.
+    unsafe fn emit_load_f64(&self, addr: LLVMValueRef) -> LLVMValueRef {
         let raw_lo = self.read_mem(addr, 2, false);
         let raw_hi = self.read_mem(
             LLVMBuildAdd(
@@ -1816,22 +2179,20 @@ impl<'a> InstructionTranslator<'a> {
             LLVMConstInt(LLVMInt64Type(), 32, 0),
             NONAME,
         );
-        let value = LLVMBuildOr(self.builder, raw_lo, raw_hi, NONAME);
-        self.write_freg(rd, value);
+        LLVMBuildOr(self.builder, raw_lo, raw_hi, NONAME)
     }
 
-    unsafe fn emit_fsd(&self, rs: u32, addr: LLVMValueRef) {
-        let ptr = self.freg_ptr(rs);
-        let rs = LLVMBuildLoad(self.builder, ptr, format!("f{}\0", rs).as_ptr() as *const _);
-        let rs_lo = LLVMBuildTrunc(self.builder, rs, LLVMInt32Type(), NONAME);
-        let rs_hi = LLVMBuildLShr(
+    /// Emit the code to store a 64-bit value to memory as two words.
+    unsafe fn emit_store_f64(&self, addr: LLVMValueRef, value: LLVMValueRef) {
+        let lo = LLVMBuildTrunc(self.builder, value, LLVMInt32Type(), NONAME);
+        let hi = LLVMBuildLShr(
             self.builder,
-            rs,
+            value,
             LLVMConstInt(LLVMInt64Type(), 32, 0),
             NONAME,
         );
-        let rs_hi = LLVMBuildTrunc(self.builder, rs_hi, LLVMInt32Type(), NONAME);
-        self.write_mem(addr, rs_lo, 2);
+        let hi = LLVMBuildTrunc(self.builder, hi, LLVMInt32Type(), NONAME);
+        self.write_mem(addr, lo, 2);
         self.write_mem(
             LLVMBuildAdd(
                 self.builder,
@@ -1839,7 +2200,7 @@ impl<'a> InstructionTranslator<'a> {
                 LLVMConstInt(LLVMInt32Type(), 4, 0),
                 NONAME,
             ),
-            rs_hi,
+            hi,
             2,
         );
     }
@@ -1868,8 +2229,9 @@ impl<'a> InstructionTranslator<'a> {
                     data.rd,
                     LLVMConstInt(LLVMInt32Type(), (self.addr + 4) as u64, 0),
                 );
+                self.emit_profile_jump(data.rd, 0, LLVMConstInt(LLVMInt32Type(), target, 0));
                 self.emit_trace(); // need to do this before we branch away
-                LLVMBuildBr(self.builder, self.section.elf.inst_bbs[&target]);
+                LLVMBuildBr(self.builder, self.section.inst_bb(target));
                 self.was_terminator.set(true);
                 Ok(())
             }
@@ -2204,9 +2566,10 @@ impl<'a> InstructionTranslator<'a> {
                     true,
                 )
             }
-            riscv::OpcodeRdRs2::Dmstat => self
-                .section
-                .emit_call("banshee_dma_stat", [self.dma_ptr(), rs2]),
+            riscv::OpcodeRdRs2::Dmstat => self.section.emit_call(
+                "banshee_dma_stat",
+                [self.dma_ptr(), self.section.state_ptr, rs2],
+            ),
             // _ => bail!("Unsupported opcode {}", data.op),
         };
 
@@ -5848,7 +6211,7 @@ impl<'a> InstructionTranslator<'a> {
                 LLVMBuildCondBr(self.builder, terminate, bb_terminate, bb_wake_up);
                 // Terminate
                 LLVMPositionBuilderAtEnd(self.builder, bb_terminate);
-                LLVMBuildRetVoid(self.builder);
+                self.section.emit_exit();
                 // Continue
                 LLVMPositionBuilderAtEnd(self.builder, bb_wake_up);
             }
@@ -5908,6 +6271,26 @@ impl<'a> InstructionTranslator<'a> {
         self.read_mem(LLVMBuildAdd(self.builder, base, offset, NONAME), size, sext)
     }
 
+    /// Emit the code to track calls and returns on the profiler's call stack.
+    ///
+    /// Following the RISC-V calling convention, a jump that links `ra` or
+    /// `t0` is a call, and a jump through either of them without linking is
+    /// a return.
+    unsafe fn emit_profile_jump(&self, rd: u32, rs1: u32, target: LLVMValueRef) {
+        if self.section.engine.profile_dir.is_none() {
+            return;
+        }
+        let is_link = |r| r == 1 || r == 5;
+        if is_link(rd) {
+            let ret_addr = LLVMConstInt(LLVMInt32Type(), (self.addr + 4) as u64, 0);
+            self.section
+                .emit_call("banshee_profile_call", [self.section.state_ptr, ret_addr]);
+        } else if rd == 0 && is_link(rs1) {
+            self.section
+                .emit_call("banshee_profile_ret", [self.section.state_ptr, target]);
+        }
+    }
+
     /// Emit the code to check for any interrupt
     unsafe fn emit_irq_check(&self) {
         // Update MIP CSR (machine interrupt pending)
@@ -6161,6 +6544,9 @@ impl<'a> InstructionTranslator<'a> {
         }
         self.trace_emitted.set(true);
 
+        // Count the events for the performance counters
+        self.emit_perf_events();
+
         // Track the cycle counter if enabled
         if self.section.elf.latency {
             // Check for read dependencies
@@ -6200,6 +6586,23 @@ impl<'a> InstructionTranslator<'a> {
                 max_cycle = LLVMBuildSelect(self.builder, is_umax, max_cycle, c, NONAME);
             }
 
+            // Stall until the TCDM banks of the memory accesses are free
+            let mem = &self.section.engine.config.memory;
+            if mem.iter().any(|m| m.tcdm.banks > 0) {
+                for &(access, addr) in accesses.iter() {
+                    match access {
+                        TraceAccess::ReadMem | TraceAccess::WriteMem | TraceAccess::RMWMem => {
+                            let stall = self.section.emit_call(
+                                "banshee_tcdm_bank_access",
+                                [self.section.state_ptr, addr, max_cycle],
+                            );
+                            max_cycle = LLVMBuildAdd(self.builder, max_cycle, stall, NONAME);
+                        }
+                        _ => (),
+                    }
+                }
+            }
+
             // Store the cycle at which all dependencies are ready and the inst is executed
             LLVMBuildStore(self.builder, max_cycle, self.cycle_ptr());
 
@@ -6328,6 +6731,43 @@ impl<'a> InstructionTranslator<'a> {
         }
     }
 
+    /// Emit the code to count the instruction's events for the performance
+    /// counters, based on the accesses it recorded.
+    unsafe fn emit_perf_events(&self) {
+        let accesses = self.trace_accesses.borrow();
+        let num_dm = self.section.engine.config.ssr.num_dm as u8;
+        let is_load = accesses.iter().any(|&(a, _)| match a {
+            TraceAccess::ReadMem => true,
+            _ => false,
+        });
+        let is_fpu = accesses.iter().any(|&(a, _)| a.freg().is_some());
+        let is_ssr = accesses
+            .iter()
+            .any(|&(a, _)| a.freg().map_or(false, |i| i < num_dm));
+        let one = LLVMConstInt(LLVMInt64Type(), 1, 0);
+        if is_load {
+            self.emit_perf_add(PERF_RETIRED_LOAD, one);
+        }
+        if is_fpu {
+            self.emit_perf_add(PERF_ISSUE_FPU, one);
+        }
+        // Whether the SSR registers are streams is only known at runtime.
+        if is_ssr {
+            let enabled = LLVMBuildLoad(self.builder, self.ssr_enabled_ptr(), NONAME);
+            let enabled = LLVMBuildTrunc(self.builder, enabled, LLVMInt1Type(), NONAME);
+            let enabled = LLVMBuildZExt(self.builder, enabled, LLVMInt64Type(), NONAME);
+            self.emit_perf_add(PERF_ISSUE_FPU_SEQ, enabled);
+        }
+    }
+
+    /// Emit the code to add `value` to the count of a performance event.
+    unsafe fn emit_perf_add(&self, event: usize, value: LLVMValueRef) {
+        let ptr = self.perf_ptr(event);
+        let count = LLVMBuildLoad(self.builder, ptr, NONAME);
+        let count = LLVMBuildAdd(self.builder, count, value, NONAME);
+        LLVMBuildStore(self.builder, count, ptr);
+    }
+
     /// Emit the code to read-modify-write a CSR with an immediate rs1.
     unsafe fn emit_csr_imm(&self, data: riscv::FormatImm12RdRs1) -> Result<()> {
         self.emit_csr(data, LLVMConstInt(LLVMInt32Type(), data.rs1 as u64, 0))
@@ -6620,8 +7060,27 @@ impl<'a> InstructionTranslator<'a> {
     /// Returns an `i1` indicating whether it is as first result, and a pointer
     /// to that location in the TCDM.
     unsafe fn emit_tcdm_check(&self, addr: LLVMValueRef) -> (LLVMValueRef, LLVMValueRef) {
-        let tcdm_start = LLVMConstInt(LLVMInt32Type(), self.section.elf.tcdm_start as u64, 0);
-        let tcdm_end = LLVMConstInt(LLVMInt32Type(), self.section.elf.tcdm_end as u64, 0);
+        // Code shared across clusters reads the TCDM range of the executing
+        // cluster at runtime.
+        let (tcdm_start, tcdm_end) = if self.section.engine.shared_jit {
+            (
+                self.section.emit_call_with_name(
+                    "banshee_tcdm_start",
+                    [self.section.state_ptr],
+                    "tcdm_start",
+                ),
+                self.section.emit_call_with_name(
+                    "banshee_tcdm_end",
+                    [self.section.state_ptr],
+                    "tcdm_end",
+                ),
+            )
+        } else {
+            (
+                LLVMConstInt(LLVMInt32Type(), self.section.elf.tcdm_start as u64, 0),
+                LLVMConstInt(LLVMInt32Type(), self.section.elf.tcdm_end as u64, 0),
+            )
+        };
         let in_range = LLVMBuildAnd(
             self.builder,
             LLVMBuildICmp(self.builder, LLVMIntUGE, addr, tcdm_start, NONAME),
@@ -7602,7 +8061,7 @@ impl<'a> InstructionTranslator<'a> {
             "banshee_ssr_next",
             [self.ssr_ptr(rs), self.section.state_ptr],
         );
-        self.emit_fld(rs, addr);
+        self.emit_ssr_load(rs, addr);
         self.trace_disabled.set(td);
         LLVMBuildBr(self.builder, bb_ssroff);
 
@@ -7639,7 +8098,7 @@ impl<'a> InstructionTranslator<'a> {
             "banshee_ssr_next",
             [self.ssr_ptr(rd), self.section.state_ptr],
         );
-        self.emit_fsd(rd, addr);
+        self.emit_ssr_store(rd, addr);
         self.trace_disabled.set(td);
         LLVMBuildBr(self.builder, bb_ssroff);
 
@@ -7647,6 +8106,116 @@ impl<'a> InstructionTranslator<'a> {
         LLVMPositionBuilderAtEnd(self.builder, bb_ssroff);
     }
 
+    /// Emit the check whether the 64-bit SSR element at `addr` lies in the
+    /// local TCDM and is word-aligned, which is where streams almost always
+    /// point. Returns the check and the element's host pointer.
+    unsafe fn emit_ssr_tcdm_check(&self, addr: LLVMValueRef) -> (LLVMValueRef, LLVMValueRef) {
+        let (lo_in_range, ptr) = self.emit_tcdm_check(addr);
+        let addr_hi = LLVMBuildAdd(
+            self.builder,
+            addr,
+            LLVMConstInt(LLVMInt32Type(), 4, 0),
+            NONAME,
+        );
+        let (hi_in_range, _) = self.emit_tcdm_check(addr_hi);
+        let aligned = LLVMBuildICmp(
+            self.builder,
+            LLVMIntEQ,
+            LLVMBuildAnd(
+                self.builder,
+                addr,
+                LLVMConstInt(LLVMInt32Type(), 3, 0),
+                NONAME,
+            ),
+            LLVMConstInt(LLVMInt32Type(), 0, 0),
+            NONAME,
+        );
+        let fast = LLVMBuildAnd(
+            self.builder,
+            LLVMBuildAnd(self.builder, lo_in_range, hi_in_range, NONAME),
+            aligned,
+            NONAME,
+        );
+        let ptr = LLVMBuildBitCast(
+            self.builder,
+            ptr,
+            LLVMPointerType(LLVMInt64Type(), 0),
+            NONAME,
+        );
+        (fast, ptr)
+    }
+
+    /// Emit the code to load the SSR element at `addr` into `rd`.
+    ///
+    /// Elements in the local TCDM are loaded with a single access; all others
+    /// go through `read_mem` like an `fld`. The register is written directly
+    /// rather than through `write_freg`, which would store the value back to
+    /// the stream.
+    unsafe fn emit_ssr_load(&self, rd: u32, addr: LLVMValueRef) {
+        let (is_fast, ptr) = self.emit_ssr_tcdm_check(addr);
+        let bb_fast = LLVMCreateBasicBlockInContext(self.section.engine.context, NONAME);
+        let bb_slow = LLVMCreateBasicBlockInContext(self.section.engine.context, NONAME);
+        let bb_end = LLVMCreateBasicBlockInContext(self.section.engine.context, NONAME);
+        LLVMInsertExistingBasicBlockAfterInsertBlock(self.builder, bb_end);
+        LLVMInsertExistingBasicBlockAfterInsertBlock(self.builder, bb_slow);
+        LLVMInsertExistingBasicBlockAfterInsertBlock(self.builder, bb_fast);
+        LLVMBuildCondBr(self.builder, is_fast, bb_fast, bb_slow);
+
+        // Emit the TCDM fast case.
+        LLVMPositionBuilderAtEnd(self.builder, bb_fast);
+        let fast_value = LLVMBuildLoad(self.builder, ptr, NONAME);
+        LLVMSetAlignment(fast_value, 4);
+        LLVMBuildBr(self.builder, bb_end);
+
+        // Emit the generic case.
+        LLVMPositionBuilderAtEnd(self.builder, bb_slow);
+        let slow_value = self.emit_load_f64(addr);
+        LLVMBuildBr(self.builder, bb_end);
+        let bb_slow = LLVMGetInsertBlock(self.builder);
+
+        LLVMPositionBuilderAtEnd(self.builder, bb_end);
+        let value = LLVMBuildPhi(self.builder, LLVMInt64Type(), NONAME);
+        LLVMAddIncoming(
+            value,
+            [fast_value, slow_value].as_mut_ptr(),
+            [bb_fast, bb_slow].as_mut_ptr(),
+            2,
+        );
+        LLVMBuildStore(self.builder, value, self.freg_ptr(rd));
+    }
+
+    /// Emit the code to store `rs` to the SSR element at `addr`.
+    ///
+    /// Elements in the local TCDM are stored with a single access; all others
+    /// go through `write_mem` like an `fsd`.
+    unsafe fn emit_ssr_store(&self, rs: u32, addr: LLVMValueRef) {
+        let value = LLVMBuildLoad(
+            self.builder,
+            self.freg_ptr(rs),
+            format!("f{}\0", rs).as_ptr() as *const _,
+        );
+        let (is_fast, ptr) = self.emit_ssr_tcdm_check(addr);
+        let bb_fast = LLVMCreateBasicBlockInContext(self.section.engine.context, NONAME);
+        let bb_slow = LLVMCreateBasicBlockInContext(self.section.engine.context, NONAME);
+        let bb_end = LLVMCreateBasicBlockInContext(self.section.engine.context, NONAME);
+        LLVMInsertExistingBasicBlockAfterInsertBlock(self.builder, bb_end);
+        LLVMInsertExistingBasicBlockAfterInsertBlock(self.builder, bb_slow);
+        LLVMInsertExistingBasicBlockAfterInsertBlock(self.builder, bb_fast);
+        LLVMBuildCondBr(self.builder, is_fast, bb_fast, bb_slow);
+
+        // Emit the TCDM fast case.
+        LLVMPositionBuilderAtEnd(self.builder, bb_fast);
+        LLVMSetAlignment(LLVMBuildStore(self.builder, value, ptr), 4);
+        LLVMBuildBr(self.builder, bb_end);
+
+        // Emit the generic case.
+        LLVMPositionBuilderAtEnd(self.builder, bb_slow);
+        self.emit_store_f64(addr, value);
+        LLVMBuildBr(self.builder, bb_end);
+
+        LLVMPositionBuilderAtEnd(self.builder, bb_end);
+    }
+
     /// Emit the code necessary to read a value from a register.
     unsafe fn read_csr(&self, csr: u32) -> LLVMValueRef {
         LLVMBuildCall(
@@ -7811,6 +8380,17 @@ impl<'a> InstructionTranslator<'a> {
         )
     }
 
+    unsafe fn perf_ptr(&self, event: usize) -> LLVMValueRef {
+        self.section.emit_call_with_name(
+            "banshee_perf_ptr",
+            [
+                self.section.state_ptr,
+                LLVMConstInt(LLVMInt32Type(), event as u64, 0),
+            ],
+            "ptr_perf",
+        )
+    }
+
     unsafe fn tcdm_ptr(&self) -> LLVMValueRef {
         self.section
             .emit_call_with_name("banshee_tcdm_ptr", [self.section.state_ptr], "ptr_tcdm")
@@ -0,0 +1,32 @@
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Fills the TCDM of each cluster with different data before a checkpoint, and
+# checks it after the checkpoint. Resuming from the checkpoint with --restore
+# must restore the TCDM of every cluster.
+
+.globl _start
+.section .text.init;
+_start:
+    csrr    a0, mhartid
+    li      a1, 0x40000040  # cluster_base_hartid
+    lw      a1, 0(a1)
+    sub     t0, a0, a1
+    slli    t0, t0, 2
+    li      t1, 0x100000    # TCDM
+    add     s0, t0, t1
+    addi    s1, a0, 1
+    sw      s1, 0(s0)
+    la      t0, scratch_reg
+    li      t1, 1
+    sw      t1, 0(t0)
+    li      t0, 0x40000058  # checkpoint_reg
+    sw      zero, 0(t0)
+    lw      t1, 0(s0)
+    beq     t1, s1, 1f
+    la      t0, scratch_reg
+    li      t1, 3
+    sw      t1, 0(t0)
+1:
+    wfi
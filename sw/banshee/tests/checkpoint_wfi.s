@@ -0,0 +1,40 @@
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Takes a checkpoint while the second core of each cluster sleeps in wfi. The
+# first core fills the TCDM, takes the checkpoint, and then wakes the second
+# core, which checks the TCDM. Resuming from the checkpoint with --restore
+# must put the second core back to sleep until it is woken up.
+
+.globl _start
+.section .text.init;
+_start:
+    csrr    a0, mhartid
+    li      a1, 0x40000040  # cluster_base_hartid
+    lw      a1, 0(a1)
+    li      s0, 0x100000    # TCDM
+    bne     a0, a1, 2f
+    # First core: fill the TCDM and take the checkpoint.
+    addi    s1, a0, 1
+    sw      s1, 0(s0)
+    la      t0, scratch_reg
+    li      t1, 1
+    sw      t1, 0(t0)
+    li      t0, 0x40000058  # checkpoint_reg
+    sw      zero, 0(t0)
+    # Wake up the second core.
+    li      t0, 0x40000028  # wakeup_reg
+    addi    t1, a0, 1
+    sw      t1, 0(t0)
+    j       3f
+2:
+    # Second core: sleep through the checkpoint, then check the TCDM.
+    wfi
+    lw      t1, 0(s0)
+    beq     t1, a0, 3f
+    la      t0, scratch_reg
+    li      t1, 3
+    sw      t1, 0(t0)
+3:
+    wfi
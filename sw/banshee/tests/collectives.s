@@ -0,0 +1,258 @@
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Port of `sw/tests/collectives.c`, with the broadcast and the allreduce of the
+# snRuntime (`snrt_broadcast`, `snrt_allreduce_sum`). For every n up to the
+# number of clusters, the first n clusters broadcast a buffer from the last of
+# them, and sum a buffer across all of them. The DM core, the last core of a
+# cluster, moves the buffers between the TCDMs, and the other cores add them.
+# Run with `config/multi_quadrant_remote.yaml`, which lays out the TCDMs below.
+
+.set N, 64
+.set TCDM_STRIDE, 0x40000
+.set BUF_OFFSET, 0x1000
+.set TMP_OFFSET, 0x2000
+
+.set TCDM_START_ADD, 0x40000000
+.set NR_CORES_ADD, 0x40000010
+.set BARRIER_ADD, 0x40000038
+.set CLUSTER_BASE_HARTID_ADD, 0x40000040
+.set CLUSTER_NUM_ADD, 0x40000048
+.set CLUSTER_ID_ADD, 0x40000050
+
+.globl _start
+.section .text.init;
+_start:
+    csrr    t0, mhartid
+    li      t1, CLUSTER_BASE_HARTID_ADD
+    lw      t1, 0(t1)
+    sub     s1, t0, t1              # core
+    li      t1, NR_CORES_ADD
+    lw      s2, 0(t1)               # cores per cluster
+    addi    t0, s2, -1
+    sub     t0, s1, t0
+    seqz    s8, t0                  # DM core
+    li      t1, CLUSTER_ID_ADD
+    lw      s3, 0(t1)               # cluster
+    li      t1, CLUSTER_NUM_ADD
+    lw      s4, 0(t1)               # clusters
+    li      t1, TCDM_START_ADD
+    lw      t1, 0(t1)
+    li      t0, BUF_OFFSET
+    add     s6, t1, t0              # buf
+    li      t0, TMP_OFFSET
+    add     s7, t1, t0              # tmp
+    li      s5, 1                   # n
+1:
+    bgeu    s3, s5, 2f
+    # Broadcast from the last cluster
+    addi    s0, s5, -1              # root
+    li      a1, 0
+    li      a2, 0
+    bne     s3, s0, 3f
+    li      a1, 1
+3:
+    call    fill
+    call    broadcast
+    li      a1, 1
+    li      a2, 0
+    call    check
+    # Sum across the clusters
+    li      a1, 1
+    mv      a2, s3
+    call    fill
+    call    reduce
+    li      s0, 0
+    call    broadcast
+    mv      a1, s5
+    addi    t0, s5, -1
+    mul     a2, s5, t0
+    srli    a2, a2, 1
+    call    check
+2:
+    # Synchronize all clusters with a flat barrier, as the clusters that did
+    # not take part must not enter the tree while the others still use it
+    beqz    s8, 3f
+    la      t0, sync
+    lw      t1, 4(t0)               # iteration
+    li      t2, 1
+    amoadd.w t2, t2, (t0)
+    addi    t2, t2, 1
+    bne     t2, s4, 4f
+    sw      zero, 0(t0)
+    addi    t1, t1, 1
+    sw      t1, 4(t0)
+    j       3f
+4:
+    lw      t2, 4(t0)
+    beq     t2, t1, 4b
+3:
+    li      t0, BARRIER_ADD
+    lw      t0, 0(t0)
+    addi    s5, s5, 1
+    bleu    s5, s4, 1b
+
+    csrr    t0, mhartid
+    bnez    t0, 5f                  # only hart 0 writes the exit code
+    la      t0, errors
+    lw      a0, 0(t0)
+    slli    a0, a0, 1
+    ori     a0, a0, 1
+    la      t0, scratch_reg
+    sw      a0, 0(t0)
+5:
+    wfi
+    j       5b
+
+# Broadcast buf from cluster s0 to the first s5 clusters (`snrt_broadcast`).
+broadcast:
+    mv      s11, ra
+    add     t0, s3, s5
+    sub     t0, t0, s0
+    remu    s9, t0, s5              # rank
+    call    collective_barrier
+    li      s10, 1                  # step
+1:
+    bgeu    s10, s5, 3f
+    beqz    s8, 2f
+    bgeu    s9, s10, 2f
+    add     a4, s9, s10
+    bgeu    a4, s5, 2f
+    add     a4, a4, s0
+    remu    a4, a4, s5
+    mv      a1, s6
+    mv      a2, s6
+    call    put
+2:
+    call    collective_barrier
+    slli    s10, s10, 1
+    j       1b
+3:
+    jr      s11
+
+# Sum buf across the first s5 clusters into cluster 0 (`snrt_reduce_sum`).
+reduce:
+    mv      s11, ra
+    call    collective_barrier
+    li      s10, 1                  # step
+1:
+    bgeu    s10, s5, 4f
+    slli    t0, s10, 1
+    remu    s9, s3, t0              # rank % (2 * step)
+    beqz    s8, 2f
+    bne     s9, s10, 2f
+    sub     a4, s3, s10
+    mv      a1, s6
+    mv      a2, s7
+    call    put
+2:
+    call    collective_barrier
+    # The compute cores add the partial sum of the partner
+    bnez    s8, 3f
+    bnez    s9, 3f
+    add     t0, s3, s10
+    bgeu    t0, s5, 3f
+    mv      t0, s1
+    addi    t3, s2, -1
+    li      t4, N
+5:
+    bgeu    t0, t4, 3f
+    slli    t1, t0, 3
+    add     t2, s6, t1
+    add     t5, s7, t1
+    fld     ft0, 0(t2)
+    fld     ft1, 0(t5)
+    fadd.d  ft0, ft0, ft1
+    fsd     ft0, 0(t2)
+    add     t0, t0, t3
+    j       5b
+3:
+    # The next round must not overwrite tmp of a cluster still adding
+    call    collective_barrier
+    slli    s10, s10, 1
+    j       1b
+4:
+    jr      s11
+
+# Synchronize all cores of the first s5 clusters.
+collective_barrier:
+    mv      t6, ra
+    li      t0, BARRIER_ADD
+    lw      t0, 0(t0)
+    beqz    s8, 1f
+    mv      a0, s5
+    call    global_barrier
+1:
+    li      t0, BARRIER_ADD
+    lw      t0, 0(t0)
+    jr      t6
+
+# Copy buf from a1 to the same offset as a2 in the TCDM of cluster a4, with
+# the DMA, and wait for it.
+put:
+    sub     t0, a4, s3
+    li      t1, TCDM_STRIDE
+    mul     t0, t0, t1
+    add     a2, a2, t0
+    li      a3, 8 * N
+    # dmsrc a1, zero
+    .word (0b0000000 << 25) | (0 << 20) | (11 << 15) | (0b000 << 12) | 0b0101011
+    # dmdst a2, zero
+    .word (0b0000001 << 25) | (0 << 20) | (12 << 15) | (0b000 << 12) | 0b0101011
+    # dmcpyi t0, a3, 0
+    .word (0b0000010 << 25) | (0 << 20) | (13 << 15) | (0b000 << 12) | (5 << 7) | 0b0101011
+1:
+    # dmstati t0, 2
+    .word (0b0000100 << 25) | (2 << 20) | (0b000 << 12) | (5 << 7) | 0b0101011
+    bnez    t0, 1b
+    ret
+
+# Set buf[i] = i * a1 + a2 on the first core.
+fill:
+    bnez    s1, 2f
+    li      t0, 0
+    li      t3, N
+1:
+    mul     t1, t0, a1
+    add     t1, t1, a2
+    fcvt.d.wu ft0, t1
+    slli    t1, t0, 3
+    add     t1, s6, t1
+    fsd     ft0, 0(t1)
+    addi    t0, t0, 1
+    bltu    t0, t3, 1b
+2:
+    ret
+
+# Count the elements with buf[i] != i * a1 + a2 as errors on the first core.
+check:
+    bnez    s1, 2f
+    li      t0, 0
+    li      t2, 0
+    li      t3, N
+1:
+    mul     t1, t0, a1
+    add     t1, t1, a2
+    fcvt.d.wu ft0, t1
+    slli    t1, t0, 3
+    add     t1, s6, t1
+    fld     ft1, 0(t1)
+    feq.d   t1, ft0, ft1
+    xori    t1, t1, 1
+    add     t2, t2, t1
+    addi    t0, t0, 1
+    bltu    t0, t3, 1b
+    la      t0, errors
+    amoadd.w zero, t2, (t0)
+2:
+    ret
+
+.include "runtime/global_barrier.s"
+
+.section .bss
+.align 2
+errors:
+    .word 0
+sync:
+    .word 0, 0
@@ -0,0 +1,44 @@
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Copies a block of DRAM that has never been written into the TCDM with the
+# DMA, and checks that it reads as zero.
+
+.globl _start
+.section .text.init;
+_start:
+    li      s0, 0x100000    # TCDM
+    li      s1, 0x80800000  # never written
+    li      s2, 256
+    # Fill the destination with garbage.
+    li      t1, -1
+    mv      t0, s0
+    add     t2, s0, s2
+1:
+    sw      t1, 0(t0)
+    addi    t0, t0, 4
+    bltu    t0, t2, 1b
+    # dmsrc s1, zero
+    .word (0b0000000 << 25) | (0 << 20) | (9 << 15) | (0b000 << 12) | 0b0101011
+    # dmdst s0, zero
+    .word (0b0000001 << 25) | (0 << 20) | (8 << 15) | (0b000 << 12) | 0b0101011
+    # dmcpyi t3, s2, 0
+    .word (0b0000010 << 25) | (0 << 20) | (18 << 15) | (0b000 << 12) | (28 << 7) | 0b0101011
+    # Wait until the DMA is idle: dmstati t0, 2
+2:
+    .word (0b0000100 << 25) | (2 << 20) | (0b000 << 12) | (5 << 7) | 0b0101011
+    bnez    t0, 2b
+    # Check the destination.
+    li      a0, 1
+    mv      t0, s0
+3:
+    lw      t1, 0(t0)
+    beqz    t1, 4f
+    li      a0, 3
+4:
+    addi    t0, t0, 4
+    bltu    t0, t2, 3b
+    la      t0, scratch_reg
+    sw      a0, 0(t0)
+    wfi
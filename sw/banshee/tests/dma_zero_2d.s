@@ -0,0 +1,87 @@
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Clears a 64 KiB block of DRAM twice, like the runtime clears the BSS: first
+# word by word, then with the DMA, which replicates a zeroed buffer in the
+# TCDM through a 2D transfer with a source stride of zero. Checks that the
+# block reads as zero after either. With `--latency --trace`, the `mcycle`
+# reads around each clear give its duration.
+
+.set BLOCK, 0x80100000
+.set BLOCK_SIZE, 0x10000
+.set ZERO_BUF, 0x100000     # TCDM
+.set ZERO_BUF_SIZE, 256
+
+.globl _start
+.section .text.init;
+_start:
+    li      s0, BLOCK
+    li      s1, BLOCK + BLOCK_SIZE
+    li      a0, 1
+
+    # Clear word by word.
+    jal     fill
+    csrr    s2, mcycle
+    mv      t0, s0
+1:
+    sw      zero, 0(t0)
+    addi    t0, t0, 4
+    bltu    t0, s1, 1b
+    csrr    s3, mcycle
+    jal     check
+
+    # Clear with the DMA.
+    jal     fill
+    csrr    s4, mcycle
+    li      t0, ZERO_BUF
+    li      t1, ZERO_BUF + ZERO_BUF_SIZE
+2:
+    sw      zero, 0(t0)
+    addi    t0, t0, 4
+    bltu    t0, t1, 2b
+    li      t0, ZERO_BUF
+    li      t1, ZERO_BUF_SIZE
+    li      t2, BLOCK_SIZE / ZERO_BUF_SIZE
+    # dmsrc t0, zero
+    .word (0b0000000 << 25) | (0 << 20) | (5 << 15) | (0b000 << 12) | 0b0101011
+    # dmdst s0, zero
+    .word (0b0000001 << 25) | (0 << 20) | (8 << 15) | (0b000 << 12) | 0b0101011
+    # dmstr zero, t1 (source stride 0, destination stride ZERO_BUF_SIZE)
+    .word (0b0000110 << 25) | (6 << 20) | (0 << 15) | (0b000 << 12) | 0b0101011
+    # dmrep t2
+    .word (0b0000111 << 25) | (0 << 20) | (7 << 15) | (0b000 << 12) | 0b0101011
+    # dmcpyi t3, t1, 2 (2D)
+    .word (0b0000010 << 25) | (2 << 20) | (6 << 15) | (0b000 << 12) | (28 << 7) | 0b0101011
+    # Wait until the DMA is idle: dmstati t0, 2
+3:
+    .word (0b0000100 << 25) | (2 << 20) | (0b000 << 12) | (5 << 7) | 0b0101011
+    bnez    t0, 3b
+    csrr    s5, mcycle
+    jal     check
+
+    la      t0, scratch_reg
+    sw      a0, 0(t0)
+    wfi
+
+# Fill the block with garbage.
+fill:
+    li      t1, -1
+    mv      t0, s0
+1:
+    sw      t1, 0(t0)
+    addi    t0, t0, 4
+    bltu    t0, s1, 1b
+    ret
+
+# Check that the block reads as zero, and flag an error in a0 otherwise.
+check:
+    mv      t0, s0
+1:
+    lw      t1, 0(t0)
+    beqz    t1, 2f
+    li      a0, 3
+2:
+    addi    t0, t0, 4
+    bltu    t0, s1, 1b
+    ret
@@ -0,0 +1,78 @@
+# Copyright 2020 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# DRAM throughput benchmark: every hart of every cluster streams stores,
+# loads, and AMOs over its own slice of DRAM. Run with increasing
+# `--num-cores`/`--num-clusters` and compare the reported inst/s.
+
+.set DRAM_BENCH_BASE, 0x81000000
+.set SLICE_WORDS, 1024
+.set ITERATIONS, 64
+
+.globl _start
+.section .text.init;
+_start:
+    csrr    s0, mhartid
+    li      s1, DRAM_BENCH_BASE
+    slli    t0, s0, 12          # SLICE_WORDS * 4 bytes per hart
+    add     s1, s1, t0          # slice
+    la      s2, counter
+    li      s3, 0               # sum
+    li      s4, 0               # i
+    li      s5, ITERATIONS
+    li      s6, SLICE_WORDS
+1:
+    # slice[j] = i ^ j
+    li      t0, 0
+    mv      t1, s1
+2:
+    xor     t2, s4, t0
+    sw      t2, 0(t1)
+    addi    t1, t1, 4
+    addi    t0, t0, 1
+    bne     t0, s6, 2b
+    # sum += slice[j]
+    li      t0, 0
+    mv      t1, s1
+3:
+    lw      t2, 0(t1)
+    add     s3, s3, t2
+    addi    t1, t1, 4
+    addi    t0, t0, 1
+    bne     t0, s6, 3b
+    li      t0, 1
+    amoadd.w zero, t0, (s2)
+    addi    s4, s4, 1
+    bne     s4, s5, 1b
+
+    # Check the last pass of the local slice.
+    li      a0, 0
+    li      t0, 0
+    mv      t1, s1
+    addi    t3, s5, -1
+4:
+    xor     t2, t3, t0
+    add     a0, a0, t2
+    lw      t2, 0(t1)
+    sub     a0, a0, t2
+    addi    t1, t1, 4
+    addi    t0, t0, 1
+    bne     t0, s6, 4b
+    seqz    t0, s3
+    add     a0, a0, t0
+
+    la      t0, barrier_reg
+    lw      t0, 0(t0)
+    bnez    s0, 5f              # only hart 0 writes the exit code
+    slli    a0, a0, 1
+    ori     a0, a0, 1
+    la      t0, scratch_reg
+    sw      a0, 0(t0)
+5:
+    wfi
+    j       5b
+
+.section .data
+counter:
+    .word 0
@@ -0,0 +1,106 @@
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Port of `sw/tests/global_barrier.c`: the DM cores of the first n clusters
+# pass through the hierarchical global barrier, for every n up to the number
+# of clusters, and then all cores synchronize. Each pass increments a
+# counter before the barrier and checks after it that no participant is still
+# behind or already two passes ahead. Run with more clusters than fit into a
+# quadrant.
+
+.set REPS, 16
+
+.set NR_CORES_ADD, 0x40000010
+.set BARRIER_ADD, 0x40000038
+.set CLUSTER_BASE_HARTID_ADD, 0x40000040
+.set CLUSTER_NUM_ADD, 0x40000048
+.set CLUSTER_ID_ADD, 0x40000050
+
+.globl _start
+.section .text.init;
+_start:
+    csrr    s0, mhartid
+    li      t0, CLUSTER_BASE_HARTID_ADD
+    lw      t0, 0(t0)
+    sub     s1, s0, t0              # core
+    li      t0, NR_CORES_ADD
+    lw      t0, 0(t0)
+    addi    t0, t0, -1
+    sub     s1, s1, t0              # zero on the DM core
+    li      t0, CLUSTER_ID_ADD
+    lw      s2, 0(t0)               # cluster
+    li      t0, CLUSTER_NUM_ADD
+    lw      s3, 0(t0)               # clusters
+    la      s4, counts
+    li      s5, 1                   # n
+1:
+    bnez    s1, 3f
+    bgeu    s2, s5, 3f
+    # Warm up, and align the clusters
+    mv      a0, s5
+    call    global_barrier
+    li      s6, 0                   # passes
+    slli    t0, s5, 2
+    add     s7, s4, t0              # counter
+2:
+    li      t0, 1
+    amoadd.w zero, t0, (s7)
+    mv      a0, s5
+    call    global_barrier
+    addi    s6, s6, 1
+    lw      t0, 0(s7)
+    mul     t1, s6, s5
+    sltu    t2, t0, t1
+    add     t1, t1, s5
+    sltu    t1, t0, t1
+    xori    t1, t1, 1
+    or      t2, t2, t1
+    la      t0, errors
+    amoadd.w zero, t2, (t0)
+    li      t0, REPS
+    bltu    s6, t0, 2b
+3:
+    # Synchronize all clusters with a flat barrier, as the clusters that did
+    # not take part must not enter the tree while the others still use it
+    bnez    s1, 4f
+    la      t0, sync
+    lw      t1, 4(t0)               # iteration
+    li      t2, 1
+    amoadd.w t2, t2, (t0)
+    addi    t2, t2, 1
+    bne     t2, s3, 3f
+    sw      zero, 0(t0)
+    addi    t1, t1, 1
+    sw      t1, 4(t0)
+    j       4f
+3:
+    lw      t2, 4(t0)
+    beq     t2, t1, 3b
+4:
+    li      t0, BARRIER_ADD
+    lw      t0, 0(t0)
+    addi    s5, s5, 1
+    bleu    s5, s3, 1b
+
+    bnez    s0, 5f                  # only hart 0 writes the exit code
+    la      t0, errors
+    lw      a0, 0(t0)
+    slli    a0, a0, 1
+    ori     a0, a0, 1
+    la      t0, scratch_reg
+    sw      a0, 0(t0)
+5:
+    wfi
+    j       5b
+
+.include "runtime/global_barrier.s"
+
+.section .bss
+.align 2
+errors:
+    .word 0
+sync:
+    .word 0, 0
+counts:
+    .zero 4 * (MAX_CLUSTER_NUM + 1)
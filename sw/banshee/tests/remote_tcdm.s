@@ -0,0 +1,99 @@
+# Copyright 2020 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Remote TCDM benchmark: every hart streams stores, loads, and AMOs over a
+# slice of the next cluster's TCDM. None of these accesses hit the inlined
+# local TCDM path, so this stresses the address decoding of the engine. Run
+# with `config/multi_cluster_remote.yaml`, which lays out the TCDMs below.
+
+.set TCDM_BASE, 0x100000
+.set TCDM_STRIDE, 0x40000
+.set BENCH_OFFSET, 0x10000
+.set SLICE_WORDS, 256
+.set ITERATIONS, 64
+
+.set CLUSTER_BASE_HARTID_ADD, 0x40000040
+.set CLUSTER_NUM_ADD, 0x40000048
+.set CLUSTER_ID_ADD, 0x40000050
+
+.globl _start
+.section .text.init;
+_start:
+    csrr    s0, mhartid
+    li      t0, CLUSTER_BASE_HARTID_ADD
+    lw      t0, 0(t0)
+    sub     s7, s0, t0          # core_id
+    li      t0, CLUSTER_ID_ADD
+    lw      t0, 0(t0)
+    li      t1, CLUSTER_NUM_ADD
+    lw      t1, 0(t1)
+    addi    t0, t0, 1
+    remu    t0, t0, t1          # remote cluster
+    li      t1, TCDM_STRIDE
+    mul     t0, t0, t1
+    li      s1, TCDM_BASE + BENCH_OFFSET
+    add     s1, s1, t0
+    li      t1, 4 * (SLICE_WORDS + 1)
+    mul     t0, s7, t1
+    add     s1, s1, t0          # slice
+    addi    s2, s1, 4 * SLICE_WORDS  # counter
+    sw      zero, 0(s2)
+    li      s3, 0               # sum
+    li      s4, 0               # i
+    li      s5, ITERATIONS
+    li      s6, SLICE_WORDS
+1:
+    # slice[j] = i ^ j
+    li      t0, 0
+    mv      t1, s1
+2:
+    xor     t2, s4, t0
+    sw      t2, 0(t1)
+    addi    t1, t1, 4
+    addi    t0, t0, 1
+    bne     t0, s6, 2b
+    # sum += slice[j]
+    li      t0, 0
+    mv      t1, s1
+3:
+    lw      t2, 0(t1)
+    add     s3, s3, t2
+    addi    t1, t1, 4
+    addi    t0, t0, 1
+    bne     t0, s6, 3b
+    li      t0, 1
+    amoadd.w zero, t0, (s2)
+    addi    s4, s4, 1
+    bne     s4, s5, 1b
+
+    # Check the last pass and the AMO count of the remote slice.
+    li      a0, 0
+    li      t0, 0
+    mv      t1, s1
+    addi    t3, s5, -1
+4:
+    xor     t2, t3, t0
+    add     a0, a0, t2
+    lw      t2, 0(t1)
+    sub     a0, a0, t2
+    addi    t1, t1, 4
+    addi    t0, t0, 1
+    bne     t0, s6, 4b
+    lw      t0, 0(s2)
+    sub     t0, t0, s5
+    snez    t0, t0
+    add     a0, a0, t0
+    seqz    t0, s3
+    add     a0, a0, t0
+
+    la      t0, barrier_reg
+    lw      t0, 0(t0)
+    bnez    s0, 5f              # only hart 0 writes the exit code
+    slli    a0, a0, 1
+    ori     a0, a0, 1
+    la      t0, scratch_reg
+    sw      a0, 0(t0)
+5:
+    wfi
+    j       5b
@@ -0,0 +1,138 @@
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# The hierarchical global barrier of the DM cores of the snRuntime
+# (`snrt_global_dm_barrier`), for tests that run across several clusters.
+# The first cluster of each quadrant waits for the other clusters in its
+# quadrant, and cluster 0 waits for the other quadrant leaders. A waiting core
+# sleeps in wfi. Banshee does not map the CLINTs of other clusters, so the
+# cores are woken up through the wakeup register instead.
+#
+# The DM core is the last core of a cluster, and the clusters have the same
+# number of cores, such that the hart IDs are consecutive.
+
+.set QUADRANT_CLUSTER_NUM, 4
+.set MAX_CLUSTER_NUM, 64
+
+.set BARRIER_NR_CORES_ADD, 0x40000010
+.set BARRIER_WAKEUP_ADD, 0x40000028
+.set BARRIER_CLUSTER_ID_ADD, 0x40000050
+
+# Synchronize the DM cores of the first a0 clusters.
+# Clobbers a1-a7 and t0-t5.
+.section .text
+global_barrier:
+    mv      a7, ra
+    li      t0, BARRIER_CLUSTER_ID_ADD
+    lw      a6, 0(t0)               # cluster
+    li      t0, BARRIER_NR_CORES_ADD
+    lw      t5, 0(t0)               # cores per cluster
+    la      t2, barrier_tree
+    slli    t0, a6, 3
+    add     t2, t2, t0              # node
+    li      t0, QUADRANT_CLUSTER_NUM
+    remu    t1, a6, t0
+    sub     t4, a6, t1              # leader
+    mv      a4, a6
+    call    global_barrier_children
+    mv      t3, a5                  # children
+
+    # Wait for the subtree to arrive
+    beqz    t3, 2f
+1:
+    lw      t0, 0(t2)
+    beq     t0, t3, 1f
+    wfi
+    j       1b
+1:
+    sw      zero, 0(t2)
+2:
+    # Arrive at the parent, waking it up if this completes its children, and
+    # wait for the release
+    beqz    a6, 2f
+    mv      a4, t4
+    bne     a6, t4, 1f
+    li      a4, 0                   # parent
+1:
+    la      a1, barrier_tree
+    slli    t0, a4, 3
+    add     a1, a1, t0              # parent node
+    lw      a2, 4(a1)               # iteration
+    li      t0, 1
+    amoadd.w a3, t0, (a1)
+    addi    a3, a3, 1
+    call    global_barrier_children
+    bne     a3, a5, 1f
+    call    global_barrier_wake
+1:
+    addi    a2, a2, 1
+    addi    a1, a1, 4
+1:
+    lw      t0, 0(a1)
+    beq     t0, a2, 2f
+    wfi
+    j       1b
+2:
+    # Release the subtree. The update must have completed before the
+    # wakeups, or a child could miss it and sleep forever.
+    beqz    t3, 3f
+    addi    t0, t2, 4
+    li      t1, 1
+    amoadd.w zero, t1, (t0)
+    fence
+    bne     a6, t4, 2f
+    addi    a4, a6, 1
+    addi    a1, t4, QUADRANT_CLUSTER_NUM
+    bleu    a1, a0, 1f
+    mv      a1, a0
+1:
+    bgeu    a4, a1, 2f
+    call    global_barrier_wake
+    addi    a4, a4, 1
+    j       1b
+2:
+    bnez    a6, 3f
+    li      a4, QUADRANT_CLUSTER_NUM
+1:
+    bgeu    a4, a0, 3f
+    call    global_barrier_wake
+    addi    a4, a4, QUADRANT_CLUSTER_NUM
+    j       1b
+3:
+    jr      a7
+
+# Number of clusters that wait for cluster a4 of the first a0 clusters -> a5.
+# Clobbers t0-t1.
+global_barrier_children:
+    li      a5, 0
+    li      t0, QUADRANT_CLUSTER_NUM
+    remu    t1, a4, t0
+    bnez    t1, 2f
+    sub     t1, a0, a4
+    bleu    t1, t0, 1f
+    mv      t1, t0
+1:
+    addi    a5, t1, -1
+2:
+    bnez    a4, 1f
+    addi    t1, a0, -1
+    divu    t1, t1, t0
+    add     a5, a5, t1
+1:
+    ret
+
+# Wake up the DM core of cluster a4. Clobbers t0-t1.
+global_barrier_wake:
+    addi    t0, a4, 1
+    mul     t0, t0, t5
+    addi    t0, t0, -1
+    li      t1, BARRIER_WAKEUP_ADD
+    sw      t0, 0(t1)
+    ret
+
+# A node for every cluster: the number of arrived children, and the iteration
+.section .bss
+.align 3
+barrier_tree:
+    .zero 8 * MAX_CLUSTER_NUM
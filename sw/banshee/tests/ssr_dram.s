@@ -0,0 +1,325 @@
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+
+# Streams a vector out of DRAM with one SSR and its double into DRAM with the
+# other, and checks the result with regular loads. Neither stream hits the
+# TCDM, so every SSR access goes through the fallback to `banshee_load` and
+# `banshee_store`. Repeats the streams to also serve as a benchmark.
+
+.set SSR_CFG, 0x204800
+.set N, 256
+.set ITERATIONS, 256
+
+.globl _start
+.section .text.init;
+_start:
+    csrr    a0, mhartid
+    bnez    a0, 9f
+    li      t0, SSR_CFG
+    li      t1, N - 1
+    sw      t1, 0x10(t0)        # DM0 bounds[0]
+    sw      t1, 0x110(t0)       # DM1 bounds[0]
+    li      t1, 8
+    sw      t1, 0x30(t0)        # DM0 stride[0]
+    sw      t1, 0x130(t0)       # DM1 stride[0]
+    la      s0, x
+    la      s1, y
+    li      s2, ITERATIONS
+1:
+    sw      s0, 0xc0(t0)        # DM0 rptr[0]
+    sw      s1, 0x1e0(t0)       # DM1 wptr[0]
+    csrsi   0x7c0, 1
+    li      t2, N
+2:
+    fadd.d  ft1, ft0, ft0
+    addi    t2, t2, -1
+    bnez    t2, 2b
+    csrci   0x7c0, 1
+    addi    s2, s2, -1
+    bnez    s2, 1b
+
+    # Check y[i] == 2 * x[i].
+    li      a0, 1
+    li      t2, N
+3:
+    fld     fa0, 0(s0)
+    fadd.d  fa0, fa0, fa0
+    fld     fa1, 0(s1)
+    feq.d   t3, fa0, fa1
+    bnez    t3, 4f
+    li      a0, 3
+4:
+    addi    s0, s0, 8
+    addi    s1, s1, 8
+    addi    t2, t2, -1
+    bnez    t2, 3b
+    la      t0, scratch_reg
+    sw      a0, 0(t0)
+9:
+    wfi
+
+.data
+.align 3
+x:
+    .double 0.5
+    .double 1.5
+    .double 2.5
+    .double 3.5
+    .double 4.5
+    .double 5.5
+    .double 6.5
+    .double 7.5
+    .double 8.5
+    .double 9.5
+    .double 10.5
+    .double 11.5
+    .double 12.5
+    .double 13.5
+    .double 14.5
+    .double 15.5
+    .double 16.5
+    .double 17.5
+    .double 18.5
+    .double 19.5
+    .double 20.5
+    .double 21.5
+    .double 22.5
+    .double 23.5
+    .double 24.5
+    .double 25.5
+    .double 26.5
+    .double 27.5
+    .double 28.5
+    .double 29.5
+    .double 30.5
+    .double 31.5
+    .double 32.5
+    .double 33.5
+    .double 34.5
+    .double 35.5
+    .double 36.5
+    .double 37.5
+    .double 38.5
+    .double 39.5
+    .double 40.5
+    .double 41.5
+    .double 42.5
+    .double 43.5
+    .double 44.5
+    .double 45.5
+    .double 46.5
+    .double 47.5
+    .double 48.5
+    .double 49.5
+    .double 50.5
+    .double 51.5
+    .double 52.5
+    .double 53.5
+    .double 54.5
+    .double 55.5
+    .double 56.5
+    .double 57.5
+    .double 58.5
+    .double 59.5
+    .double 60.5
+    .double 61.5
+    .double 62.5
+    .double 63.5
+    .double 64.5
+    .double 65.5
+    .double 66.5
+    .double 67.5
+    .double 68.5
+    .double 69.5
+    .double 70.5
+    .double 71.5
+    .double 72.5
+    .double 73.5
+    .double 74.5
+    .double 75.5
+    .double 76.5
+    .double 77.5
+    .double 78.5
+    .double 79.5
+    .double 80.5
+    .double 81.5
+    .double 82.5
+    .double 83.5
+    .double 84.5
+    .double 85.5
+    .double 86.5
+    .double 87.5
+    .double 88.5
+    .double 89.5
+    .double 90.5
+    .double 91.5
+    .double 92.5
+    .double 93.5
+    .double 94.5
+    .double 95.5
+    .double 96.5
+    .double 97.5
+    .double 98.5
+    .double 99.5
+    .double 100.5
+    .double 101.5
+    .double 102.5
+    .double 103.5
+    .double 104.5
+    .double 105.5
+    .double 106.5
+    .double 107.5
+    .double 108.5
+    .double 109.5
+    .double 110.5
+    .double 111.5
+    .double 112.5
+    .double 113.5
+    .double 114.5
+    .double 115.5
+    .double 116.5
+    .double 117.5
+    .double 118.5
+    .double 119.5
+    .double 120.5
+    .double 121.5
+    .double 122.5
+    .double 123.5
+    .double 124.5
+    .double 125.5
+    .double 126.5
+    .double 127.5
+    .double 128.5
+    .double 129.5
+    .double 130.5
+    .double 131.5
+    .double 132.5
+    .double 133.5
+    .double 134.5
+    .double 135.5
+    .double 136.5
+    .double 137.5
+    .double 138.5
+    .double 139.5
+    .double 140.5
+    .double 141.5
+    .double 142.5
+    .double 143.5
+    .double 144.5
+    .double 145.5
+    .double 146.5
+    .double 147.5
+    .double 148.5
+    .double 149.5
+    .double 150.5
+    .double 151.5
+    .double 152.5
+    .double 153.5
+    .double 154.5
+    .double 155.5
+    .double 156.5
+    .double 157.5
+    .double 158.5
+    .double 159.5
+    .double 160.5
+    .double 161.5
+    .double 162.5
+    .double 163.5
+    .double 164.5
+    .double 165.5
+    .double 166.5
+    .double 167.5
+    .double 168.5
+    .double 169.5
+    .double 170.5
+    .double 171.5
+    .double 172.5
+    .double 173.5
+    .double 174.5
+    .double 175.5
+    .double 176.5
+    .double 177.5
+    .double 178.5
+    .double 179.5
+    .double 180.5
+    .double 181.5
+    .double 182.5
+    .double 183.5
+    .double 184.5
+    .double 185.5
+    .double 186.5
+    .double 187.5
+    .double 188.5
+    .double 189.5
+    .double 190.5
+    .double 191.5
+    .double 192.5
+    .double 193.5
+    .double 194.5
+    .double 195.5
+    .double 196.5
+    .double 197.5
+    .double 198.5
+    .double 199.5
+    .double 200.5
+    .double 201.5
+    .double 202.5
+    .double 203.5
+    .double 204.5
+    .double 205.5
+    .double 206.5
+    .double 207.5
+    .double 208.5
+    .double 209.5
+    .double 210.5
+    .double 211.5
+    .double 212.5
+    .double 213.5
+    .double 214.5
+    .double 215.5
+    .double 216.5
+    .double 217.5
+    .double 218.5
+    .double 219.5
+    .double 220.5
+    .double 221.5
+    .double 222.5
+    .double 223.5
+    .double 224.5
+    .double 225.5
+    .double 226.5
+    .double 227.5
+    .double 228.5
+    .double 229.5
+    .double 230.5
+    .double 231.5
+    .double 232.5
+    .double 233.5
+    .double 234.5
+    .double 235.5
+    .double 236.5
+    .double 237.5
+    .double 238.5
+    .double 239.5
+    .double 240.5
+    .double 241.5
+    .double 242.5
+    .double 243.5
+    .double 244.5
+    .double 245.5
+    .double 246.5
+    .double 247.5
+    .double 248.5
+    .double 249.5
+    .double 250.5
+    .double 251.5
+    .double 252.5
+    .double 253.5
+    .double 254.5
+    .double 255.5
+
+.bss
+.align 3
+y:
+    .space 8 * N
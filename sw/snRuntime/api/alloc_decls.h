@@ -11,14 +11,55 @@ typedef struct {
     uint32_t next;
 } snrt_allocator_t;
 
+// Position of the L1 allocator, to free everything allocated after it
+typedef uint32_t snrt_l1_mark_t;
+
+typedef struct {
+    // Address of the first free block, or zero if the pool is exhausted
+    uint32_t free;
+} snrt_l1_pool_t;
+
+// Number of size classes of small L3 chunks, from 8 B up to 512 B
+#define SNRT_L3_NUM_CLASSES 7
+
+typedef struct {
+    // Next free address in the hart's current slab
+    uint32_t next;
+    // End of the hart's current slab
+    uint32_t end;
+    // Freed small chunks, one list per size class
+    uint32_t free[SNRT_L3_NUM_CLASSES];
+    // Freed large chunks
+    uint32_t free_large;
+} snrt_l3_cache_t;
+
 inline void *snrt_l1_next();
 
 inline void *snrt_l3_next();
 
 inline void *snrt_l1alloc(size_t size);
 
+inline void *snrt_l1alloc_aligned(size_t size, size_t align);
+
+inline void *snrt_l1alloc_bank(size_t size, size_t align, uint32_t bank_offset);
+
 inline void snrt_l1_update_next(void *next);
 
+inline snrt_l1_mark_t snrt_l1_mark();
+
+inline void snrt_l1_release(snrt_l1_mark_t mark);
+
+inline void snrt_l1_pool_init(snrt_l1_pool_t *pool, size_t block_size,
+                              uint32_t num, size_t align);
+
+inline void *snrt_l1_pool_alloc(snrt_l1_pool_t *pool);
+
+inline void snrt_l1_pool_free(snrt_l1_pool_t *pool, void *block);
+
 inline void *snrt_l3alloc(size_t size);
 
+inline void snrt_l3free(void *ptr, size_t size);
+
+inline uint32_t snrt_l3_high_water();
+
 inline void snrt_alloc_init();
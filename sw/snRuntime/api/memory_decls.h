@@ -14,4 +14,9 @@ inline volatile uint32_t* __attribute__((const)) snrt_cluster_clint_set_ptr();
 
 inline volatile uint32_t* __attribute__((const)) snrt_cluster_clint_clr_ptr();
 
+inline volatile uint32_t* __attribute__((const))
+snrt_remote_cluster_clint_set_ptr(uint32_t cluster_idx);
+
 inline uint32_t __attribute__((const)) snrt_cluster_hw_barrier_addr();
+
+inline uint32_t __attribute__((const)) snrt_cluster_perf_counters_addr();
@@ -7,8 +7,14 @@ typedef struct {
     uint32_t volatile iteration;
 } snrt_barrier_t;
 
+// Number of clusters per quadrant, which share a node of the global barrier
+#ifndef SNRT_QUADRANT_CLUSTER_NUM
+#define SNRT_QUADRANT_CLUSTER_NUM 4
+#endif
+
 extern volatile uint32_t _snrt_mutex;
 extern volatile snrt_barrier_t _snrt_barrier;
+extern volatile snrt_barrier_t _snrt_barrier_tree[SNRT_CLUSTER_NUM];
 
 inline volatile uint32_t *snrt_mutex();
 
@@ -20,4 +26,6 @@ inline void snrt_mutex_release(volatile uint32_t *pmtx);
 
 inline void snrt_cluster_hw_barrier();
 
+inline void snrt_global_dm_barrier(uint32_t num_clusters);
+
 inline void snrt_global_barrier();
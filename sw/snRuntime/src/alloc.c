@@ -2,14 +2,34 @@
 // Licensed under the Apache License, Version 2.0, see LICENSE for details.
 // SPDX-License-Identifier: Apache-2.0
 
-snrt_allocator_t l3_allocator;
+// Not in the BSS, which cluster 0 may clear while other clusters have
+// already started to allocate
+snrt_allocator_t l3_allocator __attribute__((section(".data")));
+
+__thread snrt_l3_cache_t _snrt_l3_cache;
 
 extern void *snrt_l1_next();
 extern void *snrt_l3_next();
 
 extern void *snrt_l1alloc(size_t size);
+extern void *snrt_l1alloc_aligned(size_t size, size_t align);
+extern void *snrt_l1alloc_bank(size_t size, size_t align, uint32_t bank_offset);
+extern void *snrt_l3_reserve(size_t size);
+extern uint32_t snrt_l3_size_class(size_t size);
 extern void *snrt_l3alloc(size_t size);
+extern void snrt_l3free(void *ptr, size_t size);
+extern uint32_t snrt_l3_high_water();
 
 extern void snrt_l1_update_next(void *next);
 
+extern snrt_l1_mark_t snrt_l1_mark();
+extern void snrt_l1_release(snrt_l1_mark_t mark);
+
+extern void snrt_l1_pool_init(snrt_l1_pool_t *pool, size_t block_size,
+                              uint32_t num, size_t align);
+extern void *snrt_l1_pool_alloc(snrt_l1_pool_t *pool);
+extern void snrt_l1_pool_free(snrt_l1_pool_t *pool, void *block);
+
+extern uint32_t snrt_l1_heap_end_addr();
+
 extern void snrt_alloc_init();
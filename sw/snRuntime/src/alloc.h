@@ -7,7 +7,14 @@
 
 #define MIN_CHUNK_SIZE 8
 
+// Size of the slabs in which each hart carves out small L3 chunks
+#define SNRT_L3_SLAB_SIZE 4096
+
+// Largest L3 chunk that is carved from a slab
+#define SNRT_L3_MAX_SMALL (MIN_CHUNK_SIZE << (SNRT_L3_NUM_CLASSES - 1))
+
 extern snrt_allocator_t l3_allocator;
+extern __thread snrt_l3_cache_t _snrt_l3_cache;
 
 inline snrt_allocator_t *snrt_l1_allocator() {
     return (snrt_allocator_t *)&(cls()->l1_allocator);
@@ -19,32 +26,84 @@ inline void *snrt_l1_next() { return (void *)snrt_l1_allocator()->next; }
 
 inline void *snrt_l3_next() { return (void *)snrt_l3_allocator()->next; }
 
+#ifndef SNRT_TCDM_BANK_WIDTH
+#define SNRT_TCDM_BANK_WIDTH 8
+#endif
+
+#ifndef SNRT_TCDM_BANK_NUM
+#define SNRT_TCDM_BANK_NUM 32
+#endif
+
+// Trap on an allocation that does not fit into its allocator, if
+// `SNRT_ALLOC_CHECK` is defined, such that it does not go unnoticed by
+// silently corrupting the CLS or the stacks at the end of the TCDM.
+#ifdef SNRT_ALLOC_CHECK
+#define SNRT_ALLOC_OVERFLOW() asm volatile("ebreak" ::: "memory")
+#else
+#define SNRT_ALLOC_OVERFLOW() \
+    do {                      \
+    } while (0)
+#endif
+
 /**
  * @brief Allocate a chunk of memory in the L1 memory
- * @details This currently does not support free-ing of memory
+ * @details The chunk is aligned to `align` bytes and starts in TCDM bank
+ * `bank_offset`. Placing buffers which are accessed concurrently in different
+ * banks avoids TCDM bank conflicts. Where the alignment spans several banks,
+ * the bank is rounded down to a multiple of it.
+ * Allocations are not thread safe: allocate from a single core, e.g. the DM
+ * core, and share the pointer with the other cores of the cluster.
  *
  * @param size number of bytes to allocate
+ * @param align alignment in bytes, a power of two of at least
+ * `MIN_CHUNK_SIZE`
+ * @param bank_offset index of the bank the chunk starts at, modulo the number
+ * of banks
  * @return pointer to the allocated memory
  */
-inline void *snrt_l1alloc(size_t size) {
+inline void *snrt_l1alloc_bank(size_t size, size_t align,
+                               uint32_t bank_offset) {
     snrt_allocator_t *alloc = snrt_l1_allocator();
 
-    // TODO colluca: do we need this? What does it imply?
-    //               one more instruction, TCDM consumption...
-    size = ALIGN_UP(size, MIN_CHUNK_SIZE);
+    uint32_t ret = ALIGN_UP(alloc->next, align);
+    uint32_t offset = ALIGN_DOWN(
+        (bank_offset % SNRT_TCDM_BANK_NUM) * SNRT_TCDM_BANK_WIDTH, align);
+    if (offset) {
+        // Skip ahead to the requested bank
+        uint32_t period = SNRT_TCDM_BANK_NUM * SNRT_TCDM_BANK_WIDTH;
+        ret = ALIGN_UP(ret - offset, period) + offset;
+    }
+    uint32_t next = ret + ALIGN_UP(size, MIN_CHUNK_SIZE);
 
-    // TODO colluca
-    // if (alloc->next + size > alloc->base + alloc->size) {
-    //     snrt_trace(
-    //         SNRT_TRACE_ALLOC,
-    //         "Not enough memory to allocate: base %#x size %#x next %#x\n",
-    //         alloc->base, alloc->size, alloc->next);
-    //     return 0;
-    // }
+    if (next > alloc->base + alloc->size || next < alloc->next)
+        SNRT_ALLOC_OVERFLOW();
 
-    void *ret = (void *)alloc->next;
-    alloc->next += size;
-    return ret;
+    alloc->next = next;
+    return (void *)ret;
+}
+
+/**
+ * @brief Allocate a chunk of memory in the L1 memory, with a given alignment
+ *
+ * @param size number of bytes to allocate
+ * @param align alignment in bytes, a power of two of at least
+ * `MIN_CHUNK_SIZE`
+ * @return pointer to the allocated memory
+ */
+inline void *snrt_l1alloc_aligned(size_t size, size_t align) {
+    return snrt_l1alloc_bank(size, align, 0);
+}
+
+/**
+ * @brief Allocate a chunk of memory in the L1 memory
+ * @details Individual chunks cannot be freed. Release them all at once with
+ * `snrt_l1_release`, or use a pool for buffers of a fixed size.
+ *
+ * @param size number of bytes to allocate
+ * @return pointer to the allocated memory
+ */
+inline void *snrt_l1alloc(size_t size) {
+    return snrt_l1alloc_bank(size, MIN_CHUNK_SIZE, 0);
 }
 
 /**
@@ -55,39 +114,217 @@ inline void snrt_l1_update_next(void *next) {
     alloc->next = (uint32_t)next;
 }
 
+/**
+ * @brief Open a scope in the L1 memory
+ * @details Everything allocated after the mark is freed at once by passing it
+ * to `snrt_l1_release`, e.g. to reuse the TCDM between the layers of a
+ * network. Scopes nest.
+ *
+ * @return mark to release the scope with
+ */
+inline snrt_l1_mark_t snrt_l1_mark() { return snrt_l1_allocator()->next; }
+
+/**
+ * @brief Free everything allocated in the L1 memory since `mark` was taken
+ */
+inline void snrt_l1_release(snrt_l1_mark_t mark) {
+    snrt_l1_allocator()->next = mark;
+}
+
+/**
+ * @brief Create a pool of `num` blocks of `block_size` bytes in the L1 memory
+ * @details The blocks are aligned to `align` bytes, e.g. for DMA buffers. The
+ * pool's memory is taken from the L1 allocator, and freed with the scope it
+ * was created in.
+ *
+ * @param pool the pool to initialize
+ * @param block_size number of bytes in a block
+ * @param num number of blocks
+ * @param align alignment in bytes, a power of two of at least
+ * `MIN_CHUNK_SIZE`
+ */
+inline void snrt_l1_pool_init(snrt_l1_pool_t *pool, size_t block_size,
+                              uint32_t num, size_t align) {
+    block_size = ALIGN_UP(block_size, align);
+    uint32_t base = (uint32_t)snrt_l1alloc_aligned(block_size * num, align);
+
+    // Thread the free list through the blocks, in address order
+    pool->free = 0;
+    for (uint32_t i = num; i > 0; i--) {
+        uint32_t block = base + (i - 1) * block_size;
+        *(uint32_t *)block = pool->free;
+        pool->free = block;
+    }
+}
+
+/**
+ * @brief Allocate a block from a pool
+ * @details Like all L1 allocations, this is not thread safe.
+ *
+ * @return pointer to the block, or null if the pool is exhausted
+ */
+inline void *snrt_l1_pool_alloc(snrt_l1_pool_t *pool) {
+    uint32_t block = pool->free;
+    if (!block) SNRT_ALLOC_OVERFLOW();
+    if (block) pool->free = *(uint32_t *)block;
+    return (void *)block;
+}
+
+/**
+ * @brief Return a block to the pool it was allocated from
+ */
+inline void snrt_l1_pool_free(snrt_l1_pool_t *pool, void *block) {
+    *(uint32_t *)block = pool->free;
+    pool->free = (uint32_t)block;
+}
+
+/**
+ * @brief Reserve a chunk of memory in the L3 memory, for good
+ * @details Lock-free, the chunk is claimed with an AMO on the shared next
+ * pointer. Reserved memory is never returned to the shared allocator.
+ *
+ * @param size number of bytes to reserve
+ * @return pointer to the reserved memory, or null if L3 is exhausted
+ */
+inline void *snrt_l3_reserve(size_t size) {
+    snrt_allocator_t *alloc = snrt_l3_allocator();
+
+    size = ALIGN_UP(size, MIN_CHUNK_SIZE);
+    uint32_t ret = __atomic_fetch_add(&alloc->next, size, __ATOMIC_RELAXED);
+    if (ret - alloc->base + size > alloc->size) {
+        SNRT_ALLOC_OVERFLOW();
+        return 0;
+    }
+    return (void *)ret;
+}
+
+/// Index of the size class of small L3 chunks of `size` bytes.
+inline uint32_t snrt_l3_size_class(size_t size) {
+    if (size <= MIN_CHUNK_SIZE) return 0;
+    return 32 - __builtin_clz(size - 1) - __builtin_ctz(MIN_CHUNK_SIZE);
+}
+
 /**
  * @brief Allocate a chunk of memory in the L3 memory
- * @details This currently does not support free-ing of memory
+ * @details Safe to call from any hart of any cluster. Small chunks are
+ * rounded up to a power of two, and carved from a slab private to the hart,
+ * such that harts only contend on the shared allocator to get a new slab.
+ * Large chunks are reserved from the shared allocator directly. Chunks freed
+ * with `snrt_l3free` on the same hart are reused first.
  *
  * @param size number of bytes to allocate
- * @return pointer to the allocated memory
+ * @return pointer to the allocated memory, or null if L3 is exhausted
  */
 inline void *snrt_l3alloc(size_t size) {
-    snrt_allocator_t *alloc = snrt_l3_allocator();
+    snrt_l3_cache_t *cache = &_snrt_l3_cache;
 
-    // TODO: L3 alloc size check
+    if (size > SNRT_L3_MAX_SMALL) {
+        // Reuse the first freed large chunk that fits
+        uint32_t *prev = &cache->free_large;
+        while (*prev) {
+            uint32_t *chunk = (uint32_t *)*prev;
+            if (chunk[1] >= size) {
+                *prev = chunk[0];
+                return chunk;
+            }
+            prev = chunk;
+        }
+        return snrt_l3_reserve(size);
+    }
+
+    uint32_t size_class = snrt_l3_size_class(size);
+    uint32_t chunk = cache->free[size_class];
+    if (chunk) {
+        cache->free[size_class] = *(uint32_t *)chunk;
+        return (void *)chunk;
+    }
+
+    // Carve from the slab, and replace it once exhausted. The remainder of
+    // the old slab is lost.
+    uint32_t chunk_size = MIN_CHUNK_SIZE << size_class;
+    if (cache->end - cache->next < chunk_size) {
+        uint32_t slab = (uint32_t)snrt_l3_reserve(SNRT_L3_SLAB_SIZE);
+        if (!slab) return 0;
+        cache->next = slab;
+        cache->end = slab + SNRT_L3_SLAB_SIZE;
+    }
+    chunk = cache->next;
+    cache->next += chunk_size;
+    return (void *)chunk;
+}
+
+/**
+ * @brief Free a chunk of memory in the L3 memory
+ * @details The chunk is kept for reuse by later allocations of the calling
+ * hart, which does not need to be the one that allocated it.
+ *
+ * @param ptr pointer returned by `snrt_l3alloc`
+ * @param size number of bytes it was allocated with
+ */
+inline void snrt_l3free(void *ptr, size_t size) {
+    snrt_l3_cache_t *cache = &_snrt_l3_cache;
+    uint32_t *chunk = (uint32_t *)ptr;
 
-    void *ret = (void *)alloc->next;
-    alloc->next += size;
-    return ret;
+    if (size > SNRT_L3_MAX_SMALL) {
+        chunk[0] = cache->free_large;
+        chunk[1] = size;
+        cache->free_large = (uint32_t)chunk;
+    } else {
+        uint32_t size_class = snrt_l3_size_class(size);
+        chunk[0] = cache->free[size_class];
+        cache->free[size_class] = (uint32_t)chunk;
+    }
+}
+
+/**
+ * @brief Number of bytes of L3 memory reserved so far by all harts
+ * @details The shared allocator never shrinks, so this is the peak L3
+ * footprint of the program, including the harts' slabs.
+ */
+inline uint32_t snrt_l3_high_water() {
+    snrt_allocator_t *alloc = snrt_l3_allocator();
+    uint32_t used =
+        __atomic_load_n(&alloc->next, __ATOMIC_RELAXED) - alloc->base;
+    return used < alloc->size ? used : alloc->size;
+}
+
+/**
+ * @brief End of the memory available to the L1 allocator
+ * @details The CLS and the stacks of the harts, which also hold their TLS,
+ * occupy the end of the TCDM, see `start.S`.
+ */
+inline uint32_t snrt_l1_heap_end_addr() {
+    extern volatile uint32_t __cdata_start, __cdata_end;
+    extern volatile uint32_t __cbss_start, __cbss_end;
+    uint32_t cls_size = ((uint32_t)&__cdata_end) -
+                        ((uint32_t)&__cdata_start) +
+                        ((uint32_t)&__cbss_end) - ((uint32_t)&__cbss_start);
+    uint32_t stacks_size =
+        8 + snrt_cluster_core_num() * ((1 << SNRT_LOG2_STACK_SIZE) + 8);
+    return ALIGN_DOWN(snrt_l1_end_addr() - cls_size - stacks_size,
+                      MIN_CHUNK_SIZE);
 }
 
 inline void snrt_alloc_init() {
     // Only one core per cluster has to initialize the L1 allocator
     if (snrt_is_dm_core()) {
         // Initialize L1 allocator
-        // Note: at the moment the allocator assumes all of the TCDM is
-        // available for allocation. However, the CLS, TLS and stack already
-        // occupy a possibly significant portion.
         snrt_l1_allocator()->base =
             ALIGN_UP(snrt_l1_start_addr(), MIN_CHUNK_SIZE);
-        snrt_l1_allocator()->size = snrt_l1_end_addr() - snrt_l1_start_addr();
+        snrt_l1_allocator()->size =
+            snrt_l1_heap_end_addr() - snrt_l1_allocator()->base;
         snrt_l1_allocator()->next = snrt_l1_allocator()->base;
-        // Initialize L3 allocator
-        extern uint32_t _edram;
-        snrt_l3_allocator()->base = ALIGN_UP((uint32_t)&_edram, MIN_CHUNK_SIZE);
-        snrt_l3_allocator()->size = 0;
-        snrt_l3_allocator()->next = snrt_l3_allocator()->base;
+        // Initialize L3 allocator. Every cluster writes the same bounds, but
+        // only the first one sets the next pointer, as the others may
+        // already be allocating.
+        extern uint32_t _edram, __l3_start, __l3_size;
+        uint32_t base = ALIGN_UP((uint32_t)&_edram, MIN_CHUNK_SIZE);
+        uint32_t unset = 0;
+        snrt_l3_allocator()->base = base;
+        snrt_l3_allocator()->size =
+            (uint32_t)&__l3_start + (uint32_t)&__l3_size - base;
+        __atomic_compare_exchange_n(&snrt_l3_allocator()->next, &unset, base,
+                                    0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
     }
 }
 
@@ -6,6 +6,8 @@ extern void snrt_int_cluster_set(uint32_t mask);
 
 extern void snrt_int_cluster_clr(uint32_t mask);
 
+extern void snrt_int_cluster_set_remote(uint32_t cluster_idx, uint32_t mask);
+
 extern void snrt_int_clr_mcip();
 
 extern void snrt_int_set_mcip();
@@ -18,6 +18,15 @@ inline void snrt_int_cluster_clr(uint32_t mask) {
     *(snrt_cluster_clint_clr_ptr()) = mask;
 }
 
+/**
+ * @brief Write mask to the interrupt set register of another cluster
+ * @param cluster_idx cluster whose harts to interrupt
+ * @param mask set bit at X sets the interrupt of hart X
+ */
+inline void snrt_int_cluster_set_remote(uint32_t cluster_idx, uint32_t mask) {
+    *(snrt_remote_cluster_clint_set_ptr(cluster_idx)) = mask;
+}
+
 inline void snrt_int_clr_mcip() {
     snrt_int_cluster_clr(1 << snrt_cluster_core_idx());
 }
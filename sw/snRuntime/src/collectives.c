@@ -0,0 +1,27 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+extern void *snrt_remote_l1_ptr(const void *ptr, uint32_t cluster_idx);
+
+extern void snrt_collective_barrier(uint32_t num_clusters);
+
+extern snrt_dma_txid_t snrt_collective_put(void *dst, const void *src,
+                                           size_t size, uint32_t cluster_idx);
+
+extern void snrt_collective_add(double *dst, const double *src, size_t count);
+
+extern void snrt_broadcast(void *buf, size_t size, uint32_t root,
+                           uint32_t num_clusters);
+
+extern void snrt_scatter(const void *src, void *dst, size_t size,
+                         uint32_t root, uint32_t num_clusters);
+
+extern void snrt_gather(const void *src, void *dst, size_t size, uint32_t root,
+                        uint32_t num_clusters);
+
+extern void snrt_reduce_sum(double *buf, double *tmp, size_t count,
+                            uint32_t root, uint32_t num_clusters);
+
+extern void snrt_allreduce_sum(double *buf, double *tmp, size_t count,
+                               uint32_t num_clusters);
@@ -0,0 +1,165 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+//================================================================================
+// Collective operations across clusters
+//
+// The collectives operate on TCDM buffers which lie at the same offset in the
+// TCDM of every cluster, as they do when all clusters perform the same L1
+// allocations. They are called by all cores of the first `num_clusters`
+// clusters. The DM cores move the data from TCDM to TCDM with the DMA,
+// without going through L3, and the compute cores perform the reductions.
+//================================================================================
+
+/**
+ * @brief Translate a pointer into the local TCDM to the same offset in the
+ * TCDM of another cluster
+ */
+inline void *snrt_remote_l1_ptr(const void *ptr, uint32_t cluster_idx) {
+    uint32_t offset = (uint32_t)ptr - snrt_l1_start_addr();
+    return (void *)(SNRT_TCDM_START_ADDR + cluster_idx * SNRT_CLUSTER_OFFSET +
+                    offset);
+}
+
+/// Synchronize all cores of the first `num_clusters` clusters.
+inline void snrt_collective_barrier(uint32_t num_clusters) {
+    // The DM core must only arrive once the other cores of its cluster have,
+    // or remote clusters could overwrite buffers that are still in use
+    snrt_cluster_hw_barrier();
+    if (snrt_is_dm_core()) snrt_global_dm_barrier(num_clusters);
+    snrt_cluster_hw_barrier();
+}
+
+/// Copy `size` bytes from the local `src` to `dst` in cluster `cluster_idx`,
+/// where `dst` is given as the address of the same offset in the local TCDM.
+inline snrt_dma_txid_t snrt_collective_put(void *dst, const void *src,
+                                           size_t size, uint32_t cluster_idx) {
+    return snrt_dma_start_1d_wideptr(
+        (uint32_t)snrt_remote_l1_ptr(dst, cluster_idx), (uint32_t)src, size);
+}
+
+/// Add `count` elements of `src` to `dst`, split across the compute cores.
+inline void snrt_collective_add(double *dst, const double *src,
+                                size_t count) {
+    if (snrt_is_compute_core()) {
+        for (size_t i = snrt_cluster_core_idx(); i < count;
+             i += snrt_cluster_compute_core_num())
+            dst[i] += src[i];
+    }
+}
+
+/**
+ * @brief Broadcast a buffer from one cluster to all others
+ * @details Binomial tree: in every round, each cluster that holds the data
+ * sends it to one that does not, such that it takes logarithmically many
+ * rounds in the number of clusters.
+ *
+ * @param buf buffer to send on the root, and to receive into on the others
+ * @param size number of bytes in the buffer
+ * @param root index of the cluster that holds the data
+ * @param num_clusters number of clusters taking part
+ */
+inline void snrt_broadcast(void *buf, size_t size, uint32_t root,
+                           uint32_t num_clusters) {
+    uint32_t rank = (snrt_cluster_idx() + num_clusters - root) % num_clusters;
+
+    snrt_collective_barrier(num_clusters);
+    for (uint32_t step = 1; step < num_clusters; step <<= 1) {
+        if (snrt_is_dm_core() && rank < step && rank + step < num_clusters) {
+            snrt_collective_put(buf, buf, size,
+                                (rank + step + root) % num_clusters);
+            snrt_dma_wait_all();
+        }
+        snrt_collective_barrier(num_clusters);
+    }
+}
+
+/**
+ * @brief Distribute consecutive chunks of a buffer from one cluster to all
+ *
+ * @param src buffer of `num_clusters` chunks on the root
+ * @param dst buffer to receive the cluster's chunk into
+ * @param size number of bytes in a chunk
+ * @param root index of the cluster that holds the data
+ * @param num_clusters number of clusters taking part
+ */
+inline void snrt_scatter(const void *src, void *dst, size_t size,
+                         uint32_t root, uint32_t num_clusters) {
+    snrt_collective_barrier(num_clusters);
+    if (snrt_is_dm_core() && snrt_cluster_idx() == root) {
+        for (uint32_t i = 0; i < num_clusters; i++)
+            snrt_collective_put(dst, (const uint8_t *)src + i * size, size, i);
+        snrt_dma_wait_all();
+    }
+    snrt_collective_barrier(num_clusters);
+}
+
+/**
+ * @brief Collect a chunk from every cluster into consecutive chunks of a
+ * buffer on one cluster
+ *
+ * @param src the cluster's chunk
+ * @param dst buffer of `num_clusters` chunks on the root
+ * @param size number of bytes in a chunk
+ * @param root index of the cluster that receives the data
+ * @param num_clusters number of clusters taking part
+ */
+inline void snrt_gather(const void *src, void *dst, size_t size, uint32_t root,
+                        uint32_t num_clusters) {
+    snrt_collective_barrier(num_clusters);
+    if (snrt_is_dm_core()) {
+        snrt_collective_put((uint8_t *)dst + snrt_cluster_idx() * size, src,
+                            size, root);
+        snrt_dma_wait_all();
+    }
+    snrt_collective_barrier(num_clusters);
+}
+
+/**
+ * @brief Sum a buffer of doubles element-wise across clusters, into the
+ * buffer on one cluster
+ * @details Binomial tree: in every round, half of the clusters that still
+ * hold a partial sum send it to a partner, which adds it to its own. The
+ * buffers of the clusters other than the root are clobbered.
+ *
+ * @param buf the cluster's contribution, and the sum on the root
+ * @param tmp scratch buffer of the same size as `buf`
+ * @param count number of elements in the buffer
+ * @param root index of the cluster that receives the sum
+ * @param num_clusters number of clusters taking part
+ */
+inline void snrt_reduce_sum(double *buf, double *tmp, size_t count,
+                            uint32_t root, uint32_t num_clusters) {
+    uint32_t rank = (snrt_cluster_idx() + num_clusters - root) % num_clusters;
+
+    snrt_collective_barrier(num_clusters);
+    for (uint32_t step = 1; step < num_clusters; step <<= 1) {
+        if (snrt_is_dm_core() && rank % (2 * step) == step) {
+            snrt_collective_put(tmp, buf, count * sizeof(double),
+                                (rank - step + root) % num_clusters);
+            snrt_dma_wait_all();
+        }
+        snrt_collective_barrier(num_clusters);
+        if (rank % (2 * step) == 0 && rank + step < num_clusters)
+            snrt_collective_add(buf, tmp, count);
+        // The next round must not overwrite `tmp` of a cluster still adding
+        snrt_collective_barrier(num_clusters);
+    }
+}
+
+/**
+ * @brief Sum a buffer of doubles element-wise across clusters, into the
+ * buffers on all of them
+ * @details Reduces to cluster 0 and broadcasts the sum back.
+ *
+ * @param buf the cluster's contribution, and the sum on return
+ * @param tmp scratch buffer of the same size as `buf`
+ * @param count number of elements in the buffer
+ * @param num_clusters number of clusters taking part
+ */
+inline void snrt_allreduce_sum(double *buf, double *tmp, size_t count,
+                               uint32_t num_clusters) {
+    snrt_reduce_sum(buf, tmp, count, 0, num_clusters);
+    snrt_broadcast(buf, count * sizeof(double), 0, num_clusters);
+}
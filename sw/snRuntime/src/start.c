@@ -20,6 +20,47 @@ static inline void snrt_crt0_cluster_hw_barrier() {
     asm volatile("lw %0, 0(%1)" : "=r"(r) : "r"(hw_barrier) : "memory");
 }
 
+#ifdef SNRT_INIT_DMA
+// Size in bytes of the zeroed buffer at the start of the TCDM, which the DMA
+// replicates to clear memory. It lies in the L1 heap, which is only handed out
+// once `snrt_alloc_init` runs, and remains zero afterwards.
+#define SNRT_INIT_ZERO_BUF_SIZE 256
+
+static inline void snrt_init_dma() {
+    if (snrt_is_dm_core()) {
+        volatile uint32_t* p = (volatile uint32_t*)snrt_l1_start_addr();
+        for (uint32_t i = 0; i < SNRT_INIT_ZERO_BUF_SIZE / 4; i++) p[i] = 0;
+        // The DMA reads the TCDM through its own port, so the stores must
+        // have completed before the first transfer is issued.
+        asm volatile("fence" ::: "memory");
+    }
+}
+
+/// Copy `size` bytes from `src` to `dst` with the DMA, without waiting.
+static inline void snrt_init_dma_copy(uint32_t dst, uint32_t src,
+                                      uint32_t size) {
+    if (size) snrt_dma_start_1d((void*)dst, (void*)src, size);
+}
+
+/// Clear `size` bytes at `dst` with the DMA, without waiting.
+///
+/// The zero buffer is read repeatedly through a 2D transfer with a source
+/// stride of zero, such that the bulk of the region is a single transfer.
+static inline void snrt_init_dma_zero(uint32_t dst, uint32_t size) {
+    uint32_t zero_buf = snrt_l1_start_addr();
+    uint32_t reps = size / SNRT_INIT_ZERO_BUF_SIZE;
+    uint32_t rem = size % SNRT_INIT_ZERO_BUF_SIZE;
+    if (reps)
+        snrt_dma_start_2d((void*)dst, (void*)zero_buf, SNRT_INIT_ZERO_BUF_SIZE,
+                          SNRT_INIT_ZERO_BUF_SIZE, 0, reps);
+    snrt_init_dma_copy(dst + size - rem, zero_buf, rem);
+}
+
+static inline void snrt_init_dma_wait() {
+    if (snrt_is_dm_core()) snrt_dma_wait_all();
+}
+#endif
+
 static inline void snrt_init_tls() {
     extern volatile uint32_t __tdata_start, __tdata_end;
     extern volatile uint32_t __tbss_start, __tbss_end;
@@ -29,6 +70,23 @@ static inline void snrt_init_tls() {
 
     asm volatile("mv %0, tp" : "=r"(tls_ptr) : :);
 
+#ifdef SNRT_INIT_DMA
+    // The DM core sets up its own TLS with the DMA, while the compute cores
+    // copy theirs below. It has to wait, as the runtime starts to use TLS
+    // variables right away.
+    if (snrt_is_dm_core()) {
+        uint32_t tdata_size =
+            ((uint32_t)&__tdata_end) - ((uint32_t)&__tdata_start);
+        uint32_t tbss_size =
+            ((uint32_t)&__tbss_end) - ((uint32_t)&__tbss_start);
+        snrt_init_dma_copy((uint32_t)tls_ptr, (uint32_t)&__tdata_start,
+                           tdata_size);
+        snrt_init_dma_zero((uint32_t)tls_ptr + tdata_size, tbss_size);
+        snrt_dma_wait_all();
+        return;
+    }
+#endif
+
     // Copy tdata section
     for (p = (uint32_t*)(&__tdata_start); p < (uint32_t*)(&__tdata_end); p++) {
         *tls_ptr = *p;
@@ -47,6 +105,12 @@ static inline void snrt_init_bss() {
 
     // Only one core needs to perform the initialization
     if (snrt_cluster_idx() == 0 && snrt_is_dm_core()) {
+#ifdef SNRT_INIT_DMA
+        // Completes in the background, see `snrt_init_dma_wait`
+        snrt_init_dma_zero((uint32_t)&__bss_start,
+                           ((uint32_t)&__bss_end) - ((uint32_t)&__bss_start));
+        return;
+#endif
         volatile uint32_t* p;
 
         for (p = (uint32_t*)(&__bss_start); p < (uint32_t*)(&__bss_end); p++) {
@@ -63,6 +127,17 @@ static inline void snrt_init_cls() {
 
     // Only one core per cluster has to do this
     if (snrt_is_dm_core()) {
+#ifdef SNRT_INIT_DMA
+        // Completes in the background, see `snrt_init_dma_wait`
+        uint32_t cdata_size =
+            ((uint32_t)&__cdata_end) - ((uint32_t)&__cdata_start);
+        uint32_t cbss_size =
+            ((uint32_t)&__cbss_end) - ((uint32_t)&__cbss_start);
+        snrt_init_dma_copy(snrt_cls_base_addr(), (uint32_t)&__cdata_start,
+                           cdata_size);
+        snrt_init_dma_zero(snrt_cls_base_addr() + cdata_size, cbss_size);
+        return;
+#endif
         volatile uint32_t* p;
         volatile uint32_t* cls_ptr = (volatile uint32_t*)snrt_cls_base_addr();
 
@@ -98,6 +173,10 @@ void snrt_main() {
     snrt_crt0_callback0();
 #endif
 
+#ifdef SNRT_INIT_DMA
+    snrt_init_dma();
+#endif
+
 #ifdef SNRT_INIT_TLS
     snrt_init_tls();
 #endif
@@ -118,6 +197,10 @@ void snrt_main() {
     snrt_init_cls();
 #endif
 
+#ifdef SNRT_INIT_DMA
+    snrt_init_dma_wait();
+#endif
+
 #ifdef SNRT_CRT0_CALLBACK3
     snrt_crt0_callback3();
 #endif
@@ -8,6 +8,10 @@
 
 volatile uint32_t _snrt_mutex;
 volatile snrt_barrier_t _snrt_barrier;
+// Not in the BSS, which cluster 0 may clear while other clusters already
+// take part in a barrier
+volatile snrt_barrier_t _snrt_barrier_tree[SNRT_CLUSTER_NUM]
+    __attribute__((section(".data")));
 
 //================================================================================
 // Functions
@@ -23,6 +27,15 @@ extern void snrt_mutex_release(volatile uint32_t *pmtx);
 
 extern void snrt_cluster_hw_barrier();
 
+extern uint32_t snrt_global_barrier_children(uint32_t cluster_idx,
+                                             uint32_t num_clusters);
+
+extern void snrt_global_barrier_wait(volatile uint32_t *var, uint32_t value);
+
+extern void snrt_global_barrier_wake(uint32_t cluster_idx);
+
+extern void snrt_global_dm_barrier(uint32_t num_clusters);
+
 extern void snrt_global_barrier();
 
 extern void snrt_partial_barrier(snrt_barrier_t *barr, uint32_t n);
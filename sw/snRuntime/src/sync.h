@@ -64,24 +64,108 @@ inline void snrt_cluster_hw_barrier() {
                  : "memory");
 }
 
-/// Synchronize clusters globally with a global software barrier
-inline void snrt_global_barrier() {
-    // Synchronize all DM cores in software
-    if (snrt_is_dm_core()) {
-        // Remember previous iteration
-        uint32_t prev_barrier_iteration = _snrt_barrier.iteration;
-        uint32_t cnt =
-            __atomic_add_fetch(&(_snrt_barrier.cnt), 1, __ATOMIC_RELAXED);
-
-        // Increment the barrier counter
-        if (cnt == snrt_cluster_num()) {
-            _snrt_barrier.cnt = 0;
-            __atomic_add_fetch(&(_snrt_barrier.iteration), 1, __ATOMIC_RELAXED);
-        } else {
-            while (prev_barrier_iteration == _snrt_barrier.iteration)
-                ;
+/// Number of nodes of the global barrier tree that wait for cluster
+/// `cluster_idx`, of the first `num_clusters` clusters.
+inline uint32_t snrt_global_barrier_children(uint32_t cluster_idx,
+                                             uint32_t num_clusters) {
+    uint32_t children = 0;
+    // A quadrant leader waits for the other clusters in its quadrant
+    if (cluster_idx % SNRT_QUADRANT_CLUSTER_NUM == 0) {
+        uint32_t quadrant_size = num_clusters - cluster_idx;
+        if (quadrant_size > SNRT_QUADRANT_CLUSTER_NUM)
+            quadrant_size = SNRT_QUADRANT_CLUSTER_NUM;
+        children += quadrant_size - 1;
+    }
+    // The root waits for the leaders of the other quadrants
+    if (cluster_idx == 0)
+        children += (num_clusters - 1) / SNRT_QUADRANT_CLUSTER_NUM;
+    return children;
+}
+
+/// Park the DM core in WFI until `*var` equals `value`. The core is woken up
+/// through its cluster-local interrupt.
+inline void snrt_global_barrier_wait(volatile uint32_t *var, uint32_t value) {
+    // A wakeup that arrives before the WFI stays pending, and turns the WFI
+    // into a NOP. Re-check the condition after every wakeup, as it may be
+    // spurious, or left over from an earlier wait.
+    while (*var != value) {
+        snrt_wfi();
+        snrt_int_clr_mcip();
+    }
+}
+
+/// Wake up the DM core of cluster `cluster_idx`.
+inline void snrt_global_barrier_wake(uint32_t cluster_idx) {
+    snrt_int_cluster_set_remote(cluster_idx,
+                                1 << snrt_cluster_compute_core_num());
+}
+
+/**
+ * @brief Synchronize the DM cores of the first `num_clusters` clusters
+ * @details The clusters form a tree: the leader of each quadrant, its first
+ * cluster, waits for the other clusters in the quadrant, and cluster 0 in
+ * turn waits for the other quadrant leaders. Every cluster only updates the
+ * node of its parent, once per barrier, and waiting cores sleep in WFI until
+ * the last arriving child or the parent wakes them through their cluster-local
+ * interrupt. The barrier consumes the cluster-local interrupt of the DM cores.
+ *
+ * @param num_clusters number of clusters that take part, which must include
+ * the calling one. Barriers over different numbers of clusters must not
+ * overlap in time, as they share the nodes of the tree.
+ */
+inline void snrt_global_dm_barrier(uint32_t num_clusters) {
+    uint32_t idx = snrt_cluster_idx();
+    uint32_t leader = idx - idx % SNRT_QUADRANT_CLUSTER_NUM;
+    uint32_t parent = idx == leader ? 0 : leader;
+    uint32_t children = snrt_global_barrier_children(idx, num_clusters);
+    volatile snrt_barrier_t *node = &_snrt_barrier_tree[idx];
+
+    uint32_t mie = read_csr(mie);
+    snrt_interrupt_enable(IRQ_M_CLUSTER);
+
+    // Wait for the subtree to arrive
+    if (children) {
+        snrt_global_barrier_wait(&node->cnt, children);
+        node->cnt = 0;
+    }
+
+    // Arrive at the parent, waking it up if this completes its children, and
+    // wait for the release
+    if (idx != 0) {
+        volatile snrt_barrier_t *up = &_snrt_barrier_tree[parent];
+        uint32_t iteration = up->iteration;
+        uint32_t cnt = __atomic_add_fetch(&up->cnt, 1, __ATOMIC_RELAXED);
+        if (cnt == snrt_global_barrier_children(parent, num_clusters))
+            snrt_global_barrier_wake(parent);
+        snrt_global_barrier_wait(&up->iteration, iteration + 1);
+    }
+
+    // Release the subtree. Stores to different targets are not ordered, so
+    // the update must have completed before the stores that wake the
+    // children, or a child could miss it and sleep forever.
+    if (children) {
+        __atomic_add_fetch(&node->iteration, 1, __ATOMIC_RELEASE);
+        asm volatile("fence" ::: "memory");
+        if (idx == leader) {
+            for (uint32_t i = idx + 1;
+                 i < leader + SNRT_QUADRANT_CLUSTER_NUM && i < num_clusters;
+                 i++)
+                snrt_global_barrier_wake(i);
+        }
+        if (idx == 0) {
+            for (uint32_t i = SNRT_QUADRANT_CLUSTER_NUM; i < num_clusters;
+                 i += SNRT_QUADRANT_CLUSTER_NUM)
+                snrt_global_barrier_wake(i);
         }
     }
+
+    if (!(mie & MIE_MCIE)) snrt_interrupt_disable(IRQ_M_CLUSTER);
+}
+
+/// Synchronize clusters globally with a hierarchical software barrier
+inline void snrt_global_barrier() {
+    // Synchronize all DM cores in software
+    if (snrt_is_dm_core()) snrt_global_dm_barrier(snrt_cluster_num());
     // Synchronize cores in a cluster with the HW barrier
     snrt_cluster_hw_barrier();
 }
@@ -0,0 +1,48 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#include <snrt.h>
+
+// Number of doubles in the buffers
+#define N 64
+
+// Buffers of each cluster, allocated by its first core. Not in the BSS, which
+// cluster 0 may still be clearing when the other clusters allocate.
+double *share_buf[SNRT_CLUSTER_NUM] __attribute__((section(".data")));
+double *share_tmp[SNRT_CLUSTER_NUM] __attribute__((section(".data")));
+
+// Broadcasts a buffer from the last cluster and sums a buffer across all
+// clusters, checking the results on every cluster.
+int main() {
+    uint32_t cluster_idx = snrt_cluster_idx();
+    uint32_t num_clusters = snrt_cluster_num();
+    uint32_t root = num_clusters - 1;
+    uint32_t errors = 0;
+
+    // The same allocations on every cluster yield the same TCDM offsets
+    if (snrt_cluster_core_idx() == 0) {
+        share_buf[cluster_idx] = snrt_l1alloc(N * sizeof(double));
+        share_tmp[cluster_idx] = snrt_l1alloc(N * sizeof(double));
+    }
+    snrt_cluster_hw_barrier();
+    double *buf = share_buf[cluster_idx];
+    double *tmp = share_tmp[cluster_idx];
+
+    if (snrt_cluster_core_idx() == 0)
+        for (uint32_t i = 0; i < N; i++)
+            buf[i] = cluster_idx == root ? i : 0;
+    snrt_broadcast(buf, N * sizeof(double), root, num_clusters);
+    if (snrt_cluster_core_idx() == 0)
+        for (uint32_t i = 0; i < N; i++) errors += buf[i] != i;
+
+    if (snrt_cluster_core_idx() == 0)
+        for (uint32_t i = 0; i < N; i++) buf[i] = i + cluster_idx;
+    snrt_allreduce_sum(buf, tmp, N, num_clusters);
+    if (snrt_cluster_core_idx() == 0) {
+        uint32_t offset = num_clusters * (num_clusters - 1) / 2;
+        for (uint32_t i = 0; i < N; i++)
+            errors += buf[i] != i * num_clusters + offset;
+    }
+
+    return errors;
+}
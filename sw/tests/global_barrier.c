@@ -0,0 +1,37 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#include "printf.h"
+#include "snrt.h"
+
+// Number of barriers averaged over for each cluster count
+#define REPS 16
+
+// Synchronizes all clusters between the measurements. The clusters that do
+// not take part in a measurement must not enter the barrier tree while the
+// others still use it. Not in the BSS, which cluster 0 may clear while other
+// clusters already arrive.
+snrt_barrier_t sync_barrier __attribute__((section(".data")));
+
+// Measures the latency of the global barrier of the DM cores against the
+// number of clusters taking part in it.
+int main() {
+    uint32_t cluster_idx = snrt_cluster_idx();
+
+    for (uint32_t n = 1; n <= snrt_cluster_num(); n++) {
+        uint32_t cycles = 0;
+        if (snrt_is_dm_core() && cluster_idx < n) {
+            // Warm up, and align the clusters
+            snrt_global_dm_barrier(n);
+            uint32_t start = mcycle();
+            for (uint32_t i = 0; i < REPS; i++) snrt_global_dm_barrier(n);
+            cycles = (mcycle() - start) / REPS;
+        }
+        if (snrt_is_dm_core())
+            snrt_partial_barrier(&sync_barrier, snrt_cluster_num());
+        snrt_cluster_hw_barrier();
+        if (snrt_is_dm_core() && cluster_idx == 0)
+            printf("%u clusters: %u cycles\n", n, cycles);
+    }
+    return 0;
+}
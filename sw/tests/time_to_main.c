@@ -0,0 +1,33 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+#include <snrt.h>
+
+#include "printf.h"
+
+// Prints the cycle at which main is entered. The time to main without the
+// DMA initialization is measured with a runtime built without the
+// SNRT_INIT_DMA define in its start file, e.g. snitch_cluster_start.c.
+
+// Large enough for the BSS initialization to dominate the startup time
+#define BSS_WORDS 16384
+
+uint32_t bss_buf[BSS_WORDS];
+__thread uint32_t tls_data[4] = {1, 2, 3, 4};
+__thread uint32_t tls_bss[4];
+
+int main() {
+    uint32_t cycles = mcycle();
+    int errors = 0;
+
+    // Check that the startup code initialized the sections it copied or
+    // cleared.
+    for (uint32_t i = 0; i < 4; i++) {
+        errors += (tls_data[i] != i + 1) + (tls_bss[i] != 0);
+    }
+    if (snrt_global_core_idx() == 0) {
+        for (uint32_t i = 0; i < BSS_WORDS; i++) errors += (bss_buf[i] != 0);
+        printf("Time to main: %u cycles\n", cycles);
+    }
+    return errors;
+}